@@ -27,10 +27,49 @@
  *   a cache that should be used by #GtkIImageTool's when redrawing
  *   the #GtkImageView.
  * </para>
+ * <para>
+ *   Scaled pixels are kept in tiles of
+ *   #GDK_PIXBUF_DRAW_CACHE_TILE_SIZE by
+ *   #GDK_PIXBUF_DRAW_CACHE_TILE_SIZE zoom-space pixels. Each tile is
+ *   keyed by the pixbuf, zoom, interpolation and its position in the
+ *   tile grid so that returning to an area or zoom level drawn
+ *   recently only costs a copy.
+ * </para>
+ * <para>
+ *   The tiles are held by a #GdkPixbufTileStore. Normally each cache
+ *   has its own, but caches can share one process-wide store so that
+ *   several views showing the same pixbuf only scale it once, within
+ *   one memory limit.
+ * </para>
+ * <para>
+ *   Tiles of pixbufs with alpha hold the scaled pixels premultiplied
+ *   by alpha, without the checkerboard. They are composited over the
+ *   checkerboard each time they are used, which is much cheaper than
+ *   scaling, so changing the check colors does not rescale anything
+ *   and scrolling a transparent image costs about as much as
+ *   scrolling an opaque one.
+ * </para>
+ * <para>
+ *   The last draw is kept in a ring buffer, mirrored by a server side
+ *   pixmap, in which each zoom-space pixel has a fixed place. When
+ *   the view is scrolled, the pixels that are still visible are not
+ *   moved. Only the newly exposed strips are written, wrapping around
+ *   the edges of the buffer, and the visible area is copied to the
+ *   drawable in at most four pieces.
+ * </para>
+ * <para>
+ *   Instead of a pixbuf, the draw options can name a
+ *   #GtkIImageSource. Each tile is then scaled from only the pixels
+ *   of the source level it samples, read when the tile is scaled, so
+ *   the image never has to be in memory as a whole.
+ * </para>
  **/
 #include "gdkpixbufdrawcache.h"
+#include "gdkpixbufmemory.h"
+#include "gdkpixbufpyramid.h"
+#include "pixops.h"
 #include "utils.h"
-#include <string.h>
+#include <math.h>
 
 static gboolean
 gdk_rectangle_contains_rect (GdkRectangle r1, GdkRectangle r2)
@@ -42,50 +81,883 @@ gdk_rectangle_contains_rect (GdkRectangle r1, GdkRectangle r2)
         (r2.y + r2.height) <= (r1.y + r1.height);
 }
 
+typedef struct
+{
+    /* The pixbuf or image source drawn. */
+    gpointer       image;
+    /* The pixbuf or pyramid level the tile is scaled from, or the
+       image source. Pyramids are not shared, so tiles scaled from the
+       pyramids of different views must not be mixed up. */
+    gpointer       source;
+    gdouble        zoom;
+    GdkInterpType  interp;
+    /* Level of the image pyramid the tile is scaled from. */
+    int            level;
+    int            col;
+    int            row;
+} TileKey;
+
+typedef struct
+{
+    TileKey        key;
+    /* Area in zoom-space coordinates the tile covers. */
+    GdkRectangle   rect;
+    GdkPixbuf     *scaled;
+    gsize          size;
+    GList         *link;
+    /* The draw of the store the tile was last used or added in. */
+    guint          draw;
+} Tile;
+
+static guint
+tile_key_hash (gconstpointer key)
+{
+    const TileKey *k = key;
+    guint hash = g_direct_hash (k->image);
+    hash = hash * 31 + g_direct_hash (k->source);
+    hash = hash * 31 + (guint) (k->zoom * 65536.0);
+    hash = hash * 31 + k->interp;
+    hash = hash * 31 + k->level;
+    hash = hash * 31 + k->col;
+    hash = hash * 31 + k->row;
+    return hash;
+}
+
+static gboolean
+tile_key_equal (gconstpointer a,
+                gconstpointer b)
+{
+    const TileKey *k1 = a;
+    const TileKey *k2 = b;
+    return
+        k1->image == k2->image &&
+        k1->source == k2->source &&
+        k1->zoom == k2->zoom &&
+        k1->interp == k2->interp &&
+        k1->level == k2->level &&
+        k1->col == k2->col &&
+        k1->row == k2->row;
+}
+
+typedef struct
+{
+    /* The cache the job belongs to, or %NULL if the cache has been
+       invalidated or freed since the job was queued. */
+    GdkPixbufDrawCache *cache;
+    TileKey             key;
+    /* The pixbuf or pyramid level to scale from, or %NULL to read
+       from the image source. */
+    GdkPixbuf          *src;
+    GdkRectangle        rect;
+    int                 check_size;
+    volatile gint       cancelled;
+    /* Set if the pixels the tile is scaled from have changed since
+       the job was queued, so that the tile must not be kept. */
+    gboolean            stale;
+    GdkPixbuf          *scaled;
+} TileJob;
+
+static GThreadPool *tile_pool = NULL;
+
+/* The tile store shared by caches, or %NULL if no cache shares. */
+static GdkPixbufTileStore *shared_store = NULL;
+
+/**
+ * gdk_pixbuf_draw_opts_get_image:
+ *
+ * Returns the image source the options draw, or the pixbuf if they
+ * have none. The image identifies the tiles scaled from it.
+ **/
+static gpointer
+gdk_pixbuf_draw_opts_get_image (GdkPixbufDrawOpts *opts)
+{
+    if (opts->source)
+        return opts->source;
+    return opts->pixbuf;
+}
+
+/**
+ * gdk_pixbuf_draw_opts_get_zoomed_size:
+ *
+ * Returns the size of the image of @opts at the zoom of @opts.
+ **/
+static Size
+gdk_pixbuf_draw_opts_get_zoomed_size (GdkPixbufDrawOpts *opts)
+{
+    int width, height;
+    if (opts->source)
+        gtk_iimage_source_get_size (opts->source, &width, &height);
+    else
+    {
+        width = gdk_pixbuf_get_width (opts->pixbuf);
+        height = gdk_pixbuf_get_height (opts->pixbuf);
+    }
+    return (Size){
+        (int) (width * opts->zoom + 0.5),
+        (int) (height * opts->zoom + 0.5)
+    };
+}
+
+static gboolean
+tile_key_matches_opts (TileKey           *key,
+                       GdkPixbufDrawOpts *opts)
+{
+    return
+        key->image == gdk_pixbuf_draw_opts_get_image (opts) &&
+        key->zoom == opts->zoom &&
+        key->interp == opts->interp;
+}
+
+/**
+ * gdk_pixbuf_draw_cache_get_source:
+ *
+ * Returns the pixbuf to scale from to draw @opts. If the draw
+ * options has an image pyramid of the pixbuf, the smallest pyramid
+ * level that is larger than the zoomed pixbuf is returned and @level
+ * is set to it. Otherwise, the pixbuf itself is returned.
+ *
+ * Asynchronous draws do not wait for the level to be built. Until it
+ * is, a larger level is returned and @pending is set to %TRUE.
+ *
+ * If the draw options have an image source, %NULL is returned and
+ * @level is set to the level of the source to read from.
+ **/
+static GdkPixbuf *
+gdk_pixbuf_draw_cache_get_source (GdkPixbufDrawOpts *opts,
+                                  int               *level,
+                                  gboolean          *pending)
+{
+    GdkPixbufPyramid *pyramid = opts->pyramid;
+    *level = 0;
+    *pending = FALSE;
+    if (opts->source)
+    {
+        *level = gtk_iimage_source_get_level_for_zoom (opts->source,
+                                                       opts->zoom);
+        return NULL;
+    }
+    if (!pyramid || pyramid->pixbuf != opts->pixbuf)
+        return opts->pixbuf;
+    *level = gdk_pixbuf_pyramid_get_level_for_zoom (pyramid, opts->zoom);
+    if (!opts->async)
+        return gdk_pixbuf_pyramid_get_level (pyramid, *level);
+
+    int wanted = *level;
+    GdkPixbuf *src = gdk_pixbuf_pyramid_request_level (pyramid, level);
+    *pending = *level != wanted;
+    return src;
+}
+
+/**
+ * gdk_pixbuf_draw_cache_read_scaled:
+ *
+ * Scales the area @rect, in zoom-space coordinates, of the image
+ * @source at @zoom into @dst at @dst_x, @dst_y, from level @level of
+ * the source. Only the pixels of the level that the area samples are
+ * read. Like gdk_pixbuf_scale_blend(), pixels with alpha are
+ * composited over the checkerboard, unless @dst has alpha in which
+ * case they are stored premultiplied.
+ **/
+static void
+gdk_pixbuf_draw_cache_read_scaled (GtkIImageSource *source,
+                                   int              level,
+                                   gdouble          zoom,
+                                   GdkInterpType    interp,
+                                   GdkRectangle    *rect,
+                                   GdkPixbuf       *dst,
+                                   int              dst_x,
+                                   int              dst_y,
+                                   int              check_size,
+                                   int              color1,
+                                   int              color2)
+{
+    gdouble level_zoom = zoom * (1 << level);
+    int width, height;
+    gtk_iimage_source_get_level_size (source, level, &width, &height);
+
+    /* The pixels sampled and those the filter reads around them,
+       clamped to the level like the taps are. */
+    int extent = MAX (rect->x + rect->width, rect->y + rect->height);
+    int margin = gdk_pixbuf_get_scale_margin (level_zoom, interp, extent);
+    GdkRectangle area = {
+        rect->x - margin, rect->y - margin,
+        rect->width + 2 * margin, rect->height + 2 * margin
+    };
+    gdk_rectangle_unzoom (&area, level_zoom, &area);
+    int x0 = CLAMP (area.x, 0, width - 1);
+    int y0 = CLAMP (area.y, 0, height - 1);
+    int x1 = CLAMP (area.x + area.width, x0 + 1, width);
+    int y1 = CLAMP (area.y + area.height, y0 + 1, height);
+    area = (GdkRectangle){x0, y0, x1 - x0, y1 - y0};
+
+    GdkPixbuf *pixels = gtk_iimage_source_read_area (source, level, &area);
+    pixops_scale_area (pixels, area.x, area.y, width, height,
+                       dst,
+                       dst_x, dst_y,
+                       rect->width, rect->height,
+                       (double) (dst_x - rect->x),
+                       (double) (dst_y - rect->y),
+                       level_zoom,
+                       interp,
+                       rect->x, rect->y,
+                       check_size,
+                       color1,
+                       color2);
+    g_object_unref (pixels);
+}
+
+/**
+ * gdk_pixbuf_scale_tile:
+ *
+ * Scales the area @rect of the tile described by @key from @src,
+ * which is level <structfield>level</structfield> of the image
+ * pyramid of the pixbuf, or from the image source if @src is
+ * %NULL. If the image has alpha, the tile gets premultiplied pixels
+ * with alpha and is not composited.
+ **/
+static GdkPixbuf *
+gdk_pixbuf_scale_tile (GdkPixbuf    *src,
+                       TileKey      *key,
+                       GdkRectangle *rect,
+                       int           check_size,
+                       int           n_threads)
+{
+    if (!src)
+    {
+        GtkIImageSource *source = key->source;
+        GdkPixbuf *scaled =
+            gdk_pixbuf_new (GDK_COLORSPACE_RGB,
+                            gtk_iimage_source_get_has_alpha (source),
+                            8,
+                            rect->width, rect->height);
+        gdk_pixbuf_draw_cache_read_scaled (source, key->level,
+                                           key->zoom, key->interp,
+                                           rect, scaled, 0, 0,
+                                           check_size, 0, 0);
+        return scaled;
+    }
+    GdkPixbuf *scaled =
+        gdk_pixbuf_new (gdk_pixbuf_get_colorspace (src),
+                        gdk_pixbuf_get_has_alpha (src),
+                        gdk_pixbuf_get_bits_per_sample (src),
+                        rect->width, rect->height);
+    if (gdk_pixbuf_get_has_alpha (src))
+        gdk_pixbuf_scale_premultiplied_parallel (src,
+                                                 scaled,
+                                                 0, 0,
+                                                 rect->width, rect->height,
+                                                 (double) -rect->x,
+                                                 (double) -rect->y,
+                                                 key->zoom * (1 << key->level),
+                                                 key->interp,
+                                                 n_threads);
+    else
+        gdk_pixbuf_scale_blend_parallel (src,
+                                         scaled,
+                                         0, 0,
+                                         rect->width, rect->height,
+                                         (double) -rect->x, (double) -rect->y,
+                                         key->zoom * (1 << key->level),
+                                         key->interp,
+                                         rect->x, rect->y,
+                                         check_size,
+                                         0, 0,
+                                         n_threads);
+    return scaled;
+}
+
+/**
+ * tile_reads_area:
+ *
+ * Returns %TRUE if the tile described by @key and @rect is scaled
+ * from pixels in the area @area of the full size pixbuf. The tile's
+ * area is grown by gdk_pixbuf_get_scale_margin() before it is mapped
+ * back to image space, so that pixels the filters read around the
+ * sampled ones are included.
+ **/
+static gboolean
+tile_reads_area (TileKey      *key,
+                 GdkRectangle *rect,
+                 GdkRectangle *area)
+{
+    // The tile is scaled from a pyramid level with zoom multiplied by
+    // 2^level and each pixel of that level averages 2^level pixels
+    // of the full size pixbuf in each direction.
+    gdouble level_zoom = key->zoom * (1 << key->level);
+    int extent = MAX (rect->x + rect->width, rect->y + rect->height);
+    int margin =
+        gdk_pixbuf_get_scale_margin (level_zoom, key->interp, extent);
+    GdkRectangle src = {
+        rect->x - margin, rect->y - margin,
+        rect->width + 2 * margin, rect->height + 2 * margin
+    };
+    gdk_rectangle_unzoom (&src, level_zoom, &src);
+    src.x *= 1 << key->level;
+    src.y *= 1 << key->level;
+    src.width *= 1 << key->level;
+    src.height *= 1 << key->level;
+    return gdk_rectangle_intersect (&src, area, &src);
+}
+
+static void
+tile_store_source_finalized_cb (gpointer  data,
+                                GObject  *where_the_object_was);
+
+static void
+tile_store_remove (GdkPixbufTileStore *store,
+                   Tile               *tile)
+{
+    gpointer source = tile->key.source;
+    int n_tiles = GPOINTER_TO_INT (g_hash_table_lookup (store->sources,
+                                                        source));
+    if (n_tiles == 1)
+    {
+        g_hash_table_remove (store->sources, source);
+        g_object_weak_unref (G_OBJECT (source),
+                             tile_store_source_finalized_cb, store);
+    }
+    else if (n_tiles > 1)
+        g_hash_table_insert (store->sources, source,
+                             GINT_TO_POINTER (n_tiles - 1));
+
+    g_hash_table_remove (store->tiles, &tile->key);
+    g_queue_delete_link (store->lru, tile->link);
+    store->size -= tile->size;
+    g_object_unref (tile->scaled);
+    g_free (tile);
+}
+
+/**
+ * tile_store_remove_area:
+ *
+ * Removes the tiles of @image, or of any image if it is %NULL, that
+ * are scaled from pixels in @area, or all of them if @area is %NULL.
+ **/
+static void
+tile_store_remove_area (GdkPixbufTileStore *store,
+                        gpointer            image,
+                        GdkRectangle       *area)
+{
+    GList *next;
+    for (GList *link = store->lru->head; link; link = next)
+    {
+        next = link->next;
+        Tile *tile = link->data;
+        if ((!image || tile->key.image == image) &&
+            (!area || tile_reads_area (&tile->key, &tile->rect, area)))
+            tile_store_remove (store, tile);
+    }
+}
+
+/**
+ * tile_store_source_finalized_cb:
+ *
+ * Called when a pixbuf or image source that tiles are scaled from
+ * is finalized. Its tiles can never be used again and another object
+ * could later be allocated at the same address, so they are removed.
+ **/
+static void
+tile_store_source_finalized_cb (gpointer  data,
+                                GObject  *where_the_object_was)
+{
+    GdkPixbufTileStore *store = data;
+    /* The weak reference is already gone. */
+    g_hash_table_remove (store->sources, where_the_object_was);
+    GList *next;
+    for (GList *link = store->lru->head; link; link = next)
+    {
+        next = link->next;
+        Tile *tile = link->data;
+        if (tile->key.source == (gpointer) where_the_object_was)
+            tile_store_remove (store, tile);
+    }
+}
+
+/**
+ * tile_store_trim:
+ *
+ * Evicts the least recently used tiles until the store is within its
+ * memory limit and the memory used by all buffers is within the
+ * limit set with gdk_pixbuf_memory_set_limit().
+ *
+ * The tiles used or added since the latest draw are kept even if the
+ * total is over the limit. Evicting them would only make the next
+ * draw scale them again, and asynchronous draws would never finish.
+ **/
+static void
+tile_store_trim (GdkPixbufTileStore *store)
+{
+    while (store->size && (store->size > store->max_size ||
+                           gdk_pixbuf_memory_is_over_limit ()))
+    {
+        Tile *tile = g_queue_peek_tail (store->lru);
+        if (tile->draw == store->n_draws)
+            break;
+        tile_store_remove (store, tile);
+    }
+}
+
+/**
+ * tile_store_shrink_cb:
+ *
+ * Evicts the least recently used tiles while the total memory is
+ * over the limit. The tiles of the latest draw are only evicted if
+ * nothing has been drawn since the store was last asked to shrink,
+ * so that tiles finished by worker threads survive until they have
+ * been drawn.
+ **/
 static void
-gdk_pixbuf_copy_area_intact (GdkPixbuf *src,
-                             int        src_x,
-                             int        src_y,
-                             int        width,
-                             int        height,
-                             GdkPixbuf *dst,
-                             int        dst_x,
-                             int        dst_y)
-{
-    if (src_x == dst_x && src_y == dst_y && src == dst)
+tile_store_shrink_cb (gpointer data)
+{
+    GdkPixbufTileStore *store = data;
+    gboolean keep_latest = store->n_draws != store->shrunk_draw;
+    store->shrunk_draw = store->n_draws;
+    while (store->size && gdk_pixbuf_memory_is_over_limit ())
+    {
+        Tile *tile = g_queue_peek_tail (store->lru);
+        if (keep_latest && tile->draw == store->n_draws)
+            break;
+        tile_store_remove (store, tile);
+    }
+}
+
+static Tile *
+tile_store_lookup (GdkPixbufTileStore *store,
+                   TileKey            *key)
+{
+    Tile *tile = g_hash_table_lookup (store->tiles, key);
+    if (tile)
+    {
+        /* Move the tile to the front of the queue. */
+        g_queue_unlink (store->lru, tile->link);
+        g_queue_push_head_link (store->lru, tile->link);
+        tile->draw = store->n_draws;
+    }
+    return tile;
+}
+
+/**
+ * tile_store_add:
+ *
+ * Adds a newly scaled tile to the store which takes over the
+ * reference to @scaled.
+ **/
+static Tile *
+tile_store_add (GdkPixbufTileStore *store,
+                TileKey            *key,
+                GdkRectangle       *rect,
+                GdkPixbuf          *scaled)
+{
+    Tile *tile = g_new0 (Tile, 1);
+    tile->key = *key;
+    tile->rect = *rect;
+    tile->scaled = scaled;
+    tile->size = gdk_pixbuf_get_rowstride (scaled) * rect->height;
+    tile->draw = store->n_draws;
+    store->size += tile->size;
+    gdk_pixbuf_memory_track_pixbuf (scaled, GDK_PIXBUF_MEMORY_TILES);
+
+    g_queue_push_head (store->lru, tile);
+    tile->link = g_queue_peek_head_link (store->lru);
+    g_hash_table_insert (store->tiles, &tile->key, tile);
+
+    gpointer source = key->source;
+    int n_tiles = GPOINTER_TO_INT (g_hash_table_lookup (store->sources,
+                                                        source));
+    if (!n_tiles)
+        g_object_weak_ref (G_OBJECT (source),
+                           tile_store_source_finalized_cb, store);
+    g_hash_table_insert (store->sources, source,
+                         GINT_TO_POINTER (n_tiles + 1));
+    return tile;
+}
+
+static GdkPixbufTileStore *
+tile_store_new (gboolean shared)
+{
+    GdkPixbufTileStore *store = g_new0 (GdkPixbufTileStore, 1);
+    store->ref_count = 0;
+    store->shared = shared;
+    store->tiles = g_hash_table_new (tile_key_hash, tile_key_equal);
+    store->lru = g_queue_new ();
+    store->size = 0;
+    store->max_size = GDK_PIXBUF_DRAW_CACHE_MAX_SIZE;
+    store->n_draws = 0;
+    store->shrunk_draw = 0;
+    store->sources = g_hash_table_new (g_direct_hash, g_direct_equal);
+    store->caches = NULL;
+    gdk_pixbuf_memory_add_shrinker (GDK_PIXBUF_MEMORY_TILES,
+                                    tile_store_shrink_cb, store);
+    return store;
+}
+
+/**
+ * tile_store_attach:
+ *
+ * Makes @cache keep its tiles in @store.
+ **/
+static void
+tile_store_attach (GdkPixbufTileStore *store,
+                   GdkPixbufDrawCache *cache)
+{
+    store->ref_count++;
+    store->caches = g_slist_prepend (store->caches, cache);
+    cache->store = store;
+}
+
+/**
+ * tile_store_detach:
+ *
+ * Stops @cache from using its tile store, which is freed along with
+ * its tiles if no other cache uses it.
+ **/
+static void
+tile_store_detach (GdkPixbufDrawCache *cache)
+{
+    GdkPixbufTileStore *store = cache->store;
+    cache->store = NULL;
+    store->caches = g_slist_remove (store->caches, cache);
+    if (--store->ref_count)
         return;
-    
-    int src_stride = gdk_pixbuf_get_rowstride (src);
-    int dst_stride = gdk_pixbuf_get_rowstride (dst);
-    int chans = gdk_pixbuf_get_n_channels (src);
+    gdk_pixbuf_memory_remove_shrinker (tile_store_shrink_cb, store);
+    tile_store_remove_area (store, NULL, NULL);
+    g_hash_table_destroy (store->tiles);
+    g_queue_free (store->lru);
+    g_hash_table_destroy (store->sources);
+    if (store == shared_store)
+        shared_store = NULL;
+    g_free (store);
+}
 
-    int linelen = width * chans;
+/**
+ * tile_job_done_cb:
+ *
+ * Called in the main loop when a worker thread has finished, or
+ * skipped, a tile job. A scaled tile is added to the cache and the
+ * cache's #GdkPixbufDrawCacheFunc is told about it so that the area
+ * can be redrawn. A skipped tile that is still wanted is reported
+ * the same way so that it is requested again if it is visible.
+ **/
+static gboolean
+tile_job_done_cb (gpointer data)
+{
+    TileJob *job = data;
+    GdkPixbufDrawCache *cache = job->cache;
+    if (cache)
+    {
+        g_hash_table_remove (cache->jobs, &job->key);
+        if (job->scaled && !job->stale &&
+            !g_hash_table_lookup (cache->store->tiles, &job->key))
+        {
+            tile_store_add (cache->store, &job->key, &job->rect,
+                            job->scaled);
+            job->scaled = NULL;
+            tile_store_trim (cache->store);
+        }
+        if (cache->ready_func &&
+            tile_key_matches_opts (&job->key, &cache->last_opts))
+            cache->ready_func (cache, &job->rect, cache->ready_data);
+    }
+    if (job->scaled)
+        g_object_unref (job->scaled);
+    g_object_unref (job->key.image);
+    if (job->src)
+        g_object_unref (job->src);
+    g_free (job);
+    return FALSE;
+}
 
-    guchar *src_base = gdk_pixbuf_get_pixels (src);
-    guchar *dst_base = gdk_pixbuf_get_pixels (dst);
+static void
+tile_job_func (gpointer data,
+               gpointer user_data)
+{
+    TileJob *job = data;
+    if (!g_atomic_int_get (&job->cancelled))
+        job->scaled = gdk_pixbuf_scale_tile (job->src, &job->key,
+                                             &job->rect, job->check_size, 1);
+    g_idle_add (tile_job_done_cb, job);
+}
 
-    int src_y_ofs = src_y * src_stride;
-    int dst_y_ofs = dst_y * dst_stride;
-    if (dst_y > src_y)
+/**
+ * gdk_pixbuf_draw_cache_request_tile:
+ *
+ * Queues a job to scale a tile on a worker thread, unless such a job
+ * already is pending in which case it is made sure that it is not
+ * cancelled.
+ **/
+static void
+gdk_pixbuf_draw_cache_request_tile (GdkPixbufDrawCache *cache,
+                                    GdkPixbuf          *src,
+                                    TileKey            *key,
+                                    GdkRectangle       *rect,
+                                    int                 n_threads)
+{
+    TileJob *job = g_hash_table_lookup (cache->jobs, key);
+    if (job)
     {
-        src_y_ofs = (src_y + height - 1) * src_stride;
-        dst_y_ofs = (dst_y + height - 1) * dst_stride;
-        src_stride = -src_stride;
-        dst_stride = -dst_stride;
+        g_atomic_int_set (&job->cancelled, FALSE);
+        return;
     }
-    guchar *src_ofs = src_base + src_y_ofs + src_x * chans;
-    guchar *dst_ofs = dst_base + dst_y_ofs + dst_x * chans;
+    job = g_new0 (TileJob, 1);
+    job->cache = cache;
+    job->key = *key;
+    job->rect = *rect;
+    job->check_size = cache->check_size;
+    job->src = src ? g_object_ref (src) : NULL;
+    g_object_ref (key->image);
+    g_hash_table_insert (cache->jobs, &job->key, job);
+
+    n_threads = MAX (n_threads, 1);
+    if (!tile_pool)
+        tile_pool = g_thread_pool_new (tile_job_func, NULL,
+                                       n_threads, FALSE, NULL);
+    else if (g_thread_pool_get_max_threads (tile_pool) < n_threads)
+        g_thread_pool_set_max_threads (tile_pool, n_threads, NULL);
+    g_thread_pool_push (tile_pool, job, NULL);
+}
+
+static void
+tile_job_cancel (gpointer key,
+                 gpointer value,
+                 gpointer user_data)
+{
+    TileJob *job = value;
+    g_atomic_int_set (&job->cancelled, TRUE);
+}
 
-    void (*copy_func)(void *, void *, size_t) = (void *) memcpy;
-    if (dst_x > src_x)
-        copy_func = (void *) memmove;
+static gboolean
+tile_job_detach (gpointer key,
+                 gpointer value,
+                 gpointer user_data)
+{
+    TileJob *job = value;
+    g_atomic_int_set (&job->cancelled, TRUE);
+    job->cache = NULL;
+    return TRUE;
+}
+
+/**
+ * gdk_pixbuf_draw_cache_scale_nearest:
+ *
+ * Fills the area @rect, in zoom-space coordinates, of the image into
+ * the cache's pixbuf at @dst_x, @dst_y with a quick nearest neighbour
+ * scale from @src, which is level @level of the pixbuf's pyramid.
+ *
+ * This is done in the main loop, so image sources are only read from
+ * the level they can read quickly, or from @level if it is after
+ * that one. If they cannot read any level quickly yet, the area is
+ * filled with the checkerboard until their tiles are ready.
+ **/
+static void
+gdk_pixbuf_draw_cache_scale_nearest (GdkPixbufDrawCache *cache,
+                                     GdkPixbufDrawOpts  *opts,
+                                     GdkPixbuf          *src,
+                                     int                 level,
+                                     GdkRectangle       *rect,
+                                     int                 dst_x,
+                                     int                 dst_y,
+                                     int                 n_threads)
+{
+    if (src)
+    {
+        gdk_pixbuf_scale_blend_parallel (src,
+                                         cache->last_pixbuf,
+                                         dst_x, dst_y,
+                                         rect->width, rect->height,
+                                         (double) (dst_x - rect->x),
+                                         (double) (dst_y - rect->y),
+                                         opts->zoom * (1 << level),
+                                         GDK_INTERP_NEAREST,
+                                         rect->x, rect->y,
+                                         cache->check_size,
+                                         opts->check_color1,
+                                         opts->check_color2,
+                                         n_threads);
+        return;
+    }
+    int fast = gtk_iimage_source_get_fast_level (opts->source);
+    if (fast >= 0)
+    {
+        gdk_pixbuf_draw_cache_read_scaled (opts->source,
+                                           MAX (level, fast),
+                                           opts->zoom,
+                                           GDK_INTERP_NEAREST,
+                                           rect,
+                                           cache->last_pixbuf,
+                                           dst_x, dst_y,
+                                           cache->check_size,
+                                           opts->check_color1,
+                                           opts->check_color2);
+        return;
+    }
+    /* Scaling a transparent pixel composites nothing over the
+       checkerboard. */
+    GdkPixbuf *clear = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 1, 1);
+    gdk_pixbuf_fill (clear, 0);
+    gdk_pixbuf_scale_blend (clear,
+                            cache->last_pixbuf,
+                            dst_x, dst_y,
+                            rect->width, rect->height,
+                            (double) (dst_x - rect->x),
+                            (double) (dst_y - rect->y),
+                            1.0,
+                            GDK_INTERP_NEAREST,
+                            rect->x, rect->y,
+                            cache->check_size,
+                            opts->check_color1,
+                            opts->check_color2);
+    g_object_unref (clear);
+}
 
-    for (int y = 0; y < height; y++)
+/**
+ * gdk_pixbuf_draw_cache_scale:
+ *
+ * Fills the area @rect, in zoom-space coordinates, of the scaled
+ * pixbuf into the cache's pixbuf at @dst_x, @dst_y. The area is
+ * assembled from cached tiles and only the tiles missing are scaled
+ * from the source pixbuf. If the area is not completely inside the
+ * zoomed image or if tile caching is turned off, the area is scaled
+ * directly.
+ *
+ * When drawing asynchronously, missing tiles are instead requested
+ * from the worker threads and their area is filled with a quick
+ * nearest neighbour scale in the meantime. So is all of @rect while
+ * the pyramid level to scale from is being built. Progressive draws fill in
+ * missing pixels the same way, but leave it to the caller to draw
+ * them again.
+ *
+ * Image sources are scaled the same way, except that the pixels are
+ * read from the source for each tile or area scaled.
+ **/
+static void
+gdk_pixbuf_draw_cache_scale (GdkPixbufDrawCache *cache,
+                             GdkPixbufDrawOpts  *opts,
+                             GdkRectangle       *rect,
+                             int                 dst_x,
+                             int                 dst_y)
+{
+    Size zoomed = gdk_pixbuf_draw_opts_get_zoomed_size (opts);
+    int level;
+    gboolean pending;
+    GdkPixbuf *src = gdk_pixbuf_draw_cache_get_source (opts, &level,
+                                                       &pending);
+    gdouble src_zoom = opts->zoom * (1 << level);
+    gboolean quick = pending ||
+        (opts->progressive && opts->interp != GDK_INTERP_NEAREST);
+    if (!cache->store->max_size || pending ||
+        rect->x < 0 || rect->y < 0 ||
+        rect->x + rect->width > zoomed.width ||
+        rect->y + rect->height > zoomed.height)
     {
-        copy_func (dst_ofs, src_ofs, linelen);
-        src_ofs += src_stride;
-        dst_ofs += dst_stride;
+        if (quick)
+            gdk_pixbuf_draw_cache_scale_nearest (cache, opts, src, level,
+                                                 rect, dst_x, dst_y,
+                                                 opts->n_threads);
+        else if (src)
+            gdk_pixbuf_scale_blend_parallel (src,
+                                             cache->last_pixbuf,
+                                             dst_x, dst_y,
+                                             rect->width, rect->height,
+                                             (double) (dst_x - rect->x),
+                                             (double) (dst_y - rect->y),
+                                             src_zoom,
+                                             opts->interp,
+                                             rect->x, rect->y,
+                                             cache->check_size,
+                                             opts->check_color1,
+                                             opts->check_color2,
+                                             opts->n_threads);
+        else
+            gdk_pixbuf_draw_cache_read_scaled (opts->source, level,
+                                               opts->zoom, opts->interp,
+                                               rect,
+                                               cache->last_pixbuf,
+                                               dst_x, dst_y,
+                                               cache->check_size,
+                                               opts->check_color1,
+                                               opts->check_color2);
+        if (opts->stats)
+            opts->stats->n_pixels_scaled += rect->width * rect->height;
+        if (quick)
+            cache->incomplete = TRUE;
+        return;
     }
+    gboolean async =
+        opts->async && cache->ready_func && g_thread_supported ();
+
+    gpointer image = gdk_pixbuf_draw_opts_get_image (opts);
+    gpointer source = src ? (gpointer) src : image;
+    int size = GDK_PIXBUF_DRAW_CACHE_TILE_SIZE;
+    int last_col = (rect->x + rect->width - 1) / size;
+    int last_row = (rect->y + rect->height - 1) / size;
+    for (int row = rect->y / size; row <= last_row; row++)
+        for (int col = rect->x / size; col <= last_col; col++)
+        {
+            TileKey key = {image,
+                           source,
+                           opts->zoom,
+                           opts->interp,
+                           level,
+                           col, row};
+            GdkRectangle tile_rect = {
+                col * size,
+                row * size,
+                MIN (size, zoomed.width - col * size),
+                MIN (size, zoomed.height - row * size)
+            };
+            GdkRectangle inter;
+            gdk_rectangle_intersect (&tile_rect, rect, &inter);
+            int x = dst_x + inter.x - rect->x;
+            int y = dst_y + inter.y - rect->y;
+
+            Tile *tile = tile_store_lookup (cache->store, &key);
+            if (!tile && (async || quick))
+            {
+                if (async)
+                    gdk_pixbuf_draw_cache_request_tile (cache, src, &key,
+                                                        &tile_rect,
+                                                        opts->n_threads);
+                gdk_pixbuf_draw_cache_scale_nearest (cache, opts, src,
+                                                     level, &inter,
+                                                     x, y, 1);
+                if (opts->stats)
+                    opts->stats->n_pixels_scaled +=
+                        inter.width * inter.height;
+                cache->incomplete = TRUE;
+                continue;
+            }
+            if (!tile)
+            {
+                GdkPixbuf *scaled =
+                    gdk_pixbuf_scale_tile (src, &key, &tile_rect,
+                                           cache->check_size,
+                                           opts->n_threads);
+                tile = tile_store_add (cache->store, &key,
+                                       &tile_rect, scaled);
+                if (opts->stats)
+                    opts->stats->n_pixels_scaled +=
+                        tile_rect.width * tile_rect.height;
+            }
+            if (gdk_pixbuf_get_has_alpha (tile->scaled))
+                pixops_composite_checks (tile->scaled,
+                                         inter.x - tile->rect.x,
+                                         inter.y - tile->rect.y,
+                                         inter.width, inter.height,
+                                         cache->last_pixbuf,
+                                         x, y,
+                                         inter.x, inter.y,
+                                         cache->check_size,
+                                         opts->check_color1,
+                                         opts->check_color2);
+            else
+                gdk_pixbuf_copy_area (tile->scaled,
+                                      inter.x - tile->rect.x,
+                                      inter.y - tile->rect.y,
+                                      inter.width, inter.height,
+                                      cache->last_pixbuf,
+                                      x, y);
+        }
+    tile_store_trim (cache->store);
 }
 
 /**
@@ -106,7 +978,9 @@ gdk_pixbuf_draw_cache_get_method (GdkPixbufDrawOpts *old,
         new_->interp != old->interp ||
         new_->check_color1 != old->check_color1 ||
         new_->check_color2 != old->check_color2 ||
-        new_->pixbuf != old->pixbuf)
+        new_->pixbuf != old->pixbuf ||
+        new_->source != old->source ||
+        new_->pyramid != old->pyramid)
         return GDK_PIXBUF_DRAW_METHOD_SCALE;
 
     if (gdk_rectangle_contains_rect (old->zoom_rect, new_->zoom_rect))
@@ -115,6 +989,69 @@ gdk_pixbuf_draw_cache_get_method (GdkPixbufDrawOpts *old,
     return GDK_PIXBUF_DRAW_METHOD_SCROLL;
 }
 
+/**
+ * gdk_pixbuf_draw_cache_new_buffer:
+ *
+ * Allocates a pixbuf for the cache to draw in and accounts it as a
+ * draw buffer.
+ **/
+static GdkPixbuf *
+gdk_pixbuf_draw_cache_new_buffer (GdkColorspace cs,
+                                  gboolean      alpha,
+                                  int           bps,
+                                  int           width,
+                                  int           height)
+{
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (cs, alpha, bps, width, height);
+    gdk_pixbuf_memory_track_pixbuf (pixbuf, GDK_PIXBUF_MEMORY_DRAW_BUFFERS);
+    return pixbuf;
+}
+
+static void
+gdk_pixbuf_draw_cache_drop_anchor (GdkPixbufDrawCache *cache)
+{
+    if (cache->anchor)
+    {
+        g_object_unref (cache->anchor);
+        cache->anchor = NULL;
+    }
+}
+
+/**
+ * gdk_pixbuf_draw_cache_shrink_cb:
+ *
+ * Releases the cache's draw buffers when memory is short, unless the
+ * cache has drawn since the last time it was asked to. The next draw
+ * scales everything again.
+ **/
+static void
+gdk_pixbuf_draw_cache_shrink_cb (gpointer data)
+{
+    GdkPixbufDrawCache *cache = data;
+    if (cache->drawn)
+    {
+        cache->drawn = FALSE;
+        return;
+    }
+    gdk_pixbuf_draw_cache_drop_anchor (cache);
+    if (cache->last_pixmap)
+    {
+        g_object_unref (cache->gc);
+        g_object_unref (cache->last_pixmap);
+        cache->gc = NULL;
+        cache->last_pixmap = NULL;
+    }
+    if (gdk_pixbuf_get_width (cache->last_pixbuf) > 1 ||
+        gdk_pixbuf_get_height (cache->last_pixbuf) > 1)
+    {
+        g_object_unref (cache->last_pixbuf);
+        cache->last_pixbuf =
+            gdk_pixbuf_draw_cache_new_buffer (GDK_COLORSPACE_RGB, FALSE, 8,
+                                              1, 1);
+    }
+    cache->old.zoom = -1234.0;
+}
+
 /**
  * gdk_pixbuf_draw_cache_new:
  * @returns: a new #GdkPixbufDrawCache
@@ -125,14 +1062,29 @@ GdkPixbufDrawCache*
 gdk_pixbuf_draw_cache_new ()
 {
     GdkPixbufDrawCache *cache = g_new0 (GdkPixbufDrawCache, 1);
-    cache->last_pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 1, 1);
+    cache->last_pixbuf =
+        gdk_pixbuf_draw_cache_new_buffer (GDK_COLORSPACE_RGB, FALSE, 8, 1, 1);
+    cache->last_pixmap = NULL;
+    cache->gc = NULL;
+    cache->dither = GDK_RGB_DITHER_MAX;
     cache->check_size = 16;
+    tile_store_attach (tile_store_new (FALSE), cache);
+    cache->jobs = g_hash_table_new (tile_key_hash, tile_key_equal);
+    cache->ready_func = NULL;
+    cache->ready_data = NULL;
+    cache->generation = 0;
+    cache->incomplete = FALSE;
+    cache->drawn = FALSE;
     cache->old = (GdkPixbufDrawOpts){0,
                                      {0, 0, 0, 0},
                                      0, 0,
                                      GDK_INTERP_NEAREST,
                                      cache->last_pixbuf,
-                                     0, 0};
+                                     0, 0,
+                                     1};
+    cache->last_opts = cache->old;
+    gdk_pixbuf_memory_add_shrinker (GDK_PIXBUF_MEMORY_DRAW_BUFFERS,
+                                    gdk_pixbuf_draw_cache_shrink_cb, cache);
     return cache;
 }
 
@@ -145,7 +1097,18 @@ gdk_pixbuf_draw_cache_new ()
 void
 gdk_pixbuf_draw_cache_free (GdkPixbufDrawCache *cache)
 {
+    gdk_pixbuf_memory_remove_shrinker (gdk_pixbuf_draw_cache_shrink_cb, cache);
+    gdk_pixbuf_draw_cache_invalidate (cache);
+    g_hash_table_destroy (cache->jobs);
+    tile_store_detach (cache);
     g_object_unref (cache->last_pixbuf);
+    if (cache->anchor)
+        g_object_unref (cache->anchor);
+    if (cache->last_pixmap)
+    {
+        g_object_unref (cache->gc);
+        g_object_unref (cache->last_pixmap);
+    }
     g_free (cache);
 }
 
@@ -163,6 +1126,12 @@ gdk_pixbuf_draw_cache_free (GdkPixbufDrawCache *cache)
  *
  * However, when the image data is modified, this assumtion breaks,
  * which is why this method must be used to tell draw cache about it.
+ * All cached tiles are discarded and tiles still being scaled by
+ * worker threads are thrown away when they are done.
+ *
+ * Tiles in the shared tile store are left alone because other
+ * caches may be using them. Use
+ * gdk_pixbuf_draw_cache_invalidate_shared() to discard those.
  **/
 void
 gdk_pixbuf_draw_cache_invalidate (GdkPixbufDrawCache *cache)
@@ -170,61 +1139,528 @@ gdk_pixbuf_draw_cache_invalidate (GdkPixbufDrawCache *cache)
     /* Set the cached zoom to a bogus value, to force a
        DRAW_FLAGS_SCALE. */
     cache->old.zoom = -1234.0;
+    cache->last_opts.pixbuf = NULL;
+    cache->last_opts.source = NULL;
+    gdk_pixbuf_draw_cache_drop_anchor (cache);
+    g_hash_table_foreach_remove (cache->jobs, tile_job_detach, NULL);
+    if (!cache->store->shared)
+        tile_store_remove_area (cache->store, NULL, NULL);
+}
+
+static gboolean
+tile_job_detach_in_area (gpointer key,
+                         gpointer value,
+                         gpointer user_data)
+{
+    TileJob *job = value;
+    if (!tile_reads_area (&job->key, &job->rect, user_data))
+        return FALSE;
+    return tile_job_detach (key, value, user_data);
 }
 
+/**
+ * gdk_pixbuf_draw_cache_invalidate_area:
+ * @cache: a #GdkPixbufDrawCache
+ * @rect: the area in image space coordinates that has changed
+ *
+ * Like gdk_pixbuf_draw_cache_invalidate(), but only discards the
+ * tiles that are scaled from pixels in @rect. The next draw scales
+ * the pixbuf again, taking the tiles that are still valid from the
+ * cache. This is much cheaper than invalidating everything when a
+ * small part of the pixbuf changes often, for example while an image
+ * is being loaded. Like gdk_pixbuf_draw_cache_invalidate(), tiles in
+ * the shared tile store are left alone.
+ **/
+void
+gdk_pixbuf_draw_cache_invalidate_area (GdkPixbufDrawCache *cache,
+                                       GdkRectangle       *rect)
+{
+    cache->old.zoom = -1234.0;
+    gdk_pixbuf_draw_cache_drop_anchor (cache);
+    g_hash_table_foreach_remove (cache->jobs, tile_job_detach_in_area, rect);
+    if (!cache->store->shared)
+        tile_store_remove_area (cache->store, NULL, rect);
+}
+
+typedef struct
+{
+    GdkPixbuf    *pixbuf;
+    GdkRectangle *area;
+} DamagedArea;
+
+static void
+tile_job_mark_stale (gpointer key,
+                     gpointer value,
+                     gpointer user_data)
+{
+    TileJob *job = value;
+    DamagedArea *damaged = user_data;
+    if (job->key.image == damaged->pixbuf &&
+        (!damaged->area ||
+         tile_reads_area (&job->key, &job->rect, damaged->area)))
+        job->stale = TRUE;
+}
+
+/**
+ * gdk_pixbuf_draw_cache_invalidate_shared:
+ * @pixbuf: a #GdkPixbuf whose pixels have changed
+ * @rect: the area in image space coordinates that has changed, or
+ *   %NULL if the whole pixbuf has changed
+ *
+ * Since caches drawn with the <structfield>shared</structfield> draw
+ * option share their tiles, changed pixels must be reported with
+ * this function. It discards the tiles of @pixbuf in the shared tile
+ * store that are scaled from pixels in @rect. Tiles of it that worker
+ * threads are scaling for any of the caches sharing the store are
+ * not kept when they are done, but the caches are still told that
+ * they are ready so that they request them again.
+ *
+ * Each cache that has drawn @pixbuf must still be invalidated
+ * itself, with gdk_pixbuf_draw_cache_invalidate_area() or
+ * gdk_pixbuf_draw_cache_invalidate(), to discard its last draw.
+ **/
+void
+gdk_pixbuf_draw_cache_invalidate_shared (GdkPixbuf    *pixbuf,
+                                         GdkRectangle *rect)
+{
+    if (!shared_store || !pixbuf)
+        return;
+    tile_store_remove_area (shared_store, pixbuf, rect);
+    DamagedArea damaged = {pixbuf, rect};
+    for (GSList *link = shared_store->caches; link; link = link->next)
+    {
+        GdkPixbufDrawCache *cache = link->data;
+        g_hash_table_foreach (cache->jobs, tile_job_mark_stale, &damaged);
+    }
+}
+
+/**
+ * gdk_pixbuf_draw_cache_set_shared:
+ *
+ * Moves the cache to the process-wide tile store if @shared is
+ * %TRUE, or to a store of its own otherwise. Tiles are keyed by the
+ * identity of the image, so caches drawing the same #GdkPixbuf or
+ * #GtkIImageSource with the same zoom and interpolation, for example
+ * in several synchronized views, use each other's tiles instead of
+ * scaling the same pixels again. The shared store has a single
+ * memory limit, set with gdk_pixbuf_draw_cache_set_max_size() on any
+ * of the caches sharing it, and is freed when no cache uses it.
+ *
+ * The tiles of the cache's own store are discarded when it starts
+ * sharing.
+ **/
+static void
+gdk_pixbuf_draw_cache_set_shared (GdkPixbufDrawCache *cache,
+                                  gboolean            shared)
+{
+    if (cache->store->shared == shared)
+        return;
+    tile_store_detach (cache);
+    if (!shared)
+        tile_store_attach (tile_store_new (FALSE), cache);
+    else
+    {
+        if (!shared_store)
+            shared_store = tile_store_new (TRUE);
+        tile_store_attach (shared_store, cache);
+    }
+}
+
+/**
+ * gdk_pixbuf_draw_cache_set_max_size:
+ * @cache: a #GdkPixbufDrawCache
+ * @max_size: maximum number of bytes of scaled tiles to keep
+ *
+ * Sets the memory limit for the scaled tiles the cache keeps. When
+ * the limit is exceeded, the least recently used tiles are
+ * evicted. The default is #GDK_PIXBUF_DRAW_CACHE_MAX_SIZE. A limit of
+ * 0 turns tile caching off so that only the last draw is cached.
+ *
+ * If the cache shares its tiles, the limit is that of the shared
+ * tile store and applies to all caches sharing it.
+ **/
+void
+gdk_pixbuf_draw_cache_set_max_size (GdkPixbufDrawCache *cache,
+                                    gsize               max_size)
+{
+    cache->store->max_size = max_size;
+    if (max_size)
+        tile_store_trim (cache->store);
+    else
+        tile_store_remove_area (cache->store, NULL, NULL);
+}
+
+/**
+ * gdk_pixbuf_draw_cache_set_ready_func:
+ * @cache: a #GdkPixbufDrawCache
+ * @func: function to call when a tile is ready, or %NULL
+ * @data: user data to pass to @func
+ *
+ * Lets the cache scale tiles asynchronously. When this function has
+ * been called with a non-%NULL @func and a draw is done with draw
+ * options whose <structfield>async</structfield> field is %TRUE, the
+ * tiles missing from the cache are scaled by worker threads instead
+ * of in the calling thread. Their area is filled with a quick, low
+ * quality, nearest neighbour scale until they are ready. Then @func
+ * is called from the main loop with the zoom-space area of the tile
+ * so that the caller can redraw it, which will take the tile from
+ * the cache.
+ *
+ * Each draw option carries a generation number. When a draw is done
+ * with a different generation than the previous one, for example
+ * because the view was zoomed or scrolled, tiles that have not been
+ * requested again and that workers have not started on yet are
+ * skipped.
+ *
+ * Asynchronous scaling requires that the GLib thread system has been
+ * initialized with g_thread_init(). Otherwise, drawing is always
+ * synchronous.
+ **/
+void
+gdk_pixbuf_draw_cache_set_ready_func (GdkPixbufDrawCache     *cache,
+                                      GdkPixbufDrawCacheFunc  func,
+                                      gpointer                data)
+{
+    cache->ready_func = func;
+    cache->ready_data = data;
+}
+
+/**
+ * gdk_pixbuf_draw_cache_prefetch:
+ * @cache: a #GdkPixbufDrawCache
+ * @rect: area in zoom-space coordinates that is likely to be drawn
+ *   soon
+ * @returns: %TRUE if tiles in @rect might still be missing
+ *
+ * Scales tiles in @rect that are not in the cache yet, with the
+ * pixbuf or image source, zoom and interpolation of the last draw,
+ * so that drawing the area later only needs to copy them. To keep
+ * the main loop responsive, at most one tile is scaled per call and
+ * the function should be called from an idle handler until it
+ * returns %FALSE. When the last draw was asynchronous, all missing
+ * tiles are instead requested from the worker threads at once.
+ *
+ * Nothing is done if the last draw was a preview, if tile caching
+ * is turned off, if the cache is full or if the memory used by all
+ * buffers is over the limit set with gdk_pixbuf_memory_set_limit().
+ **/
+gboolean
+gdk_pixbuf_draw_cache_prefetch (GdkPixbufDrawCache *cache,
+                                GdkRectangle       *rect)
+{
+    GdkPixbufDrawOpts *opts = &cache->last_opts;
+    gpointer image = gdk_pixbuf_draw_opts_get_image (opts);
+    if (!image || opts->preview ||
+        cache->store->size >= cache->store->max_size ||
+        gdk_pixbuf_memory_is_over_limit ())
+        return FALSE;
+
+    Size zoomed = gdk_pixbuf_draw_opts_get_zoomed_size (opts);
+    GdkRectangle area = {0, 0, zoomed.width, zoomed.height};
+    if (!gdk_rectangle_intersect (&area, rect, &area))
+        return FALSE;
+
+    int level;
+    gboolean pending;
+    GdkPixbuf *src = gdk_pixbuf_draw_cache_get_source (opts, &level,
+                                                       &pending);
+    if (pending)
+        return FALSE;
+    gboolean async =
+        opts->async && cache->ready_func && g_thread_supported ();
+
+    int size = GDK_PIXBUF_DRAW_CACHE_TILE_SIZE;
+    int last_col = (area.x + area.width - 1) / size;
+    int last_row = (area.y + area.height - 1) / size;
+
+    /* If the tiles do not fit in the cache, prefetching them would
+       only evict each other. */
+    gsize n_tiles = ((last_col - area.x / size + 1) *
+                     (last_row - area.y / size + 1));
+    int n_channels = src ? gdk_pixbuf_get_n_channels (src)
+        : gtk_iimage_source_get_has_alpha (opts->source) ? 4 : 3;
+    if (n_tiles * size * size * n_channels > cache->store->max_size)
+        return FALSE;
+
+    gpointer source = src ? (gpointer) src : image;
+    for (int row = area.y / size; row <= last_row; row++)
+        for (int col = area.x / size; col <= last_col; col++)
+        {
+            TileKey key = {image,
+                           source,
+                           opts->zoom,
+                           opts->interp,
+                           level,
+                           col, row};
+            if (g_hash_table_lookup (cache->store->tiles, &key))
+                continue;
+            GdkRectangle tile_rect = {
+                col * size,
+                row * size,
+                MIN (size, zoomed.width - col * size),
+                MIN (size, zoomed.height - row * size)
+            };
+            if (async)
+            {
+                gdk_pixbuf_draw_cache_request_tile (cache, src, &key,
+                                                    &tile_rect,
+                                                    opts->n_threads);
+                continue;
+            }
+            GdkPixbuf *scaled = gdk_pixbuf_scale_tile (src, &key, &tile_rect,
+                                                       cache->check_size,
+                                                       opts->n_threads);
+            tile_store_add (cache->store, &key, &tile_rect, scaled);
+            tile_store_trim (cache->store);
+            return TRUE;
+        }
+    return FALSE;
+}
+
+static int
+ring_pos (int coord,
+          int size)
+{
+    return (coord % size + size) % size;
+}
+
+/**
+ * gdk_pixbuf_draw_cache_ring_split:
+ * @returns: the number of parts
+ *
+ * <structfield>last_pixbuf</structfield> is a ring buffer in which
+ * the pixel at a zoom-space coordinate is kept at the coordinate
+ * modulo the size of the buffer. This function splits @rect, which
+ * must not be larger than the buffer, into the at most four parts
+ * that are contiguous in the buffer. The parts are in zoom-space
+ * coordinates and @bufs is set to where they are in the buffer.
+ **/
+static int
+gdk_pixbuf_draw_cache_ring_split (GdkPixbufDrawCache *cache,
+                                  GdkRectangle       *rect,
+                                  GdkRectangle        parts[4],
+                                  GdkRectangle        bufs[4])
+{
+    int width = gdk_pixbuf_get_width (cache->last_pixbuf);
+    int height = gdk_pixbuf_get_height (cache->last_pixbuf);
+    int buf_x = ring_pos (rect->x, width);
+    int buf_y = ring_pos (rect->y, height);
+    int left = MIN (rect->width, width - buf_x);
+    int top = MIN (rect->height, height - buf_y);
+
+    /* Zoom-space start, buffer start and length of the parts in each
+       direction. */
+    int cols[2][3] = {
+        {rect->x, buf_x, left},
+        {rect->x + left, 0, rect->width - left}
+    };
+    int rows[2][3] = {
+        {rect->y, buf_y, top},
+        {rect->y + top, 0, rect->height - top}
+    };
+    int n_parts = 0;
+    for (int j = 0; j < 2; j++)
+        for (int i = 0; i < 2; i++)
+        {
+            if (!cols[i][2] || !rows[j][2])
+                continue;
+            parts[n_parts] = (GdkRectangle){cols[i][0], rows[j][0],
+                                            cols[i][2], rows[j][2]};
+            bufs[n_parts] = (GdkRectangle){cols[i][1], rows[j][1],
+                                           cols[i][2], rows[j][2]};
+            n_parts++;
+        }
+    return n_parts;
+}
+
+/**
+ * gdk_pixbuf_draw_cache_ensure_buffer:
+ * @returns: %TRUE if <structfield>last_pixbuf</structfield> still
+ *   holds the pixels of the last draw, %FALSE if it was recreated
+ *
+ * Makes sure that the ring buffer is at least @width x @height
+ * pixels and that it has the colorspace and bits per sample of
+ * @pixbuf, or is 8 bit RGB if @pixbuf is %NULL because an image
+ * source is drawn. Where a pixel is kept depends on the size of the buffer,
+ * so everything must be scaled again when it grows.
+ **/
+static gboolean
+gdk_pixbuf_draw_cache_ensure_buffer (GdkPixbufDrawCache *cache,
+                                     GdkPixbuf          *pixbuf,
+                                     int                 width,
+                                     int                 height)
+{
+    int last_width = gdk_pixbuf_get_width (cache->last_pixbuf);
+    int last_height = gdk_pixbuf_get_height (cache->last_pixbuf);
+    GdkColorspace cs =
+        pixbuf ? gdk_pixbuf_get_colorspace (pixbuf) : GDK_COLORSPACE_RGB;
+    int bps = pixbuf ? gdk_pixbuf_get_bits_per_sample (pixbuf) : 8;
+    if (width <= last_width && height <= last_height &&
+        cs == gdk_pixbuf_get_colorspace (cache->last_pixbuf) &&
+        bps == gdk_pixbuf_get_bits_per_sample (cache->last_pixbuf))
+        return TRUE;
+    g_object_unref (cache->last_pixbuf);
+    cache->last_pixbuf =
+        gdk_pixbuf_draw_cache_new_buffer (cs, FALSE, bps,
+                                          MAX (width, last_width),
+                                          MAX (height, last_height));
+    return FALSE;
+}
+
+/**
+ * gdk_pixbuf_draw_cache_unroll:
+ *
+ * Returns a copy of the area @rect, in zoom-space coordinates, of the
+ * ring buffer with the pixels in order.
+ **/
 static GdkPixbuf *
-gdk_pixbuf_draw_cache_scroll_intersection (GdkPixbuf    *pixbuf,
-                                           int           new_width,
-                                           int           new_height,
-                                           int           src_x,
-                                           int           src_y,
-                                           int           inter_width,
-                                           int           inter_height,
-                                           int           dst_x,
-                                           int           dst_y)
-{
-    int last_width = gdk_pixbuf_get_width (pixbuf);
-    int last_height = gdk_pixbuf_get_height (pixbuf);
-    
-    int width = MAX (last_width, new_width);
-    int height = MAX (last_height, new_height);
-    if (width > last_width || height > last_height)
-    {
-        GdkColorspace cs = gdk_pixbuf_get_colorspace (pixbuf);
-        int bps = gdk_pixbuf_get_bits_per_sample (pixbuf);
-        gboolean alpha = gdk_pixbuf_get_has_alpha (pixbuf);
-        GdkPixbuf *tmp = gdk_pixbuf_new (cs, alpha, bps, width, height);
-        
-        gdk_pixbuf_copy_area_intact (pixbuf,
-                                     src_x, src_y,
-                                     inter_width, inter_height,
-                                     tmp,
-                                     dst_x, dst_y);
-        g_object_unref (pixbuf);
-        return tmp;
-    }
-    gdk_pixbuf_copy_area_intact (pixbuf,
-                                 src_x, src_y,
-                                 inter_width, inter_height,
-                                 pixbuf,
-                                 dst_x, dst_y);
+gdk_pixbuf_draw_cache_unroll (GdkPixbufDrawCache *cache,
+                              GdkRectangle       *rect)
+{
+    GdkPixbuf *last = cache->last_pixbuf;
+    GdkPixbuf *pixbuf =
+        gdk_pixbuf_draw_cache_new_buffer (gdk_pixbuf_get_colorspace (last),
+                                          FALSE,
+                                          gdk_pixbuf_get_bits_per_sample (last),
+                                          rect->width, rect->height);
+    GdkRectangle parts[4], bufs[4];
+    int n_parts = gdk_pixbuf_draw_cache_ring_split (cache, rect, parts, bufs);
+    for (int n = 0; n < n_parts; n++)
+        gdk_pixbuf_copy_area (last,
+                              bufs[n].x, bufs[n].y,
+                              bufs[n].width, bufs[n].height,
+                              pixbuf,
+                              parts[n].x - rect->x, parts[n].y - rect->y);
     return pixbuf;
 }
 
+/**
+ * gdk_pixbuf_draw_cache_ensure_pixmap:
+ * @returns: %TRUE if the pixmap still holds the pixels of
+ *   <structfield>last_pixbuf</structfield>, %FALSE if it was
+ *   recreated
+ *
+ * Makes sure that the server side pixmap is at least @width x
+ * @height pixels and that it can be copied to @drawable. Pixels are
+ * only dithered when @drawable has less than 24 bits per pixel or is
+ * not TrueColor, as dithering is wasted work otherwise.
+ **/
+static gboolean
+gdk_pixbuf_draw_cache_ensure_pixmap (GdkPixbufDrawCache *cache,
+                                     GdkDrawable        *drawable,
+                                     int                 width,
+                                     int                 height)
+{
+    int pm_width = 0;
+    int pm_height = 0;
+    if (cache->last_pixmap)
+    {
+        gdk_drawable_get_size (cache->last_pixmap, &pm_width, &pm_height);
+        if (width <= pm_width && height <= pm_height &&
+            (gdk_drawable_get_depth (cache->last_pixmap) ==
+             gdk_drawable_get_depth (drawable)) &&
+            (gdk_drawable_get_screen (cache->last_pixmap) ==
+             gdk_drawable_get_screen (drawable)))
+            return TRUE;
+        g_object_unref (cache->gc);
+        g_object_unref (cache->last_pixmap);
+    }
+    width = MAX (width, pm_width);
+    height = MAX (height, pm_height);
+    cache->last_pixmap = gdk_pixmap_new (drawable, width, height, -1);
+    /* Pixmaps deeper than 16 bits are stored with 32 bits per pixel. */
+    int depth = gdk_drawable_get_depth (cache->last_pixmap);
+    int bytes_per_pixel = depth > 16 ? 4 : (depth + 7) / 8;
+    gdk_pixbuf_memory_track (cache->last_pixmap,
+                             GDK_PIXBUF_MEMORY_DRAW_BUFFERS,
+                             width * height * bytes_per_pixel);
+    cache->gc = gdk_gc_new (cache->last_pixmap);
+    gdk_gc_set_exposures (cache->gc, FALSE);
+
+    GdkVisual *visual = gdk_drawable_get_visual (drawable);
+    if (!visual)
+        visual = gdk_visual_get_system ();
+    if (visual->type == GDK_VISUAL_TRUE_COLOR && visual->depth >= 24)
+        cache->dither = GDK_RGB_DITHER_NONE;
+    else
+        cache->dither = GDK_RGB_DITHER_MAX;
+    return FALSE;
+}
+
+/**
+ * gdk_pixbuf_draw_cache_upload:
+ *
+ * Copies the area @rect of <structfield>last_pixbuf</structfield> to
+ * the server side pixmap.
+ **/
+static void
+gdk_pixbuf_draw_cache_upload (GdkPixbufDrawCache *cache,
+                              GdkPixbufDrawOpts  *opts,
+                              GdkRectangle       *rect)
+{
+    gdk_draw_pixbuf (cache->last_pixmap,
+                     cache->gc,
+                     cache->last_pixbuf,
+                     rect->x, rect->y,
+                     rect->x, rect->y,
+                     rect->width, rect->height,
+                     cache->dither,
+                     opts->widget_x + rect->x, opts->widget_y + rect->y);
+    if (opts->stats)
+        opts->stats->n_pixels_uploaded += rect->width * rect->height;
+}
+
+/**
+ * gdk_pixbuf_draw_cache_render:
+ *
+ * Scales the area @rect, in zoom-space coordinates, into its place
+ * in the ring buffer and uploads it to the server side pixmap.
+ **/
+static void
+gdk_pixbuf_draw_cache_render (GdkPixbufDrawCache *cache,
+                              GdkPixbufDrawOpts  *opts,
+                              GdkRectangle       *rect)
+{
+    GdkRectangle parts[4], bufs[4];
+    int n_parts = gdk_pixbuf_draw_cache_ring_split (cache, rect, parts, bufs);
+    for (int n = 0; n < n_parts; n++)
+    {
+        gdk_pixbuf_draw_cache_scale (cache, opts, &parts[n],
+                                     bufs[n].x, bufs[n].y);
+        gdk_pixbuf_draw_cache_upload (cache, opts, &bufs[n]);
+    }
+}
+
+/**
+ * gdk_pixbuf_draw_cache_upload_ring:
+ *
+ * Uploads the area @rect, in zoom-space coordinates, of the ring
+ * buffer to the server side pixmap.
+ **/
+static void
+gdk_pixbuf_draw_cache_upload_ring (GdkPixbufDrawCache *cache,
+                                   GdkPixbufDrawOpts  *opts,
+                                   GdkRectangle       *rect)
+{
+    GdkRectangle parts[4], bufs[4];
+    int n_parts = gdk_pixbuf_draw_cache_ring_split (cache, rect, parts, bufs);
+    for (int n = 0; n < n_parts; n++)
+        gdk_pixbuf_draw_cache_upload (cache, opts, &bufs[n]);
+}
+
 /**
  * gdk_pixbuf_draw_cache_intersect_draw:
  *
- * Updates the cache by first scrolling the still valid area in the
- * cache. Then the newly exposed areas in the cache is sampled from
- * the pixbuf.
+ * Updates the cache after the area has been scrolled. The pixels
+ * still visible stay where they are in the ring buffer and the
+ * server side pixmap, so only the newly exposed areas are scaled
+ * from the pixbuf and uploaded.
  **/
 static void
 gdk_pixbuf_draw_cache_intersect_draw (GdkPixbufDrawCache *cache,
-                                      GdkPixbufDrawOpts  *opts,
-                                      GdkDrawable        *drawable)
+                                      GdkPixbufDrawOpts  *opts)
 {
     GdkRectangle this = opts->zoom_rect;
-    GdkRectangle old_rect = cache->old.zoom_rect;
 
     /* If there is no intersection, we have to scale the whole area
        from the source pixbuf. */
@@ -235,37 +1671,150 @@ gdk_pixbuf_draw_cache_intersect_draw (GdkPixbufDrawCache *cache,
         {0, 0, 0, 0},
         {0, 0, 0, 0}
     };
-    if (gdk_rectangle_intersect (&old_rect, &this, &inter))
+    if (gdk_rectangle_intersect (&cache->old.zoom_rect, &this, &inter))
         gdk_rectangle_get_rects_around (&this, &inter, around);
 
-    cache->last_pixbuf =
-        gdk_pixbuf_draw_cache_scroll_intersection (cache->last_pixbuf,
-                                                   this.width,
-                                                   this.height,
-                                                   inter.x - old_rect.x,
-                                                   inter.y - old_rect.y,
-                                                   inter.width,
-                                                   inter.height,
-                                                   around[1].width,
-                                                   around[0].height);
-    
     for (int n = 0; n < 4; n++)
+        if (around[n].width && around[n].height)
+            gdk_pixbuf_draw_cache_render (cache, opts, &around[n]);
+}
+
+/**
+ * gdk_pixbuf_draw_cache_blit:
+ *
+ * Copies the area of @opts from the server side pixmap to
+ * @drawable, in at most four pieces.
+ **/
+static void
+gdk_pixbuf_draw_cache_blit (GdkPixbufDrawCache *cache,
+                            GdkPixbufDrawOpts  *opts,
+                            GdkDrawable        *drawable)
+{
+    GdkRectangle *this = &opts->zoom_rect;
+    GdkRectangle parts[4], bufs[4];
+    int n_parts = gdk_pixbuf_draw_cache_ring_split (cache, this, parts, bufs);
+    for (int n = 0; n < n_parts; n++)
+        gdk_draw_drawable (drawable,
+                           cache->gc,
+                           cache->last_pixmap,
+                           bufs[n].x, bufs[n].y,
+                           opts->widget_x + parts[n].x - this->x,
+                           opts->widget_y + parts[n].y - this->y,
+                           bufs[n].width, bufs[n].height);
+}
+
+/**
+ * gdk_pixbuf_draw_cache_draw_preview:
+ *
+ * Draws a preview frame. The part of the area that the output of the
+ * last full quality draw, the anchor, covers is rescaled from it and
+ * the rest is scaled from the pixbuf or the pyramid level closest to
+ * the zoom, or from the image source as described for
+ * gdk_pixbuf_draw_cache_scale_nearest(). Both are scaled with
+ * %GDK_INTERP_NEAREST and without tiles, so the cost only depends on
+ * the size of the area.
+ *
+ * The preview replaces the last draw but the options of the last full
+ * quality draw are forgotten, so the next draw that is not a preview
+ * scales everything again.
+ **/
+static void
+gdk_pixbuf_draw_cache_draw_preview (GdkPixbufDrawCache *cache,
+                                    GdkPixbufDrawOpts  *opts,
+                                    GdkDrawable        *drawable)
+{
+    GdkRectangle this = opts->zoom_rect;
+    if (!cache->anchor && cache->old.zoom > 0 &&
+        gdk_pixbuf_draw_opts_get_image (&cache->old) ==
+        gdk_pixbuf_draw_opts_get_image (opts))
     {
-        if (!around[n].width || !around[n].height)
-            continue;
-        gdk_pixbuf_scale_blend (opts->pixbuf,
+        cache->anchor =
+            gdk_pixbuf_draw_cache_unroll (cache, &cache->old.zoom_rect);
+        cache->anchor_opts = cache->old;
+    }
+    if (this.width > gdk_pixbuf_get_width (cache->last_pixbuf) ||
+        this.height > gdk_pixbuf_get_height (cache->last_pixbuf))
+    {
+        g_object_unref (cache->last_pixbuf);
+        cache->last_pixbuf =
+            gdk_pixbuf_draw_cache_new_buffer (GDK_COLORSPACE_RGB, FALSE, 8,
+                                              this.width, this.height);
+    }
+
+    /* The pixels whose nearest neighbour lies inside the anchor. */
+    GdkRectangle inter = {0, 0, 0, 0};
+    gdouble ratio = 1.0;
+    if (cache->anchor)
+    {
+        ratio = opts->zoom / cache->anchor_opts.zoom;
+        GdkRectangle a = cache->anchor_opts.zoom_rect;
+        int x0 = (int) ceil (a.x * ratio);
+        int y0 = (int) ceil (a.y * ratio);
+        int x1 = (int) floor ((a.x + a.width) * ratio);
+        int y1 = (int) floor ((a.y + a.height) * ratio);
+        GdkRectangle covered = {x0, y0, x1 - x0, y1 - y0};
+        if (!gdk_rectangle_intersect (&covered, &this, &inter))
+            inter = (GdkRectangle){0, 0, 0, 0};
+    }
+    GdkRectangle around[4] = {
+        this,
+        {0, 0, 0, 0},
+        {0, 0, 0, 0},
+        {0, 0, 0, 0}
+    };
+    if (inter.width && inter.height)
+    {
+        gdk_rectangle_get_rects_around (&this, &inter, around);
+        GdkRectangle a = cache->anchor_opts.zoom_rect;
+        gdk_pixbuf_scale_blend (cache->anchor,
                                 cache->last_pixbuf,
-                                around[n].x - this.x,
-                                around[n].y - this.y,
-                                around[n].width, around[n].height,
-                                -this.x, -this.y,
-                                opts->zoom,
-                                opts->interp,
-                                around[n].x, around[n].y,
+                                inter.x - this.x, inter.y - this.y,
+                                inter.width, inter.height,
+                                a.x * ratio - this.x,
+                                a.y * ratio - this.y,
+                                ratio,
+                                GDK_INTERP_NEAREST,
+                                0, 0,
                                 cache->check_size,
                                 opts->check_color1,
                                 opts->check_color2);
     }
+
+    int level;
+    gboolean pending;
+    GdkPixbuf *src = gdk_pixbuf_draw_cache_get_source (opts, &level,
+                                                       &pending);
+    for (int n = 0; n < 4; n++)
+    {
+        if (!around[n].width || !around[n].height)
+            continue;
+        gdk_pixbuf_draw_cache_scale_nearest (cache, opts, src, level,
+                                             &around[n],
+                                             around[n].x - this.x,
+                                             around[n].y - this.y,
+                                             1);
+    }
+
+    gdk_pixbuf_draw_cache_ensure_pixmap (cache, drawable,
+                                         this.width, this.height);
+    GdkRectangle all = {0, 0, this.width, this.height};
+    gdk_pixbuf_draw_cache_upload (cache, opts, &all);
+    gdk_draw_drawable (drawable,
+                       cache->gc,
+                       cache->last_pixmap,
+                       0, 0,
+                       opts->widget_x, opts->widget_y,
+                       this.width, this.height);
+    cache->old = *opts;
+    cache->old.zoom = -1234.0;
+
+    if (opts->stats)
+    {
+        opts->stats->n_draws[GDK_PIXBUF_DRAW_METHOD_SCALE]++;
+        opts->stats->n_pixels_scaled += this.width * this.height;
+        opts->stats->n_pixels_drawn += this.width * this.height;
+        opts->stats->cache_size = cache->store->size;
+    }
 }
 
 /**
@@ -282,59 +1831,67 @@ gdk_pixbuf_draw_cache_draw (GdkPixbufDrawCache *cache,
                             GdkPixbufDrawOpts  *opts,
                             GdkDrawable        *drawable)
 {
-    GdkRectangle this = opts->zoom_rect;
-    GdkPixbufDrawMethod method =
-        gdk_pixbuf_draw_cache_get_method (&cache->old, opts);
-    int deltax = 0;
-    int deltay = 0;
-    if (method == GDK_PIXBUF_DRAW_METHOD_CONTAINS)
+    if (opts->async && opts->generation != cache->generation)
     {
-        deltax = this.x - cache->old.zoom_rect.x;
-        deltay = this.y - cache->old.zoom_rect.y;
+        /* The view has changed so queued tiles might not be needed
+           anymore. Those that are, are requested again below. */
+        cache->generation = opts->generation;
+        g_hash_table_foreach (cache->jobs, tile_job_cancel, NULL);
     }
-    else if (method == GDK_PIXBUF_DRAW_METHOD_SCROLL)
+    gdk_pixbuf_draw_cache_set_shared (cache, opts->shared);
+    cache->drawn = TRUE;
+    cache->last_opts = *opts;
+    cache->incomplete = FALSE;
+    if (opts->preview)
     {
-        gdk_pixbuf_draw_cache_intersect_draw (cache, opts, drawable);
+        gdk_pixbuf_draw_cache_draw_preview (cache, opts, drawable);
+        return;
     }
-    else if (method == GDK_PIXBUF_DRAW_METHOD_SCALE)
+    gdk_pixbuf_draw_cache_drop_anchor (cache);
+    cache->store->n_draws++;
+
+    GdkRectangle this = opts->zoom_rect;
+    GdkPixbufDrawMethod method =
+        gdk_pixbuf_draw_cache_get_method (&cache->old, opts);
+    if (!gdk_pixbuf_draw_cache_ensure_buffer (cache,
+                                              opts->source ? NULL
+                                              : opts->pixbuf,
+                                              this.width, this.height))
+        method = GDK_PIXBUF_DRAW_METHOD_SCALE;
+
+    /* The pixmap mirrors the ring buffer, so a new one must be filled
+       from it. */
+    gboolean pixmap_valid =
+        gdk_pixbuf_draw_cache_ensure_pixmap
+        (cache, drawable,
+         gdk_pixbuf_get_width (cache->last_pixbuf),
+         gdk_pixbuf_get_height (cache->last_pixbuf));
+    if (method == GDK_PIXBUF_DRAW_METHOD_SCALE)
+        gdk_pixbuf_draw_cache_render (cache, opts, &this);
+    else
     {
-        int last_width = gdk_pixbuf_get_width (cache->last_pixbuf);
-        int last_height = gdk_pixbuf_get_height (cache->last_pixbuf);
-        GdkColorspace new_cs = gdk_pixbuf_get_colorspace (opts->pixbuf);
-        GdkColorspace last_cs =
-            gdk_pixbuf_get_colorspace (cache->last_pixbuf);
-        int new_bps = gdk_pixbuf_get_bits_per_sample (opts->pixbuf);
-        int last_bps = gdk_pixbuf_get_bits_per_sample (cache->last_pixbuf);
-        
-        if (this.width > last_width || this.height > last_height ||
-            new_cs != last_cs || new_bps != last_bps)
-        {
-            g_object_unref (cache->last_pixbuf);
-            cache->last_pixbuf = gdk_pixbuf_new (new_cs, FALSE, new_bps,
-                                                  this.width, this.height);
-        }
-        
-        gdk_pixbuf_scale_blend (opts->pixbuf,
-                                cache->last_pixbuf,
-                                0, 0,
-                                this.width, this.height,
-                                (double) -this.x, (double) -this.y,
-                                opts->zoom,
-                                opts->interp,
-                                this.x, this.y,
-                                cache->check_size,
-                                opts->check_color1,
-                                opts->check_color2);
+        if (!pixmap_valid)
+            gdk_pixbuf_draw_cache_upload_ring (cache, opts,
+                                               &cache->old.zoom_rect);
+        if (method == GDK_PIXBUF_DRAW_METHOD_SCROLL)
+            gdk_pixbuf_draw_cache_intersect_draw (cache, opts);
     }
-    gdk_draw_pixbuf (drawable,
-                     NULL,
-                     cache->last_pixbuf,
-                     deltax, deltay,
-                     opts->widget_x, opts->widget_y,
-                     this.width, this.height,
-                     GDK_RGB_DITHER_MAX,
-                     opts->widget_x, opts->widget_y);
+    gdk_pixbuf_draw_cache_blit (cache, opts, drawable);
     if (method != GDK_PIXBUF_DRAW_METHOD_CONTAINS)
         cache->old = *opts;
+
+    if (opts->stats)
+    {
+        opts->stats->n_draws[method]++;
+        opts->stats->n_pixels_drawn += this.width * this.height;
+        opts->stats->cache_size = cache->store->size;
+        if (cache->incomplete)
+            opts->stats->n_incomplete++;
+    }
+
+    /* Don't let the next draw reuse the low quality pixels drawn in
+       place of missing tiles. */
+    if (cache->incomplete)
+        cache->old.zoom = -1234.0;
 }
 
@@ -4,10 +4,30 @@
 
 #include <gdk/gdk.h>
 
+#include "gdkpixbufpyramid.h"
+#include "gtkiimagesource.h"
 #include "utils.h"
 
 typedef struct _GdkPixbufDrawOpts GdkPixbufDrawOpts;
 typedef struct _GdkPixbufDrawCache GdkPixbufDrawCache;
+typedef struct _GdkPixbufDrawStats GdkPixbufDrawStats;
+typedef struct _GdkPixbufTileStore GdkPixbufTileStore;
+
+/**
+ * GDK_PIXBUF_DRAW_CACHE_TILE_SIZE:
+ *
+ * Width and height in zoom-space pixels of the scaled tiles that
+ * #GdkPixbufDrawCache keeps.
+ **/
+#define GDK_PIXBUF_DRAW_CACHE_TILE_SIZE     256
+
+/**
+ * GDK_PIXBUF_DRAW_CACHE_MAX_SIZE:
+ *
+ * Default number of bytes of scaled tiles a #GdkPixbufDrawCache may
+ * hold before it starts to evict the least recently used ones.
+ **/
+#define GDK_PIXBUF_DRAW_CACHE_MAX_SIZE      (32 * 1024 * 1024)
 
 /**
  * GdkPixbufDrawMethod:
@@ -36,6 +56,50 @@ typedef enum
     GDK_PIXBUF_DRAW_METHOD_SCROLL = 2
 } GdkPixbufDrawMethod;
 
+/**
+ * GdkPixbufDrawStats:
+ * @n_draws: number of draws made with each #GdkPixbufDrawMethod,
+ *   indexed by the method
+ * @n_pixels_scaled: number of pixels that have been scaled
+ * @n_pixels_drawn: number of pixels that have been drawn to the
+ *   drawable, whether they were scaled or taken from the cache
+ * @n_pixels_uploaded: number of pixels that have been sent from the
+ *   client to the server side copy of the cache
+ * @cache_size: number of bytes the scaled tiles used after the last
+ *   draw
+ * @n_incomplete: number of draws that filled in missing tiles with a
+ *   quick nearest neighbour scale, because they were asynchronous or
+ *   progressive
+ * @n_exposes: number of exposes, only counted by #GtkImageView. An
+ *   expose whose region is repainted as several rectangles is counted
+ *   once for each rectangle
+ * @expose_time: total time spent in exposes in seconds, only counted
+ *   by #GtkImageView
+ * @max_expose_time: time in seconds of the slowest expose, only
+ *   counted by #GtkImageView
+ * @n_pixels_saved: number of pixels inside the bounding boxes of
+ *   exposed regions that were not repainted because only the
+ *   rectangles of the regions were, only counted by #GtkImageView
+ *
+ * Counters of the work done to draw pixbufs. They are updated by
+ * gdk_pixbuf_draw_cache_draw() when the draw options points to a
+ * stats struct. Zero the struct to reset it.
+ **/
+struct _GdkPixbufDrawStats
+{
+    guint          n_draws[3];
+    guint64        n_pixels_scaled;
+    guint64        n_pixels_drawn;
+    guint64        n_pixels_uploaded;
+    gsize          cache_size;
+    guint          n_incomplete;
+
+    guint          n_exposes;
+    gdouble        expose_time;
+    gdouble        max_expose_time;
+    guint64        n_pixels_saved;
+};
+
 /**
  * GdkPixbufDrawOpts:
  *
@@ -60,6 +124,84 @@ struct _GdkPixbufDrawOpts
     /* The two colors to use to draw the checker board. */
     int            check_color1;
     int            check_color2;
+
+    /* Number of threads to scale with. 0 or 1 means that scaling is
+       done in the calling thread only. */
+    int            n_threads;
+
+    /* Whether missing tiles may be scaled by worker threads and the
+       generation of the view state the draw belongs to. */
+    gboolean       async;
+    guint          generation;
+
+    /* Image pyramid of pixbuf to scale zoomed out images from, or
+       NULL to always scale from pixbuf. */
+    GdkPixbufPyramid *pyramid;
+
+    /* Counters to update when drawing, or NULL. */
+    GdkPixbufDrawStats *stats;
+
+    /* Whether this is a transient frame, such as one in the middle of
+       a zoom animation, that should be drawn as fast as possible. */
+    gboolean       preview;
+
+    /* Whether the cache should keep its tiles in the tile store
+       shared by all caches drawing with this option set. */
+    gboolean       shared;
+
+    /* Whether tiles that are not cached may be filled in with a quick
+       nearest neighbour scale, for the caller to draw the area again
+       later when it has time. */
+    gboolean       progressive;
+
+    /* Image source to draw instead of pixbuf, or NULL. When set,
+       pixbuf and pyramid are not used. */
+    GtkIImageSource *source;
+};
+
+/**
+ * GdkPixbufDrawCacheFunc:
+ * @cache: the #GdkPixbufDrawCache
+ * @zoom_rect: the area in zoom-space coordinates that is ready
+ * @data: user data
+ *
+ * Function called from the main loop when a tile scaled by a worker
+ * thread is ready to be drawn.
+ **/
+typedef void (*GdkPixbufDrawCacheFunc) (GdkPixbufDrawCache *cache,
+                                        GdkRectangle       *zoom_rect,
+                                        gpointer            data);
+
+/**
+ * GdkPixbufTileStore:
+ *
+ * Scaled tiles and their memory limit. Each #GdkPixbufDrawCache has
+ * a store of its own unless it is drawn with the
+ * <structfield>shared</structfield> draw option, in which case it
+ * uses the process-wide store shared with other caches.
+ **/
+struct _GdkPixbufTileStore
+{
+    int                ref_count;
+    gboolean           shared;
+
+    /* Scaled tiles, the most recently used one first in the queue. */
+    GHashTable        *tiles;
+    GQueue            *lru;
+    gsize              size;
+    gsize              max_size;
+    /* Number of draws of the caches using the store, and that number
+       when the store was last asked to shrink. */
+    guint              n_draws;
+    guint              shrunk_draw;
+
+    /* Number of tiles scaled from each source pixbuf. The sources are
+       weakly referenced so that their tiles are thrown away when they
+       are finalized. */
+    GHashTable        *sources;
+
+    /* Draw caches using the store. */
+    GSList            *caches;
 };
 
 /**
@@ -75,6 +217,26 @@ struct _GdkPixbufDrawOpts
  * and adds a cache with the last draw from which pixels can be
  * fetched.
  *
+ * Besides the last draw, the cache also keeps scaled tiles of
+ * #GDK_PIXBUF_DRAW_CACHE_TILE_SIZE pixels that are reused when the
+ * same area is drawn again with the same zoom and interpolation,
+ * whatever the check colors. That makes it cheap to pan back to a
+ * region seen before or to flip between two zoom levels. The least
+ * recently used tiles are evicted when their total size exceeds the
+ * limit set with gdk_pixbuf_draw_cache_set_max_size(). Caches that
+ * draw the same pixbuf, for example in several views, can share
+ * their tiles.
+ *
+ * Draws whose options have <structfield>preview</structfield> set
+ * are scaled with nearest neighbour, either from the output of the
+ * last full quality draw or from the pixbuf or its pyramid, and
+ * bypass the tiles. Their cost only depends on the size of the area
+ * drawn, which makes them suitable for animations.
+ *
+ * The last draw is also kept in a server side #GdkPixmap. Redrawing
+ * an area that is cached is then only a copy on the X server, and
+ * when scrolling only the newly exposed strips are sent to it.
+ *
  * This object is present purely to ensure optimal speed. A
  * #GtkIImageTool that is asked to redraw a part of the image view
  * widget could either do it by itself using gdk_pixbuf_scale() and
@@ -83,13 +245,48 @@ struct _GdkPixbufDrawOpts
 struct _GdkPixbufDrawCache
 {
     GdkPixbuf         *last_pixbuf;
+
+    /* Server side copy of last_pixbuf which is what is drawn. */
+    GdkPixmap         *last_pixmap;
+    GdkGC             *gc;
+    GdkRgbDither       dither;
     GdkPixbufDrawOpts  old;
     int                check_size;
+
+    GdkPixbufTileStore *store;
+
+    /* Tiles being scaled by worker threads. */
+    GHashTable        *jobs;
+    GdkPixbufDrawCacheFunc ready_func;
+    gpointer           ready_data;
+    guint              generation;
+    GdkPixbufDrawOpts  last_opts;
+    gboolean           incomplete;
+
+    /* Output of the last full quality draw, kept while preview
+       frames are rescaled from it. */
+    GdkPixbuf         *anchor;
+    GdkPixbufDrawOpts  anchor_opts;
+
+    /* Whether the cache has drawn since it was last asked to release
+       its buffers because memory is short. */
+    gboolean           drawn;
 };
 
 GdkPixbufDrawCache *gdk_pixbuf_draw_cache_new (void);
 void          gdk_pixbuf_draw_cache_free (GdkPixbufDrawCache *cache);
 void          gdk_pixbuf_draw_cache_invalidate (GdkPixbufDrawCache *cache);
+void          gdk_pixbuf_draw_cache_invalidate_area (GdkPixbufDrawCache *cache,
+                                                     GdkRectangle       *rect);
+void          gdk_pixbuf_draw_cache_invalidate_shared (GdkPixbuf    *pixbuf,
+                                                       GdkRectangle *rect);
+void          gdk_pixbuf_draw_cache_set_max_size (GdkPixbufDrawCache *cache,
+                                                  gsize               max_size);
+void          gdk_pixbuf_draw_cache_set_ready_func (GdkPixbufDrawCache     *cache,
+                                                    GdkPixbufDrawCacheFunc  func,
+                                                    gpointer                data);
+gboolean      gdk_pixbuf_draw_cache_prefetch (GdkPixbufDrawCache *cache,
+                                              GdkRectangle       *rect);
 void          gdk_pixbuf_draw_cache_draw (GdkPixbufDrawCache *cache,
                                           GdkPixbufDrawOpts  *opts,
                                           GdkDrawable        *drawable);
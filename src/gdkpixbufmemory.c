@@ -0,0 +1,293 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; coding: utf-8 -*-
+ *
+ * Copyright © 2007-2008 Björn Lindqvist <bjourne@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/**
+ * SECTION:gdkpixbufmemory
+ * @short_description: Accounting of the memory used for rendering
+ *
+ * <para>
+ *   Besides the pixbuf it shows, each #GtkImageView holds several
+ *   buffers of its own: the last draw of each #GdkPixbufDrawCache
+ *   and its server side pixmap, scaled tiles, image pyramid levels,
+ *   the shaded copy of the pixbuf #GtkImageToolSelector draws and
+ *   the thumbnail of #GtkImageNav. With many views open, these add
+ *   up. Every such buffer is accounted here when it is allocated and
+ *   until it is finalized, so that the total and the peak can be
+ *   read with gdk_pixbuf_memory_get_stats().
+ * </para>
+ * <para>
+ *   A limit for the total can be set with
+ *   gdk_pixbuf_memory_set_limit(). Tile stores evict tiles at once
+ *   while the total is over it, except those used by their latest
+ *   draw. Those and other buffers are released from the main loop
+ *   by the shrink functions their owners have registered, kind by
+ *   kind in the order of #GdkPixbufMemoryKind. Each owner only
+ *   releases buffers that have not been used since it was last
+ *   asked to, so the buffers of the views being drawn survive while
+ *   those of idle views are let go. They are recreated when next
+ *   needed. As long as the total stays over the limit, the shrink
+ *   functions are run again every second.
+ * </para>
+ * <para>
+ *   The accounting is not thread safe and must only be done from the
+ *   thread running the main loop.
+ * </para>
+ **/
+#include "gdkpixbufmemory.h"
+
+/* Milliseconds to wait before trying to shrink again if the total is
+   still over the limit. */
+#define GDK_PIXBUF_MEMORY_RETRY_INTERVAL    1000
+
+typedef struct
+{
+    GdkPixbufMemoryKind       kind;
+    gsize                     size;
+} Tracked;
+
+typedef struct
+{
+    GdkPixbufMemoryKind       kind;
+    GdkPixbufMemoryShrinkFunc func;
+    gpointer                  data;
+} Shrinker;
+
+static GdkPixbufMemoryStats memory_stats = {{0}, 0, 0, 0};
+static gsize memory_limit = 0;
+static GSList *shrinkers = NULL;
+static guint trim_id = 0;
+
+static gboolean
+gdk_pixbuf_memory_trim_cb (gpointer data)
+{
+    trim_id = 0;
+    gdk_pixbuf_memory_trim ();
+    if (gdk_pixbuf_memory_is_over_limit ())
+        trim_id = g_timeout_add (GDK_PIXBUF_MEMORY_RETRY_INTERVAL,
+                                 gdk_pixbuf_memory_trim_cb, NULL);
+    return FALSE;
+}
+
+static void
+gdk_pixbuf_memory_queue_trim (void)
+{
+    if (trim_id || !gdk_pixbuf_memory_is_over_limit ())
+        return;
+    trim_id = g_idle_add (gdk_pixbuf_memory_trim_cb, NULL);
+}
+
+static void
+gdk_pixbuf_memory_untrack_cb (gpointer  data,
+                              GObject  *where_the_object_was)
+{
+    Tracked *tracked = data;
+    memory_stats.usage[tracked->kind] -= tracked->size;
+    memory_stats.total -= tracked->size;
+    g_free (tracked);
+}
+
+/**
+ * gdk_pixbuf_memory_get_stats:
+ * @stats: a #GdkPixbufMemoryStats to fill in
+ *
+ * Gets the memory currently used by each kind of buffer, the total
+ * and the peak total.
+ **/
+void
+gdk_pixbuf_memory_get_stats (GdkPixbufMemoryStats *stats)
+{
+    *stats = memory_stats;
+}
+
+/**
+ * gdk_pixbuf_memory_reset_peak:
+ *
+ * Sets the peak to the current total.
+ **/
+void
+gdk_pixbuf_memory_reset_peak (void)
+{
+    memory_stats.peak = memory_stats.total;
+}
+
+/**
+ * gdk_pixbuf_memory_set_limit:
+ * @limit: the maximum number of bytes of all buffers, or 0 for no
+ *   limit
+ *
+ * Sets the limit for the memory used by all buffers. The default is
+ * 0 which means that nothing is released because of the total. If
+ * the total is over the new limit, buffers are released from the
+ * main loop.
+ **/
+void
+gdk_pixbuf_memory_set_limit (gsize limit)
+{
+    memory_limit = limit;
+    gdk_pixbuf_memory_queue_trim ();
+}
+
+/**
+ * gdk_pixbuf_memory_get_limit:
+ * @returns: the limit for the memory used by all buffers
+ *
+ * Returns the limit for the memory used by all buffers, or 0 if
+ * there is none.
+ **/
+gsize
+gdk_pixbuf_memory_get_limit (void)
+{
+    return memory_limit;
+}
+
+/**
+ * gdk_pixbuf_memory_is_over_limit:
+ * @returns: %TRUE if the buffers use more memory than the limit
+ *
+ * Returns %TRUE if there is a limit and the total is over it.
+ **/
+gboolean
+gdk_pixbuf_memory_is_over_limit (void)
+{
+    return memory_limit && memory_stats.total > memory_limit;
+}
+
+/**
+ * gdk_pixbuf_memory_trim:
+ *
+ * Runs the shrink functions, kind by kind, until the total is no
+ * longer over the limit. This is done from the main loop whenever a
+ * buffer is accounted while over the limit, but can be called
+ * directly to release memory at once.
+ *
+ * The shrink functions are called from a copy of the list, so that
+ * they can free objects that remove their own or other shrink
+ * functions. Shrink functions that are removed that way are not
+ * called.
+ **/
+void
+gdk_pixbuf_memory_trim (void)
+{
+    GSList *copy = g_slist_copy (shrinkers);
+    for (int kind = 0; kind < GDK_PIXBUF_MEMORY_N_KINDS; kind++)
+        for (GSList *link = copy; link; link = link->next)
+        {
+            if (!gdk_pixbuf_memory_is_over_limit ())
+                break;
+            Shrinker *shrinker = link->data;
+            if (shrinker->kind != kind ||
+                !g_slist_find (shrinkers, shrinker))
+                continue;
+            memory_stats.n_shrinks++;
+            shrinker->func (shrinker->data);
+        }
+    g_slist_free (copy);
+}
+
+/**
+ * gdk_pixbuf_memory_track:
+ * @object: the #GObject holding the memory
+ * @kind: the kind of buffer @object is
+ * @size: the number of bytes to account
+ *
+ * Adds @size bytes to the memory used by @kind buffers until @object
+ * is finalized.
+ **/
+void
+gdk_pixbuf_memory_track (gpointer             object,
+                         GdkPixbufMemoryKind  kind,
+                         gsize                size)
+{
+    Tracked *tracked = g_new (Tracked, 1);
+    tracked->kind = kind;
+    tracked->size = size;
+    g_object_weak_ref (G_OBJECT (object),
+                       gdk_pixbuf_memory_untrack_cb, tracked);
+
+    memory_stats.usage[kind] += size;
+    memory_stats.total += size;
+    memory_stats.peak = MAX (memory_stats.peak, memory_stats.total);
+    gdk_pixbuf_memory_queue_trim ();
+}
+
+/**
+ * gdk_pixbuf_memory_track_pixbuf:
+ * @pixbuf: a newly allocated #GdkPixbuf
+ * @kind: the kind of buffer @pixbuf is
+ *
+ * Accounts the pixel data of @pixbuf until it is finalized.
+ **/
+void
+gdk_pixbuf_memory_track_pixbuf (GdkPixbuf           *pixbuf,
+                                GdkPixbufMemoryKind  kind)
+{
+    gdk_pixbuf_memory_track (pixbuf, kind,
+                             gdk_pixbuf_get_rowstride (pixbuf) *
+                             gdk_pixbuf_get_height (pixbuf));
+}
+
+/**
+ * gdk_pixbuf_memory_add_shrinker:
+ * @kind: the kind of buffers @func releases
+ * @func: function to call when over the limit
+ * @data: user data to pass to @func
+ *
+ * Registers a function that releases @kind buffers when the total is
+ * over the limit. It must be removed with
+ * gdk_pixbuf_memory_remove_shrinker() before @data is freed.
+ *
+ * @func should only release buffers and not remove other shrink
+ * functions. If it frees an object that removes one anyway, the
+ * removed function is skipped for the rest of the trim.
+ **/
+void
+gdk_pixbuf_memory_add_shrinker (GdkPixbufMemoryKind        kind,
+                                GdkPixbufMemoryShrinkFunc  func,
+                                gpointer                   data)
+{
+    Shrinker *shrinker = g_new (Shrinker, 1);
+    shrinker->kind = kind;
+    shrinker->func = func;
+    shrinker->data = data;
+    shrinkers = g_slist_append (shrinkers, shrinker);
+}
+
+/**
+ * gdk_pixbuf_memory_remove_shrinker:
+ * @func: a function added with gdk_pixbuf_memory_add_shrinker()
+ * @data: the user data it was added with
+ *
+ * Removes a shrink function.
+ **/
+void
+gdk_pixbuf_memory_remove_shrinker (GdkPixbufMemoryShrinkFunc func,
+                                   gpointer                  data)
+{
+    for (GSList *link = shrinkers; link; link = link->next)
+    {
+        Shrinker *shrinker = link->data;
+        if (shrinker->func == func && shrinker->data == data)
+        {
+            shrinkers = g_slist_delete_link (shrinkers, link);
+            g_free (shrinker);
+            return;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; coding: utf-8 -*- */
+#ifndef __GDK_PIXBUF_MEMORY_H__
+#define __GDK_PIXBUF_MEMORY_H__
+
+#include <gdk/gdk.h>
+
+typedef struct _GdkPixbufMemoryStats GdkPixbufMemoryStats;
+
+/**
+ * GdkPixbufMemoryKind:
+ * @GDK_PIXBUF_MEMORY_TILES: Scaled tiles of #GdkPixbufDrawCache.
+ * @GDK_PIXBUF_MEMORY_PREVIEWS: Thumbnails shown by #GtkImageNav.
+ * @GDK_PIXBUF_MEMORY_PYRAMIDS: Levels of #GdkPixbufPyramid above
+ *   the full size pixbuf.
+ * @GDK_PIXBUF_MEMORY_SELECTIONS: Shaded copies of the pixbuf drawn
+ *   by #GtkImageToolSelector.
+ * @GDK_PIXBUF_MEMORY_DRAW_BUFFERS: The last draw of each
+ *   #GdkPixbufDrawCache and its server side pixmap.
+ * @GDK_PIXBUF_MEMORY_N_KINDS: The number of kinds.
+ *
+ * The kinds of buffers whose memory is accounted. When over the
+ * limit, buffers are released in this order.
+ **/
+typedef enum
+{
+    GDK_PIXBUF_MEMORY_TILES,
+    GDK_PIXBUF_MEMORY_PREVIEWS,
+    GDK_PIXBUF_MEMORY_PYRAMIDS,
+    GDK_PIXBUF_MEMORY_SELECTIONS,
+    GDK_PIXBUF_MEMORY_DRAW_BUFFERS,
+    GDK_PIXBUF_MEMORY_N_KINDS
+} GdkPixbufMemoryKind;
+
+/**
+ * GdkPixbufMemoryStats:
+ *
+ * Memory used by the buffers the library allocates for rendering,
+ * in bytes.
+ **/
+struct _GdkPixbufMemoryStats
+{
+    gsize          usage[GDK_PIXBUF_MEMORY_N_KINDS];
+    gsize          total;
+    /* The highest total since the peak was last reset. */
+    gsize          peak;
+    /* Number of times buffers have been asked to shrink because the
+       total was over the limit. */
+    guint          n_shrinks;
+};
+
+/**
+ * GdkPixbufMemoryShrinkFunc:
+ * @data: user data passed to gdk_pixbuf_memory_add_shrinker()
+ *
+ * Called when the memory used is over the limit. The function should
+ * release the buffers it can recreate later and which have not been
+ * used since it was last called.
+ **/
+typedef void (*GdkPixbufMemoryShrinkFunc) (gpointer data);
+
+void          gdk_pixbuf_memory_get_stats    (GdkPixbufMemoryStats *stats);
+void          gdk_pixbuf_memory_reset_peak   (void);
+void          gdk_pixbuf_memory_set_limit    (gsize                limit);
+gsize         gdk_pixbuf_memory_get_limit    (void);
+gboolean      gdk_pixbuf_memory_is_over_limit (void);
+void          gdk_pixbuf_memory_trim         (void);
+void          gdk_pixbuf_memory_track        (gpointer             object,
+                                              GdkPixbufMemoryKind  kind,
+                                              gsize                size);
+void          gdk_pixbuf_memory_track_pixbuf (GdkPixbuf           *pixbuf,
+                                              GdkPixbufMemoryKind  kind);
+void          gdk_pixbuf_memory_add_shrinker (GdkPixbufMemoryKind        kind,
+                                              GdkPixbufMemoryShrinkFunc  func,
+                                              gpointer                   data);
+void          gdk_pixbuf_memory_remove_shrinker (GdkPixbufMemoryShrinkFunc func,
+                                                 gpointer                  data);
+
+#endif
@@ -0,0 +1,443 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; coding: utf-8 -*-
+ *
+ * Copyright © 2007-2008 Björn Lindqvist <bjourne@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/**
+ * SECTION:gdkpixbufpyramid
+ * @short_description: Successively downsampled copies of a pixbuf
+ *
+ * <para>
+ *   #GdkPixbufPyramid holds an image pyramid of a pixbuf, which is
+ *   used by #GdkPixbufDrawCache to draw zoomed out images. Scaling a
+ *   huge pixbuf down to a small zoom factor is slow because every
+ *   source pixel must be sampled and it aliases badly with bilinear
+ *   interpolation. Scaling from a level of the pyramid that is only
+ *   a little larger than the wanted size is both faster and looks
+ *   better.
+ * </para>
+ * <para>
+ *   Each level is made by averaging 2x2 pixel blocks of the level
+ *   before it. Pixels with alpha are weighted by their alpha so that
+ *   transparent pixels do not bleed their color.
+ * </para>
+ * <para>
+ *   Levels above the full size pixbuf are accounted as
+ *   %GDK_PIXBUF_MEMORY_PYRAMIDS buffers. When memory is short, the
+ *   levels of pyramids that have not been used for a while are freed
+ *   and built again when next requested.
+ * </para>
+ * <para>
+ *   Building the levels of a huge pixbuf reads all of its pixels, so
+ *   it can take long. If a ready function has been set with
+ *   gdk_pixbuf_pyramid_set_ready_func(),
+ *   gdk_pixbuf_pyramid_request_level() builds missing levels on a
+ *   worker thread instead and returns a level that is already built
+ *   in the meantime.
+ * </para>
+ **/
+#include "gdkpixbufmemory.h"
+#include "gdkpixbufpyramid.h"
+
+struct _GdkPixbufPyramidJob
+{
+    /* The pyramid the levels are built for, or %NULL if it has been
+       freed or damaged since the job was queued. */
+    GdkPixbufPyramid *pyramid;
+    /* The level the job starts from, which is already built, and the
+       last level to build. */
+    int               first;
+    int               last;
+    GdkPixbuf        *levels[GDK_PIXBUF_PYRAMID_MAX_LEVELS];
+};
+
+static GThreadPool *pyramid_pool = NULL;
+
+static gboolean pyramid_job_done_cb (gpointer data);
+
+/**
+ * gdk_pixbuf_box_downsample:
+ *
+ * Computes the pixels in @rect of @dst by averaging the 2x2 blocks
+ * of @src they cover. Blocks on the right or bottom edge of an odd
+ * sized @src only contain one column or row.
+ **/
+static void
+gdk_pixbuf_box_downsample (GdkPixbuf    *src,
+                           GdkPixbuf    *dst,
+                           GdkRectangle *rect)
+{
+    int src_w = gdk_pixbuf_get_width (src);
+    int src_h = gdk_pixbuf_get_height (src);
+    int src_stride = gdk_pixbuf_get_rowstride (src);
+    int dst_stride = gdk_pixbuf_get_rowstride (dst);
+    int chans = gdk_pixbuf_get_n_channels (src);
+    gboolean alpha = gdk_pixbuf_get_has_alpha (src);
+    guchar *src_base = gdk_pixbuf_get_pixels (src);
+    guchar *dst_base = gdk_pixbuf_get_pixels (dst);
+
+    for (int y = rect->y; y < rect->y + rect->height; y++)
+    {
+        guchar *row0 = src_base + 2 * y * src_stride;
+        guchar *row1 = src_base + MIN (2 * y + 1, src_h - 1) * src_stride;
+        guchar *d = dst_base + y * dst_stride + rect->x * chans;
+        for (int x = rect->x; x < rect->x + rect->width; x++)
+        {
+            int x0 = 2 * x * chans;
+            int x1 = MIN (2 * x + 1, src_w - 1) * chans;
+            guchar *p[4] = {row0 + x0, row0 + x1, row1 + x0, row1 + x1};
+            if (!alpha)
+            {
+                for (int c = 0; c < 3; c++)
+                    d[c] = (p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) >> 2;
+            }
+            else
+            {
+                int a = p[0][3] + p[1][3] + p[2][3] + p[3][3];
+                for (int c = 0; c < 3; c++)
+                {
+                    if (!a)
+                    {
+                        d[c] = 0;
+                        continue;
+                    }
+                    int sum = (p[0][c] * p[0][3] + p[1][c] * p[1][3] +
+                               p[2][c] * p[2][3] + p[3][c] * p[3][3]);
+                    d[c] = (sum + a / 2) / a;
+                }
+                d[3] = (a + 2) >> 2;
+            }
+            d += chans;
+        }
+    }
+}
+
+/**
+ * gdk_pixbuf_pyramid_downsample:
+ *
+ * Returns a new pixbuf half as wide and high as @src, rounded up,
+ * with the averages of its 2x2 pixel blocks.
+ **/
+static GdkPixbuf *
+gdk_pixbuf_pyramid_downsample (GdkPixbuf *src)
+{
+    GdkRectangle rect = {
+        0, 0,
+        (gdk_pixbuf_get_width (src) + 1) / 2,
+        (gdk_pixbuf_get_height (src) + 1) / 2
+    };
+    GdkPixbuf *dst = gdk_pixbuf_new (GDK_COLORSPACE_RGB,
+                                     gdk_pixbuf_get_has_alpha (src),
+                                     8,
+                                     rect.width, rect.height);
+    gdk_pixbuf_box_downsample (src, dst, &rect);
+    return dst;
+}
+
+static void
+pyramid_job_func (gpointer data,
+                  gpointer user_data)
+{
+    GdkPixbufPyramidJob *job = data;
+    for (int n = job->first + 1; n <= job->last; n++)
+        job->levels[n] = gdk_pixbuf_pyramid_downsample (job->levels[n - 1]);
+    g_idle_add (pyramid_job_done_cb, job);
+}
+
+/**
+ * pyramid_job_done_cb:
+ *
+ * Adds the levels built by a worker thread to the pyramid, unless it
+ * has been freed or damaged in the meantime, and calls its ready
+ * function.
+ **/
+static gboolean
+pyramid_job_done_cb (gpointer data)
+{
+    GdkPixbufPyramidJob *job = data;
+    GdkPixbufPyramid *pyramid = job->pyramid;
+    if (pyramid)
+    {
+        pyramid->job = NULL;
+        for (int n = job->first + 1; n <= job->last; n++)
+        {
+            if (pyramid->levels[n])
+                continue;
+            pyramid->levels[n] = g_object_ref (job->levels[n]);
+            gdk_pixbuf_memory_track_pixbuf (pyramid->levels[n],
+                                            GDK_PIXBUF_MEMORY_PYRAMIDS);
+        }
+        if (pyramid->ready_func)
+            pyramid->ready_func (pyramid, pyramid->ready_data);
+    }
+    for (int n = job->first; n <= job->last; n++)
+        g_object_unref (job->levels[n]);
+    g_free (job);
+    return FALSE;
+}
+
+/**
+ * gdk_pixbuf_pyramid_detach_job:
+ *
+ * Makes the levels being built on a worker thread, if any, be thrown
+ * away when they are done.
+ **/
+static void
+gdk_pixbuf_pyramid_detach_job (GdkPixbufPyramid *pyramid)
+{
+    if (!pyramid->job)
+        return;
+    pyramid->job->pyramid = NULL;
+    pyramid->job = NULL;
+}
+
+/**
+ * gdk_pixbuf_pyramid_free_levels:
+ *
+ * Frees all levels that have been built, except the full size one.
+ **/
+static void
+gdk_pixbuf_pyramid_free_levels (GdkPixbufPyramid *pyramid)
+{
+    for (int n = 1; n < pyramid->n_levels; n++)
+        if (pyramid->levels[n])
+        {
+            g_object_unref (pyramid->levels[n]);
+            pyramid->levels[n] = NULL;
+        }
+}
+
+/**
+ * gdk_pixbuf_pyramid_shrink_cb:
+ *
+ * Frees the built levels when memory is short, unless a level has
+ * been asked for since the last time the pyramid was asked to.
+ **/
+static void
+gdk_pixbuf_pyramid_shrink_cb (gpointer data)
+{
+    GdkPixbufPyramid *pyramid = data;
+    if (pyramid->used)
+        pyramid->used = FALSE;
+    else
+        gdk_pixbuf_pyramid_free_levels (pyramid);
+}
+
+/**
+ * gdk_pixbuf_pyramid_new:
+ * @pixbuf: the full size #GdkPixbuf
+ * @returns: a new #GdkPixbufPyramid
+ *
+ * Creates a new image pyramid for @pixbuf. No levels are built until
+ * they are requested with gdk_pixbuf_pyramid_get_level(). The
+ * pyramid holds a reference to @pixbuf.
+ **/
+GdkPixbufPyramid *
+gdk_pixbuf_pyramid_new (GdkPixbuf *pixbuf)
+{
+    GdkPixbufPyramid *pyramid = g_new0 (GdkPixbufPyramid, 1);
+    pyramid->pixbuf = g_object_ref (pixbuf);
+    pyramid->levels[0] = pixbuf;
+
+    int width = gdk_pixbuf_get_width (pixbuf);
+    int height = gdk_pixbuf_get_height (pixbuf);
+    pyramid->n_levels = 1;
+    while ((width > 1 || height > 1) &&
+           pyramid->n_levels < GDK_PIXBUF_PYRAMID_MAX_LEVELS)
+    {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        pyramid->n_levels++;
+    }
+    pyramid->used = FALSE;
+    pyramid->job = NULL;
+    pyramid->ready_func = NULL;
+    pyramid->ready_data = NULL;
+    gdk_pixbuf_memory_add_shrinker (GDK_PIXBUF_MEMORY_PYRAMIDS,
+                                    gdk_pixbuf_pyramid_shrink_cb, pyramid);
+    return pyramid;
+}
+
+/**
+ * gdk_pixbuf_pyramid_free:
+ * @pyramid: a #GdkPixbufPyramid
+ *
+ * Frees the pyramid and all levels that have been built.
+ **/
+void
+gdk_pixbuf_pyramid_free (GdkPixbufPyramid *pyramid)
+{
+    gdk_pixbuf_memory_remove_shrinker (gdk_pixbuf_pyramid_shrink_cb, pyramid);
+    gdk_pixbuf_pyramid_detach_job (pyramid);
+    gdk_pixbuf_pyramid_free_levels (pyramid);
+    g_object_unref (pyramid->pixbuf);
+    g_free (pyramid);
+}
+
+/**
+ * gdk_pixbuf_pyramid_get_level_for_zoom:
+ * @pyramid: a #GdkPixbufPyramid
+ * @zoom: the zoom factor to draw the pixbuf at
+ * @returns: the smallest level that is at least as large as the
+ *   zoomed pixbuf
+ *
+ * Returns the level to scale from to draw the pixbuf at @zoom. The
+ * level's own zoom factor is @zoom multiplied by 2 raised to the
+ * level. For zoom factors of 0.5 or more the full size pixbuf, level
+ * 0, is returned.
+ **/
+int
+gdk_pixbuf_pyramid_get_level_for_zoom (GdkPixbufPyramid *pyramid,
+                                       gdouble           zoom)
+{
+    int level = 0;
+    while (zoom * 2.0 <= 1.0 && level < pyramid->n_levels - 1)
+    {
+        zoom *= 2.0;
+        level++;
+    }
+    return level;
+}
+
+/**
+ * gdk_pixbuf_pyramid_get_level:
+ * @pyramid: a #GdkPixbufPyramid
+ * @level: the level to get
+ * @returns: the pixbuf of the level
+ *
+ * Returns the pixbuf of a level in the pyramid, building it and the
+ * levels before it if needed. The pixbuf is owned by the pyramid.
+ **/
+GdkPixbuf *
+gdk_pixbuf_pyramid_get_level (GdkPixbufPyramid *pyramid,
+                              int               level)
+{
+    g_return_val_if_fail (level >= 0 && level < pyramid->n_levels, NULL);
+    if (level)
+        pyramid->used = TRUE;
+    if (pyramid->levels[level])
+        return pyramid->levels[level];
+
+    GdkPixbuf *src = gdk_pixbuf_pyramid_get_level (pyramid, level - 1);
+    GdkPixbuf *dst = gdk_pixbuf_pyramid_downsample (src);
+    gdk_pixbuf_memory_track_pixbuf (dst, GDK_PIXBUF_MEMORY_PYRAMIDS);
+    pyramid->levels[level] = dst;
+    return dst;
+}
+
+/**
+ * gdk_pixbuf_pyramid_damage:
+ * @pyramid: a #GdkPixbufPyramid
+ * @rect: the area in image space coordinates that has changed, or
+ *   %NULL if the whole pixbuf has changed
+ *
+ * Updates the levels that have been built after the pixels in @rect
+ * of the full size pixbuf have been modified. Levels being built on a
+ * worker thread may have read the old pixels, so they are thrown
+ * away.
+ **/
+void
+gdk_pixbuf_pyramid_damage (GdkPixbufPyramid *pyramid,
+                           GdkRectangle     *rect)
+{
+    gdk_pixbuf_pyramid_detach_job (pyramid);
+
+    GdkRectangle area = {
+        0, 0,
+        gdk_pixbuf_get_width (pyramid->pixbuf),
+        gdk_pixbuf_get_height (pyramid->pixbuf)
+    };
+    if (rect && !gdk_rectangle_intersect (&area, rect, &area))
+        return;
+
+    for (int n = 1; n < pyramid->n_levels && pyramid->levels[n]; n++)
+    {
+        int x1 = (area.x + area.width - 1) / 2;
+        int y1 = (area.y + area.height - 1) / 2;
+        area.x /= 2;
+        area.y /= 2;
+        area.width = x1 - area.x + 1;
+        area.height = y1 - area.y + 1;
+        gdk_pixbuf_box_downsample (pyramid->levels[n - 1],
+                                   pyramid->levels[n],
+                                   &area);
+    }
+}
+
+/**
+ * gdk_pixbuf_pyramid_set_ready_func:
+ * @pyramid: a #GdkPixbufPyramid
+ * @func: function to call when levels built on a worker thread are
+ *   ready, or %NULL
+ * @data: user data to pass to @func
+ *
+ * Sets the function to call when levels requested with
+ * gdk_pixbuf_pyramid_request_level() have been built. Levels are
+ * only built on worker threads while a ready function is set.
+ **/
+void
+gdk_pixbuf_pyramid_set_ready_func (GdkPixbufPyramid     *pyramid,
+                                   GdkPixbufPyramidFunc  func,
+                                   gpointer              data)
+{
+    pyramid->ready_func = func;
+    pyramid->ready_data = data;
+}
+
+/**
+ * gdk_pixbuf_pyramid_request_level:
+ * @pyramid: a #GdkPixbufPyramid
+ * @level: the level wanted, set to the level returned
+ * @returns: the pixbuf of the level
+ *
+ * Like gdk_pixbuf_pyramid_get_level() but without blocking. If the
+ * level has not been built, it and the levels before it are built on
+ * a worker thread and the largest level before it that is already
+ * built is returned. The ready function is called when the level
+ * can be had. Without a ready function, or without thread support,
+ * the level is built at once.
+ **/
+GdkPixbuf *
+gdk_pixbuf_pyramid_request_level (GdkPixbufPyramid *pyramid,
+                                  int              *level)
+{
+    g_return_val_if_fail (*level >= 0 && *level < pyramid->n_levels, NULL);
+    if (!pyramid->ready_func || !g_thread_supported ())
+        return gdk_pixbuf_pyramid_get_level (pyramid, *level);
+    if (*level)
+        pyramid->used = TRUE;
+
+    int built = *level;
+    while (!pyramid->levels[built])
+        built--;
+    if (built < *level && !pyramid->job)
+    {
+        GdkPixbufPyramidJob *job = g_new0 (GdkPixbufPyramidJob, 1);
+        job->pyramid = pyramid;
+        job->first = built;
+        job->last = *level;
+        job->levels[built] = g_object_ref (pyramid->levels[built]);
+        pyramid->job = job;
+        if (!pyramid_pool)
+            pyramid_pool = g_thread_pool_new (pyramid_job_func, NULL,
+                                              1, FALSE, NULL);
+        g_thread_pool_push (pyramid_pool, job, NULL);
+    }
+    *level = built;
+    return pyramid->levels[built];
+}
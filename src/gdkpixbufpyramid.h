@@ -0,0 +1,67 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; coding: utf-8 -*- */
+#ifndef __GDK_PIXBUF_PYRAMID_H__
+#define __GDK_PIXBUF_PYRAMID_H__
+
+#include <gdk/gdk.h>
+
+/**
+ * GDK_PIXBUF_PYRAMID_MAX_LEVELS:
+ *
+ * Maximum number of levels in a #GdkPixbufPyramid, including the
+ * full size pixbuf.
+ **/
+#define GDK_PIXBUF_PYRAMID_MAX_LEVELS   16
+
+typedef struct _GdkPixbufPyramid GdkPixbufPyramid;
+typedef struct _GdkPixbufPyramidJob GdkPixbufPyramidJob;
+
+/**
+ * GdkPixbufPyramidFunc:
+ * @pyramid: the #GdkPixbufPyramid
+ * @data: user data passed to gdk_pixbuf_pyramid_set_ready_func()
+ *
+ * Called when levels that were built on a worker thread have been
+ * added to the pyramid.
+ **/
+typedef void (*GdkPixbufPyramidFunc) (GdkPixbufPyramid *pyramid,
+                                      gpointer          data);
+
+/**
+ * GdkPixbufPyramid:
+ *
+ * An image pyramid of a pixbuf. Level 0 is the pixbuf itself and
+ * each following level is half as wide and high as the one before
+ * it. Levels are only built when they are first asked for.
+ **/
+struct _GdkPixbufPyramid
+{
+    GdkPixbuf *pixbuf;
+    int        n_levels;
+    /* Levels that have not been built yet are NULL. */
+    GdkPixbuf *levels[GDK_PIXBUF_PYRAMID_MAX_LEVELS];
+    /* Whether a level has been asked for since the pyramid was last
+       asked to free its levels because memory is short. */
+    gboolean   used;
+
+    /* Levels being built on a worker thread, or NULL, and the
+       function to call when they are done. */
+    GdkPixbufPyramidJob  *job;
+    GdkPixbufPyramidFunc  ready_func;
+    gpointer              ready_data;
+};
+
+GdkPixbufPyramid *gdk_pixbuf_pyramid_new          (GdkPixbuf        *pixbuf);
+void              gdk_pixbuf_pyramid_free         (GdkPixbufPyramid *pyramid);
+int               gdk_pixbuf_pyramid_get_level_for_zoom (GdkPixbufPyramid *pyramid,
+                                                         gdouble           zoom);
+GdkPixbuf        *gdk_pixbuf_pyramid_get_level    (GdkPixbufPyramid *pyramid,
+                                                   int               level);
+void              gdk_pixbuf_pyramid_damage       (GdkPixbufPyramid *pyramid,
+                                                   GdkRectangle     *rect);
+void              gdk_pixbuf_pyramid_set_ready_func (GdkPixbufPyramid     *pyramid,
+                                                     GdkPixbufPyramidFunc  func,
+                                                     gpointer              data);
+GdkPixbuf        *gdk_pixbuf_pyramid_request_level (GdkPixbufPyramid *pyramid,
+                                                    int              *level);
+
+#endif
@@ -0,0 +1,246 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; coding: utf-8 -*-
+ *
+ * Copyright © 2007-2008 Björn Lindqvist <bjourne@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/**
+ * SECTION:gtkiimagesource
+ * @see_also: #GtkImageSourceMapped, gtk_image_view_set_source()
+ * @short_description: Interface for images that are read in tiles
+ * instead of held in a #GdkPixbuf
+ *
+ * <para>
+ *   GtkIImageSource is an interface for images that are too large to
+ *   decode into one #GdkPixbuf, such as multi-gigabyte scans. The
+ *   #GdkPixbufDrawCache asks the source for the pixels of each tile
+ *   it scales, at the resolution it scales from, and the source
+ *   reads only those. Resident memory is then bounded by the
+ *   viewport and the size of the draw cache, not by the size of the
+ *   image. A source is shown with gtk_image_view_set_source().
+ * </para>
+ * <para>
+ *   Like #GdkPixbufPyramid, a source has levels. Level 0 is the full
+ *   size image and each following level is half as wide and high as
+ *   the one before it, rounded up, with each pixel averaging the 2x2
+ *   pixels of the level before it that it covers. Zoomed out images
+ *   are scaled from the level closest to the zoom, so a source
+ *   should be able to read them without reading every pixel of the
+ *   full size image, for example from the overviews of a tiled
+ *   TIFF file.
+ * </para>
+ * <para>
+ *   The draw cache reads areas from worker threads when drawing
+ *   asynchronously, so all functions of a source must be thread
+ *   safe. The size and alpha of a source must never change.
+ *   #GtkImageSourceMapped is a source reading memory mapped PPM and
+ *   PAM files.
+ * </para>
+ **/
+#include "gdkpixbufpyramid.h"
+#include "gtkiimagesource.h"
+
+/*************************************************************/
+/***** Stuff that deals with the type ************************/
+/*************************************************************/
+GType
+gtk_iimage_source_get_type (void)
+{
+    static GType type = 0;
+    if (type)
+        return type;
+    static const GTypeInfo info = {
+        sizeof (GtkIImageSourceClass),
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        0,
+        0,
+        NULL
+    };
+    type = g_type_register_static (G_TYPE_INTERFACE,
+                                   "GtkIImageSource",
+                                   &info,
+                                   0);
+    g_type_interface_add_prerequisite (type, G_TYPE_OBJECT);
+    return type;
+}
+
+/*************************************************************/
+/***** Read-only properties **********************************/
+/*************************************************************/
+/**
+ * gtk_iimage_source_get_size:
+ * @source: the source
+ * @width: return location for the width of the full size image
+ * @height: return location for the height of the full size image
+ *
+ * Gets the size of level 0 of the source.
+ **/
+void
+gtk_iimage_source_get_size (GtkIImageSource *source,
+                            int             *width,
+                            int             *height)
+{
+    GTK_IIMAGE_SOURCE_GET_CLASS (source)->get_size (source, width, height);
+}
+
+/**
+ * gtk_iimage_source_get_has_alpha:
+ * @source: the source
+ * @returns: %TRUE if the pixels read have an alpha channel
+ *
+ * Returns whether the pixbufs returned by
+ * gtk_iimage_source_read_area() have an alpha channel.
+ **/
+gboolean
+gtk_iimage_source_get_has_alpha (GtkIImageSource *source)
+{
+    return GTK_IIMAGE_SOURCE_GET_CLASS (source)->get_has_alpha (source);
+}
+
+/**
+ * gtk_iimage_source_get_n_levels:
+ * @source: the source
+ * @returns: the number of levels of the source
+ *
+ * Returns the number of levels of the source, which are halved until
+ * the last one is 1x1 pixel or there are
+ * #GDK_PIXBUF_PYRAMID_MAX_LEVELS of them.
+ **/
+int
+gtk_iimage_source_get_n_levels (GtkIImageSource *source)
+{
+    int width, height;
+    gtk_iimage_source_get_size (source, &width, &height);
+    int n_levels = 1;
+    while ((width > 1 || height > 1) &&
+           n_levels < GDK_PIXBUF_PYRAMID_MAX_LEVELS)
+    {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        n_levels++;
+    }
+    return n_levels;
+}
+
+/**
+ * gtk_iimage_source_get_level_size:
+ * @source: the source
+ * @level: a level of the source
+ * @width: return location for the width of the level
+ * @height: return location for the height of the level
+ *
+ * Gets the size of a level of the source.
+ **/
+void
+gtk_iimage_source_get_level_size (GtkIImageSource *source,
+                                  int              level,
+                                  int             *width,
+                                  int             *height)
+{
+    gtk_iimage_source_get_size (source, width, height);
+    for (int n = 0; n < level; n++)
+    {
+        *width = (*width + 1) / 2;
+        *height = (*height + 1) / 2;
+    }
+}
+
+/**
+ * gtk_iimage_source_get_level_for_zoom:
+ * @source: the source
+ * @zoom: the zoom factor to draw the image at
+ * @returns: the smallest level that is at least as large as the
+ *   zoomed image
+ *
+ * Returns the level to scale from to draw the image at @zoom, chosen
+ * the same way as gdk_pixbuf_pyramid_get_level_for_zoom() does.
+ **/
+int
+gtk_iimage_source_get_level_for_zoom (GtkIImageSource *source,
+                                      gdouble          zoom)
+{
+    int n_levels = gtk_iimage_source_get_n_levels (source);
+    int level = 0;
+    while (zoom * 2.0 <= 1.0 && level < n_levels - 1)
+    {
+        zoom *= 2.0;
+        level++;
+    }
+    return level;
+}
+
+/**
+ * gtk_iimage_source_get_fast_level:
+ * @source: the source
+ * @returns: the finest level that can be read quickly, or -1
+ *
+ * Returns the finest level whose areas, and those of the levels
+ * after it, can be read without waiting for the disk, for example
+ * because the source keeps them in memory. -1 means that no level
+ * can be read quickly yet. The draw cache only reads such levels in
+ * the main loop to fill in tiles that worker threads have not
+ * scaled yet and to draw previews.
+ *
+ * Sources that do not implement this are assumed to read all levels
+ * quickly.
+ **/
+int
+gtk_iimage_source_get_fast_level (GtkIImageSource *source)
+{
+    GtkIImageSourceClass *klass = GTK_IIMAGE_SOURCE_GET_CLASS (source);
+    if (!klass->get_fast_level)
+        return 0;
+    return klass->get_fast_level (source);
+}
+
+/*************************************************************/
+/***** Pixels ************************************************/
+/*************************************************************/
+/**
+ * gtk_iimage_source_read_area:
+ * @source: the source
+ * @level: the level to read from
+ * @area: the area in the coordinates of @level to read, which must
+ *   be inside the level
+ * @returns: a new 8 bit RGB or RGBA #GdkPixbuf of the size of @area
+ *   with its pixels
+ *
+ * Reads the pixels of an area of a level of the source. The pixbuf
+ * is owned by the caller and no longer needed than it takes to scale
+ * it, so a source should not keep it.
+ **/
+GdkPixbuf *
+gtk_iimage_source_read_area (GtkIImageSource *source,
+                             int              level,
+                             GdkRectangle    *area)
+{
+    g_return_val_if_fail (level >= 0 &&
+                          level < gtk_iimage_source_get_n_levels (source),
+                          NULL);
+    int width, height;
+    gtk_iimage_source_get_level_size (source, level, &width, &height);
+    g_return_val_if_fail (area->x >= 0 && area->y >= 0 &&
+                          area->width > 0 && area->height > 0 &&
+                          area->x + area->width <= width &&
+                          area->y + area->height <= height, NULL);
+    return GTK_IIMAGE_SOURCE_GET_CLASS (source)->read_area (source, level,
+                                                            area);
+}
@@ -0,0 +1,72 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; coding: utf-8 -*-
+ *
+ * Copyright © 2007-2008 Björn Lindqvist <bjourne@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef __GTK_IIMAGE_SOURCE_H__
+#define __GTK_IIMAGE_SOURCE_H__
+
+#include <gdk/gdk.h>
+
+G_BEGIN_DECLS
+
+#define GTK_TYPE_IIMAGE_SOURCE            (gtk_iimage_source_get_type ())
+#define GTK_IIMAGE_SOURCE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GTK_TYPE_IIMAGE_SOURCE, GtkIImageSource))
+#define GTK_IIMAGE_SOURCE_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GTK_TYPE_IIMAGE_SOURCE, GtkIImageSourceClass))
+#define GTK_IS_IIMAGE_SOURCE(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GTK_TYPE_IIMAGE_SOURCE))
+#define GTK_IS_IIMAGE_SOURCE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GTK_TYPE_IIMAGE_SOURCE))
+#define GTK_IIMAGE_SOURCE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_INTERFACE ((obj), GTK_TYPE_IIMAGE_SOURCE, GtkIImageSourceClass))
+
+typedef struct _GtkIImageSource GtkIImageSource;
+typedef struct _GtkIImageSourceClass GtkIImageSourceClass;
+
+struct _GtkIImageSourceClass
+{
+    GTypeInterface parent;
+    void           (*get_size)               (GtkIImageSource *source,
+                                              int             *width,
+                                              int             *height);
+    gboolean       (*get_has_alpha)          (GtkIImageSource *source);
+    GdkPixbuf*     (*read_area)              (GtkIImageSource *source,
+                                              int              level,
+                                              GdkRectangle    *area);
+    int            (*get_fast_level)         (GtkIImageSource *source);
+};
+
+GType         gtk_iimage_source_get_type     (void) G_GNUC_CONST;
+
+/* Read-only properties. */
+void          gtk_iimage_source_get_size     (GtkIImageSource *source,
+                                              int             *width,
+                                              int             *height);
+gboolean      gtk_iimage_source_get_has_alpha (GtkIImageSource *source);
+int           gtk_iimage_source_get_n_levels (GtkIImageSource *source);
+void          gtk_iimage_source_get_level_size (GtkIImageSource *source,
+                                                int              level,
+                                                int             *width,
+                                                int             *height);
+int           gtk_iimage_source_get_level_for_zoom (GtkIImageSource *source,
+                                                    gdouble          zoom);
+int           gtk_iimage_source_get_fast_level (GtkIImageSource *source);
+
+/* Pixels. */
+GdkPixbuf    *gtk_iimage_source_read_area    (GtkIImageSource *source,
+                                              int              level,
+                                              GdkRectangle    *area);
+
+G_END_DECLS
+#endif
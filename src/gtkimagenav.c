@@ -45,6 +45,7 @@
  *   keypresses that it receives are passed along to the view.
  * </para>
  **/
+#include "gdkpixbufmemory.h"
 #include "gtkimagenav.h"
 
 G_DEFINE_TYPE (GtkImageNav, gtk_image_nav, GTK_TYPE_WINDOW);
@@ -52,12 +53,34 @@ G_DEFINE_TYPE (GtkImageNav, gtk_image_nav, GTK_TYPE_WINDOW);
 /*************************************************************/
 /***** Static stuff ******************************************/
 /*************************************************************/
+/**
+ * gtk_image_nav_get_image_size:
+ *
+ * Returns the size of the pixbuf or image source the view shows, or
+ * 0x0 if it shows nothing.
+ **/
+static Size
+gtk_image_nav_get_image_size (GtkImageNav *nav)
+{
+    Size s = {0, 0};
+    GdkPixbuf *pixbuf = gtk_image_view_get_pixbuf (nav->view);
+    GtkIImageSource *source = gtk_image_view_get_source (nav->view);
+    if (pixbuf)
+    {
+        s.width = gdk_pixbuf_get_width (pixbuf);
+        s.height = gdk_pixbuf_get_height (pixbuf);
+    }
+    else if (source)
+        gtk_iimage_source_get_size (source, &s.width, &s.height);
+    return s;
+}
+
 static gdouble
 gtk_image_nav_get_zoom (GtkImageNav *nav)
 {
-    GdkPixbuf *pixbuf = gtk_image_view_get_pixbuf (nav->view);
-    int img_width = gdk_pixbuf_get_width (pixbuf);
-	int img_height = gdk_pixbuf_get_height (pixbuf);
+    Size img = gtk_image_nav_get_image_size (nav);
+    int img_width = img.width;
+	int img_height = img.height;
 
 	gdouble width_zoom =
 		(gdouble)GTK_IMAGE_NAV_MAX_WIDTH / (gdouble)img_width;
@@ -70,11 +93,11 @@ gtk_image_nav_get_zoom (GtkImageNav *nav)
 static Size
 gtk_image_nav_get_preview_size (GtkImageNav *nav)
 {
-	GdkPixbuf *pixbuf = gtk_image_view_get_pixbuf (nav->view);
-    if (!pixbuf)
+    Size img = gtk_image_nav_get_image_size (nav);
+    if (!img.width)
         return (Size){GTK_IMAGE_NAV_MAX_WIDTH, GTK_IMAGE_NAV_MAX_HEIGHT};
-	int img_width = gdk_pixbuf_get_width (pixbuf);
-	int img_height = gdk_pixbuf_get_height (pixbuf);
+	int img_width = img.width;
+	int img_height = img.height;
 
 	gdouble zoom = gtk_image_nav_get_zoom (nav);
 
@@ -136,6 +159,31 @@ gtk_image_nav_update_position (GtkImageNav *nav)
     gtk_window_move (GTK_WINDOW (nav), x, y);
 }
 
+/**
+ * gtk_image_nav_read_source:
+ *
+ * Returns a whole level of the view's image source to scale the
+ * preview from and sets @level to it, or returns %NULL if the source
+ * cannot read any level without waiting for the disk yet. The level
+ * is the one closest to the preview's zoom that can be read quickly.
+ **/
+static GdkPixbuf *
+gtk_image_nav_read_source (GtkImageNav *nav,
+                           int         *level)
+{
+    GtkIImageSource *source = gtk_image_view_get_source (nav->view);
+    int fast = gtk_iimage_source_get_fast_level (source);
+    if (fast < 0)
+        return NULL;
+    *level = gtk_iimage_source_get_level_for_zoom
+        (source, gtk_image_nav_get_zoom (nav));
+    *level = MAX (*level, fast);
+    GdkRectangle area = {0, 0, 0, 0};
+    gtk_iimage_source_get_level_size (source, *level,
+                                      &area.width, &area.height);
+    return gtk_iimage_source_read_area (source, *level, &area);
+}
+
 static void
 gtk_image_nav_update_pixbuf (GtkImageNav *nav)
 {
@@ -145,29 +193,62 @@ gtk_image_nav_update_pixbuf (GtkImageNav *nav)
         nav->pixbuf = NULL;
     }
     GdkPixbuf *pixbuf = gtk_image_view_get_pixbuf (nav->view);
-    if (!pixbuf)
+    int level = 0;
+    if (pixbuf)
+        g_object_ref (pixbuf);
+    else if (gtk_image_view_get_source (nav->view))
+        pixbuf = gtk_image_nav_read_source (nav, &level);
+    else
         return;
 
     Size pw = gtk_image_nav_get_preview_size (nav);
 
     int col1, col2;
     gtk_image_view_get_check_colors (nav->view, &col1, &col2);
-    nav->pixbuf = gdk_pixbuf_new (gdk_pixbuf_get_colorspace (pixbuf),
-                                  gdk_pixbuf_get_has_alpha (pixbuf),
+    nav->pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB,
+                                  pixbuf && gdk_pixbuf_get_has_alpha (pixbuf),
                                   8,
                                   pw.width, pw.height);
+    gdk_pixbuf_memory_track_pixbuf (nav->pixbuf, GDK_PIXBUF_MEMORY_PREVIEWS);
+    if (!pixbuf)
+    {
+        // The source's pixels are not at hand yet, so only the
+        // viewport rectangle is shown until the navigator is shown
+        // again.
+        gdk_pixbuf_fill (nav->pixbuf, (guint32) col1 << 8 | 0xff);
+        return;
+    }
     gdk_pixbuf_scale_blend (pixbuf, nav->pixbuf,
                             0, 0, pw.width, pw.height,
                             0, 0,
-                            gtk_image_nav_get_zoom (nav),
+                            gtk_image_nav_get_zoom (nav) * (1 << level),
                             GDK_INTERP_BILINEAR,
                             0, 0,
                             16, col1, col2);
+    g_object_unref (pixbuf);
     // Lower the flag so the pixbuf isn't recreated more than
     // necessarily.
     nav->update_when_shown = FALSE;
 }
 
+/**
+ * gtk_image_nav_shrink_cb:
+ *
+ * Frees the downsampled pixbuf when memory is short and the
+ * navigator is hidden. It is recreated when the navigator is shown
+ * again.
+ **/
+static void
+gtk_image_nav_shrink_cb (gpointer data)
+{
+    GtkImageNav *nav = GTK_IMAGE_NAV (data);
+    if (!nav->pixbuf || GTK_WIDGET_VISIBLE (nav))
+        return;
+    g_object_unref (nav->pixbuf);
+    nav->pixbuf = NULL;
+    nav->update_when_shown = TRUE;
+}
+
 
 /*************************************************************/
 /***** Private signal handlers *******************************/
@@ -344,12 +425,15 @@ gtk_image_nav_init (GtkImageNav *nav)
                       nav);
 	
 	gtk_window_set_wmclass (GTK_WINDOW (nav), "", "gtkimagenav");
+    gdk_pixbuf_memory_add_shrinker (GDK_PIXBUF_MEMORY_PREVIEWS,
+                                    gtk_image_nav_shrink_cb, nav);
 }
 
 static void
 gtk_image_nav_finalize (GObject *object)
 {
 	GtkImageNav *nav = GTK_IMAGE_NAV (object);
+    gdk_pixbuf_memory_remove_shrinker (gtk_image_nav_shrink_cb, nav);
 	if (nav->pixbuf)
 	{
 		g_object_unref (nav->pixbuf);
@@ -0,0 +1,634 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; coding: utf-8 -*-
+ *
+ * Copyright © 2007-2008 Björn Lindqvist <bjourne@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/**
+ * SECTION:gtkimagesourcemapped
+ * @see_also: #GtkIImageSource
+ * @short_description: Image source reading memory mapped PPM and PAM
+ * files
+ *
+ * <para>
+ *   #GtkImageSourceMapped is a #GtkIImageSource that maps an
+ *   uncompressed image file into memory and reads the tiles the draw
+ *   cache asks for straight from the mapping. Nothing is read when
+ *   the source is created, so opening an image of many gigabytes is
+ *   instant. The pages read are released again after each tile, so
+ *   resident memory is bounded by the viewport and the size of the
+ *   draw cache, not by the size of the image. Images are not limited
+ *   to the 2 GB a #GdkPixbuf can hold, only by the address space.
+ * </para>
+ * <para>
+ *   Binary PPM files and PAM files with 8 bit RGB or RGBA tuples are
+ *   supported. Other formats can be converted to them with for
+ *   example <command>convert image.tif image.pam</command>.
+ * </para>
+ * <para>
+ *   Levels after the full size one are computed by averaging blocks
+ *   of pixels, which reads many pixels of the file for each pixel of
+ *   the level. The source therefore keeps the first level that fits
+ *   in #GTK_IMAGE_SOURCE_MAPPED_OVERVIEW_SIZE bytes in memory and
+ *   reads it and the levels after it from that copy. Building it
+ *   reads the whole file once, the first time a zoomed out enough
+ *   view of the image is drawn. The copy is made on the draw cache's
+ *   worker threads and is not accounted by #GdkPixbufMemory.
+ * </para>
+ **/
+#include <errno.h>
+#include <string.h>
+#include "gtkimagesourcemapped.h"
+
+#ifdef G_OS_UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+typedef struct
+{
+    int width;
+    int height;
+    int n_channels;
+    /* Offset of the first pixel from the start of the file. */
+    gsize offset;
+} MappedHeader;
+
+typedef struct
+{
+    const guchar *p;
+    const guchar *end;
+} HeaderReader;
+
+static void
+header_reader_skip_space (HeaderReader *r)
+{
+    while (r->p < r->end)
+    {
+        if (*r->p == '#')
+            while (r->p < r->end && *r->p != '\n')
+                r->p++;
+        else if (g_ascii_isspace (*r->p))
+            r->p++;
+        else
+            break;
+    }
+}
+
+static gboolean
+header_reader_int (HeaderReader *r,
+                   int          *value)
+{
+    header_reader_skip_space (r);
+    const guchar *start = r->p;
+    gint64 v = 0;
+    while (r->p < r->end && g_ascii_isdigit (*r->p) && v <= G_MAXINT)
+    {
+        v = v * 10 + (*r->p - '0');
+        r->p++;
+    }
+    if (r->p == start || v > G_MAXINT)
+        return FALSE;
+    *value = v;
+    return TRUE;
+}
+
+static void
+header_reader_token (HeaderReader *r,
+                     char         *buf,
+                     int           size)
+{
+    header_reader_skip_space (r);
+    int n = 0;
+    while (r->p < r->end && !g_ascii_isspace (*r->p))
+    {
+        if (n < size - 1)
+            buf[n++] = *r->p;
+        r->p++;
+    }
+    buf[n] = '\0';
+}
+
+/**
+ * gtk_image_source_mapped_parse_pam:
+ *
+ * Parses the header lines of a PAM file that follow its magic number
+ * up to and including the ENDHDR line.
+ **/
+static gboolean
+gtk_image_source_mapped_parse_pam (HeaderReader *r,
+                                   MappedHeader *header,
+                                   int          *maxval)
+{
+    header->width = header->height = header->n_channels = *maxval = 0;
+    while (TRUE)
+    {
+        char key[16];
+        header_reader_token (r, key, sizeof (key));
+        if (!strcmp (key, "ENDHDR"))
+            break;
+        else if (!strcmp (key, "WIDTH"))
+        {
+            if (!header_reader_int (r, &header->width))
+                return FALSE;
+        }
+        else if (!strcmp (key, "HEIGHT"))
+        {
+            if (!header_reader_int (r, &header->height))
+                return FALSE;
+        }
+        else if (!strcmp (key, "DEPTH"))
+        {
+            if (!header_reader_int (r, &header->n_channels))
+                return FALSE;
+        }
+        else if (!strcmp (key, "MAXVAL"))
+        {
+            if (!header_reader_int (r, maxval))
+                return FALSE;
+        }
+        else if (!*key)
+            return FALSE;
+        else
+        {
+            /* TUPLTYPE and unknown lines are implied by DEPTH. */
+            while (r->p < r->end && *r->p != '\n')
+                r->p++;
+        }
+    }
+    while (r->p < r->end && *r->p != '\n')
+        r->p++;
+    if (r->p == r->end)
+        return FALSE;
+    r->p++;
+    return TRUE;
+}
+
+/**
+ * gtk_image_source_mapped_parse_header:
+ *
+ * Parses the header of a binary PPM or PAM image in @data and checks
+ * that its pixels are 8 bit RGB or RGBA and that they are all in the
+ * file.
+ **/
+static gboolean
+gtk_image_source_mapped_parse_header (const guchar  *data,
+                                      gsize          size,
+                                      MappedHeader  *header,
+                                      GError       **error)
+{
+    HeaderReader r = {data + 2, data + size};
+    int maxval = 0;
+    gboolean ok;
+    if (size >= 2 && data[0] == 'P' && data[1] == '6')
+    {
+        header->n_channels = 3;
+        ok = header_reader_int (&r, &header->width) &&
+            header_reader_int (&r, &header->height) &&
+            header_reader_int (&r, &maxval) &&
+            r.p < r.end && g_ascii_isspace (*r.p);
+        r.p++;
+    }
+    else if (size >= 2 && data[0] == 'P' && data[1] == '7')
+        ok = gtk_image_source_mapped_parse_pam (&r, header, &maxval);
+    else
+    {
+        g_set_error (error,
+                     GDK_PIXBUF_ERROR,
+                     GDK_PIXBUF_ERROR_UNKNOWN_TYPE,
+                     "Only binary PPM and PAM images can be mapped");
+        return FALSE;
+    }
+    if (!ok || header->width <= 0 || header->height <= 0)
+    {
+        g_set_error (error,
+                     GDK_PIXBUF_ERROR,
+                     GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                     "Image header is invalid");
+        return FALSE;
+    }
+    if (maxval != 255 ||
+        (header->n_channels != 3 && header->n_channels != 4))
+    {
+        g_set_error (error,
+                     GDK_PIXBUF_ERROR,
+                     GDK_PIXBUF_ERROR_UNKNOWN_TYPE,
+                     "Only 8 bit RGB and RGBA images can be mapped");
+        return FALSE;
+    }
+    if ((guint64) header->width * header->n_channels >
+        G_MAXSIZE / header->height)
+    {
+        g_set_error (error,
+                     GDK_PIXBUF_ERROR,
+                     GDK_PIXBUF_ERROR_UNSUPPORTED_OPERATION,
+                     "Image is too large to be mapped");
+        return FALSE;
+    }
+    header->offset = r.p - data;
+    gsize n_bytes =
+        (gsize) header->width * header->n_channels * header->height;
+    if (header->offset > size || n_bytes > size - header->offset)
+    {
+        g_set_error (error,
+                     GDK_PIXBUF_ERROR,
+                     GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                     "Image file is truncated");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+/*************************************************************/
+/***** Reading pixels ****************************************/
+/*************************************************************/
+typedef struct
+{
+    const guchar *pixels;
+    gsize         rowstride;
+    int           width;
+    int           height;
+    int           n_channels;
+    /* Whether the pixels are those of the mapped file, whose pages
+       are released after they have been read. */
+    gboolean      mapped;
+} Plane;
+
+/**
+ * plane_release_rows:
+ *
+ * Tells the kernel that the rows @y0 up to @y1 of a mapped plane are
+ * not needed anymore so that their pages stop counting as resident
+ * memory. The file is mapped read-only, so the pages are read again
+ * from the page cache or the file if they are needed later.
+ **/
+static void
+plane_release_rows (Plane *plane,
+                    int    y0,
+                    int    y1)
+{
+#if defined (G_OS_UNIX) && defined (MADV_DONTNEED)
+    if (!plane->mapped || y0 >= y1)
+        return;
+    gsize page = sysconf (_SC_PAGESIZE);
+    const guchar *start = plane->pixels + (gsize) y0 * plane->rowstride;
+    const guchar *end = plane->pixels + (gsize) y1 * plane->rowstride;
+    /* The mapping starts at a page boundary before the pixels. */
+    start -= (gsize) start % page;
+    madvise ((void *) start, end - start, MADV_DONTNEED);
+#endif
+}
+
+/**
+ * plane_average:
+ *
+ * Returns a new pixbuf with the pixels of @area of @plane downsampled
+ * by @factor, which is a power of two. Each pixel averages the
+ * @factor by @factor block of @plane it covers, or the part of the
+ * block inside @plane. Pixels with alpha are weighted by their alpha
+ * like the levels of #GdkPixbufPyramid are.
+ **/
+static GdkPixbuf *
+plane_average (Plane        *plane,
+               int           factor,
+               GdkRectangle *area)
+{
+    int chans = plane->n_channels;
+    gboolean alpha = chans == 4;
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, alpha, 8,
+                                        area->width, area->height);
+    int dst_stride = gdk_pixbuf_get_rowstride (pixbuf);
+    guchar *dst = gdk_pixbuf_get_pixels (pixbuf);
+    if (factor == 1)
+    {
+        for (int y = 0; y < area->height; y++)
+            memcpy (dst + y * dst_stride,
+                    plane->pixels
+                    + (gsize) (area->y + y) * plane->rowstride
+                    + (gsize) area->x * chans,
+                    area->width * chans);
+        plane_release_rows (plane, area->y, area->y + area->height);
+        return pixbuf;
+    }
+
+    /* The sums of the channels of each pixel in a row of the area,
+       weighted by alpha if there is one, and the sum of alpha. */
+    guint64 *sums = g_new (guint64, area->width * 4);
+    for (int y = 0; y < area->height; y++)
+    {
+        int y0 = (area->y + y) * factor;
+        int y1 = MIN (y0 + factor, plane->height);
+        memset (sums, 0, area->width * 4 * sizeof (guint64));
+        for (int sy = y0; sy < y1; sy++)
+        {
+            const guchar *row = plane->pixels + (gsize) sy * plane->rowstride;
+            guint64 *sum = sums;
+            for (int x = 0; x < area->width; x++, sum += 4)
+            {
+                int x0 = (area->x + x) * factor;
+                int x1 = MIN (x0 + factor, plane->width);
+                const guchar *p = row + (gsize) x0 * chans;
+                if (!alpha)
+                    for (int sx = x0; sx < x1; sx++, p += 3)
+                    {
+                        sum[0] += p[0];
+                        sum[1] += p[1];
+                        sum[2] += p[2];
+                    }
+                else
+                    for (int sx = x0; sx < x1; sx++, p += 4)
+                    {
+                        sum[0] += p[0] * p[3];
+                        sum[1] += p[1] * p[3];
+                        sum[2] += p[2] * p[3];
+                        sum[3] += p[3];
+                    }
+            }
+        }
+        plane_release_rows (plane, y0, y1);
+
+        guchar *d = dst + y * dst_stride;
+        guint64 *sum = sums;
+        for (int x = 0; x < area->width; x++, sum += 4, d += chans)
+        {
+            int x0 = (area->x + x) * factor;
+            guint64 n = (guint64) (MIN (x0 + factor, plane->width) - x0) *
+                (y1 - y0);
+            guint64 a = alpha ? sum[3] : n;
+            for (int c = 0; c < 3; c++)
+                d[c] = a ? (sum[c] + a / 2) / a : 0;
+            if (alpha)
+                d[3] = (a + n / 2) / n;
+        }
+    }
+    g_free (sums);
+    return pixbuf;
+}
+
+/**
+ * gtk_image_source_mapped_get_overview:
+ *
+ * Returns the level kept in memory, building it from the file if
+ * this is the first time it is needed. Threads that need it while it
+ * is being built wait for it.
+ **/
+static GdkPixbuf *
+gtk_image_source_mapped_get_overview (GtkImageSourceMapped *mapped)
+{
+    GdkPixbuf *overview =
+        g_atomic_pointer_get ((gpointer *) &mapped->overview);
+    if (overview)
+        return overview;
+    g_static_mutex_lock (&mapped->overview_lock);
+    if (!mapped->overview)
+    {
+        Plane plane = {
+            mapped->pixels, mapped->rowstride,
+            mapped->width, mapped->height, mapped->n_channels,
+            TRUE
+        };
+        GdkRectangle all = {0, 0, 0, 0};
+        gtk_iimage_source_get_level_size (GTK_IIMAGE_SOURCE (mapped),
+                                          mapped->overview_level,
+                                          &all.width, &all.height);
+        overview = plane_average (&plane, 1 << mapped->overview_level, &all);
+        g_atomic_pointer_set ((gpointer *) &mapped->overview, overview);
+    }
+    overview = mapped->overview;
+    g_static_mutex_unlock (&mapped->overview_lock);
+    return overview;
+}
+
+/*************************************************************/
+/***** Implementation of the GtkIImageSource interface *******/
+/*************************************************************/
+static void
+get_size (GtkIImageSource *source,
+          int             *width,
+          int             *height)
+{
+    GtkImageSourceMapped *mapped = GTK_IMAGE_SOURCE_MAPPED (source);
+    *width = mapped->width;
+    *height = mapped->height;
+}
+
+static gboolean
+get_has_alpha (GtkIImageSource *source)
+{
+    return GTK_IMAGE_SOURCE_MAPPED (source)->n_channels == 4;
+}
+
+/**
+ * read_area:
+ *
+ * Reads levels before the overview from the file and the others from
+ * the overview.
+ **/
+static GdkPixbuf *
+read_area (GtkIImageSource *source,
+           int              level,
+           GdkRectangle    *area)
+{
+    GtkImageSourceMapped *mapped = GTK_IMAGE_SOURCE_MAPPED (source);
+    if (level < mapped->overview_level)
+    {
+        Plane plane = {
+            mapped->pixels, mapped->rowstride,
+            mapped->width, mapped->height, mapped->n_channels,
+            TRUE
+        };
+        return plane_average (&plane, 1 << level, area);
+    }
+    GdkPixbuf *overview = gtk_image_source_mapped_get_overview (mapped);
+    Plane plane = {
+        gdk_pixbuf_get_pixels (overview),
+        gdk_pixbuf_get_rowstride (overview),
+        gdk_pixbuf_get_width (overview),
+        gdk_pixbuf_get_height (overview),
+        mapped->n_channels,
+        FALSE
+    };
+    return plane_average (&plane, 1 << (level - mapped->overview_level),
+                          area);
+}
+
+static int
+get_fast_level (GtkIImageSource *source)
+{
+    GtkImageSourceMapped *mapped = GTK_IMAGE_SOURCE_MAPPED (source);
+    if (!g_atomic_pointer_get ((gpointer *) &mapped->overview))
+        return -1;
+    return mapped->overview_level;
+}
+
+/*************************************************************/
+/***** Stuff that deals with the type ************************/
+/*************************************************************/
+static void
+gtk_iimage_source_interface_init (gpointer g_iface,
+                                  gpointer iface_data)
+{
+    GtkIImageSourceClass *klass = (GtkIImageSourceClass *) g_iface;
+    klass->get_size = get_size;
+    klass->get_has_alpha = get_has_alpha;
+    klass->read_area = read_area;
+    klass->get_fast_level = get_fast_level;
+}
+
+G_DEFINE_TYPE_EXTENDED (GtkImageSourceMapped,
+                        gtk_image_source_mapped,
+                        G_TYPE_OBJECT,
+                        0,
+                        G_IMPLEMENT_INTERFACE (GTK_TYPE_IIMAGE_SOURCE,
+                                               gtk_iimage_source_interface_init));
+
+static void
+gtk_image_source_mapped_finalize (GObject *object)
+{
+    GtkImageSourceMapped *mapped = GTK_IMAGE_SOURCE_MAPPED (object);
+    if (mapped->overview)
+        g_object_unref (mapped->overview);
+    g_static_mutex_free (&mapped->overview_lock);
+#ifdef G_OS_UNIX
+    if (mapped->data)
+        munmap (mapped->data, mapped->size);
+#else
+    g_free (mapped->data);
+#endif
+
+    /* Chain up */
+    G_OBJECT_CLASS (gtk_image_source_mapped_parent_class)->finalize (object);
+}
+
+static void
+gtk_image_source_mapped_class_init (GtkImageSourceMappedClass *klass)
+{
+    GObjectClass *object_class = (GObjectClass *) klass;
+    object_class->finalize = gtk_image_source_mapped_finalize;
+}
+
+static void
+gtk_image_source_mapped_init (GtkImageSourceMapped *mapped)
+{
+    mapped->data = NULL;
+    mapped->size = 0;
+    mapped->pixels = NULL;
+    mapped->rowstride = 0;
+    mapped->width = 0;
+    mapped->height = 0;
+    mapped->n_channels = 0;
+    mapped->overview_level = 0;
+    mapped->overview = NULL;
+    g_static_mutex_init (&mapped->overview_lock);
+}
+
+/**
+ * gtk_image_source_mapped_new:
+ * @filename: name of a binary PPM or PAM file with 8 bit RGB or RGBA
+ *   pixels
+ * @error: return location for an error, or %NULL
+ * @returns: a new #GtkImageSourceMapped, or %NULL if the file could
+ *   not be mapped
+ *
+ * Creates an image source that reads the pixels of @filename on
+ * demand by mapping the file into memory. Only the header of the
+ * file is read by this function. The file should not be modified
+ * while the source exists.
+ *
+ * On systems without mmap(), the whole file is read into memory.
+ **/
+GtkIImageSource *
+gtk_image_source_mapped_new (const char  *filename,
+                             GError     **error)
+{
+    guchar *data;
+    gsize size;
+#ifdef G_OS_UNIX
+    int fd = open (filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat (fd, &st) < 0)
+    {
+        int saved_errno = errno;
+        char *display_name = g_filename_display_name (filename);
+        g_set_error (error,
+                     G_FILE_ERROR,
+                     g_file_error_from_errno (saved_errno),
+                     "Failed to open file '%s': %s",
+                     display_name, g_strerror (saved_errno));
+        g_free (display_name);
+        if (fd >= 0)
+            close (fd);
+        return NULL;
+    }
+    size = st.st_size;
+    data = size ? mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)
+        : MAP_FAILED;
+    int saved_errno = errno;
+    close (fd);
+    if (data == MAP_FAILED)
+    {
+        char *display_name = g_filename_display_name (filename);
+        g_set_error (error,
+                     G_FILE_ERROR,
+                     size ? g_file_error_from_errno (saved_errno)
+                     : G_FILE_ERROR_INVAL,
+                     "Failed to map file '%s': %s",
+                     display_name,
+                     size ? g_strerror (saved_errno) : "File is empty");
+        g_free (display_name);
+        return NULL;
+    }
+#else
+    if (!g_file_get_contents (filename, (gchar **) &data, &size, error))
+        return NULL;
+#endif
+
+    GtkImageSourceMapped *mapped =
+        g_object_new (GTK_TYPE_IMAGE_SOURCE_MAPPED, NULL);
+    mapped->data = data;
+    mapped->size = size;
+
+    MappedHeader header;
+    if (!gtk_image_source_mapped_parse_header (data, size, &header, error))
+    {
+        g_object_unref (mapped);
+        return NULL;
+    }
+    mapped->pixels = data + header.offset;
+    mapped->width = header.width;
+    mapped->height = header.height;
+    mapped->n_channels = header.n_channels;
+    mapped->rowstride = (gsize) header.width * header.n_channels;
+
+    /* The first level small enough to keep in memory. */
+    GtkIImageSource *source = GTK_IIMAGE_SOURCE (mapped);
+    int n_levels = gtk_iimage_source_get_n_levels (source);
+    int width = header.width;
+    int height = header.height;
+    while ((gsize) width * height * header.n_channels >
+           GTK_IMAGE_SOURCE_MAPPED_OVERVIEW_SIZE &&
+           mapped->overview_level < n_levels - 1)
+    {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        mapped->overview_level++;
+    }
+    return source;
+}
@@ -0,0 +1,64 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; coding: utf-8 -*- */
+#ifndef __GTK_IMAGE_SOURCE_MAPPED_H__
+#define __GTK_IMAGE_SOURCE_MAPPED_H__
+
+#include <gdk/gdk.h>
+#include "gtkiimagesource.h"
+
+G_BEGIN_DECLS
+
+#define GTK_TYPE_IMAGE_SOURCE_MAPPED            (gtk_image_source_mapped_get_type ())
+#define GTK_IMAGE_SOURCE_MAPPED(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GTK_TYPE_IMAGE_SOURCE_MAPPED, GtkImageSourceMapped))
+#define GTK_IMAGE_SOURCE_MAPPED_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GTK_TYPE_IMAGE_SOURCE_MAPPED, GtkImageSourceMappedClass))
+#define GTK_IS_IMAGE_SOURCE_MAPPED(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GTK_TYPE_IMAGE_SOURCE_MAPPED))
+#define GTK_IS_IMAGE_SOURCE_MAPPED_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GTK_TYPE_IMAGE_SOURCE_MAPPED))
+#define GTK_IMAGE_SOURCE_MAPPED_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GTK_TYPE_IMAGE_SOURCE_MAPPED, GtkImageSourceMappedClass))
+
+/**
+ * GTK_IMAGE_SOURCE_MAPPED_OVERVIEW_SIZE:
+ *
+ * Maximum number of bytes of the downsampled copy of the image that
+ * a #GtkImageSourceMapped keeps in memory to read zoomed out levels
+ * from.
+ **/
+#define GTK_IMAGE_SOURCE_MAPPED_OVERVIEW_SIZE   (16 * 1024 * 1024)
+
+typedef struct _GtkImageSourceMapped GtkImageSourceMapped;
+typedef struct _GtkImageSourceMappedClass GtkImageSourceMappedClass;
+
+struct _GtkImageSourceMapped
+{
+    GObject       parent;
+
+    /* The mapped file, or its contents on systems without mmap(). */
+    guchar       *data;
+    gsize         size;
+
+    /* The pixels of the image in the file. */
+    const guchar *pixels;
+    gsize         rowstride;
+    int           width;
+    int           height;
+    int           n_channels;
+
+    /* The level kept in memory, which is built the first time it or
+       a level after it is read, and the lock held while building
+       it. */
+    int           overview_level;
+    GdkPixbuf    *overview;
+    GStaticMutex  overview_lock;
+};
+
+struct _GtkImageSourceMappedClass
+{
+    GObjectClass parent;
+};
+
+GType         gtk_image_source_mapped_get_type (void);
+
+/* Constructors */
+GtkIImageSource *gtk_image_source_mapped_new (const char  *filename,
+                                              GError     **error);
+
+G_END_DECLS
+#endif
@@ -27,11 +27,47 @@
  *   GtkImageToolDragger is the default image tool for #GtkImageView.
  *   Its only feature is that it can drag the image around.
  * </para>
+ * <para>
+ *   The dragger supports asynchronous scaling, see
+ *   gtk_image_view_set_async().
+ * </para>
+ * <para>
+ *   In kinetic mode, see gtk_image_tool_dragger_set_kinetic(), the
+ *   image keeps gliding after the mouse button is released and slows
+ *   down gradually.
+ * </para>
+ * <para>
+ *   While the image is dragged, the dragger measures how fast it
+ *   moves and scales the tiles that are about to scroll into view in
+ *   idle time, so that they only need to be copied when they do.
+ * </para>
+ * <para>
+ *   The view asks for motion hints, so motion does not pile up while
+ *   the view is being redrawn. Each hint scrolls the image once to
+ *   where the pointer is now.
+ * </para>
  **/
+#include <math.h>
 #include <stdlib.h>
 #include "cursors.h"
 #include "gtkimagetooldragger.h"
 
+/* How many seconds ahead of the drag tiles are prefetched. */
+#define PREFETCH_AHEAD              0.3
+
+/* Milliseconds between the frames of kinetic scrolling. */
+#define KINETIC_FRAME_INTERVAL      16
+
+/* Seconds it takes a fling to slow down to 1/e of its speed. */
+#define KINETIC_TIME_CONSTANT       0.325
+
+/* Speed, in pixels per second, at which a fling stops. */
+#define KINETIC_MIN_VELOCITY        20.0
+
+/* A release later than this many milliseconds after the last motion
+   does not fling the image. */
+#define KINETIC_RELEASE_DELAY       100
+
 /*************************************************************/
 /***** Static stuff ******************************************/
 /*************************************************************/
@@ -54,8 +90,15 @@ gtk_image_tool_dragger_is_draggable (GtkImageToolDragger *dragger,
     gdouble zoom = gtk_image_view_get_zoom (view);
     GdkPixbuf *pixbuf = gtk_image_view_get_pixbuf (view);
 
-    int pb_w = gdk_pixbuf_get_width (pixbuf);
-    int pb_h = gdk_pixbuf_get_height (pixbuf);
+    int pb_w, pb_h;
+    if (pixbuf)
+    {
+        pb_w = gdk_pixbuf_get_width (pixbuf);
+        pb_h = gdk_pixbuf_get_height (pixbuf);
+    }
+    else
+        gtk_iimage_source_get_size (gtk_image_view_get_source (view),
+                                    &pb_w, &pb_h);
 
     int zoom_w = (int) (pb_w * zoom + 0.5);
     int zoom_h = (int) (pb_h * zoom + 0.5);
@@ -69,6 +112,214 @@ gtk_image_tool_dragger_is_draggable (GtkImageToolDragger *dragger,
     return FALSE;
 }
 
+/**
+ * gtk_image_tool_dragger_tile_ready_cb:
+ *
+ * Called when the draw cache has finished scaling a tile
+ * asynchronously. Redraws the part of the tile that is visible in
+ * the view.
+ **/
+static void
+gtk_image_tool_dragger_tile_ready_cb (GdkPixbufDrawCache *cache,
+                                      GdkRectangle       *zoom_rect,
+                                      gpointer            data)
+{
+    GtkImageToolDragger *dragger = GTK_IMAGE_TOOL_DRAGGER (data);
+    GtkImageView *view = dragger->view;
+    GdkRectangle viewport, draw_rect;
+    if (!GTK_WIDGET_REALIZED (view) ||
+        !gtk_image_view_get_viewport (view, &viewport) ||
+        !gtk_image_view_get_draw_rect (view, &draw_rect))
+        return;
+
+    GdkRectangle wid_rect = {
+        draw_rect.x + zoom_rect->x - viewport.x,
+        draw_rect.y + zoom_rect->y - viewport.y,
+        zoom_rect->width,
+        zoom_rect->height
+    };
+    if (gdk_rectangle_intersect (&wid_rect, &draw_rect, &wid_rect))
+        gtk_widget_queue_draw_area (GTK_WIDGET (view),
+                                    wid_rect.x, wid_rect.y,
+                                    wid_rect.width, wid_rect.height);
+}
+
+/**
+ * gtk_image_tool_dragger_get_velocity:
+ *
+ * Sets @vx and @vy to the speed, in zoom space pixels per second,
+ * with which the viewport is moving, either because the image is
+ * dragged or because it was flung. The image moves in the opposite
+ * direction of the mouse.
+ **/
+static void
+gtk_image_tool_dragger_get_velocity (GtkImageToolDragger *dragger,
+                                     gdouble             *vx,
+                                     gdouble             *vy)
+{
+    if (dragger->mouse_handler->pressed)
+    {
+        mouse_handler_get_velocity (dragger->mouse_handler, vx, vy);
+        *vx = -*vx;
+        *vy = -*vy;
+    }
+    else
+    {
+        *vx = dragger->velocity_x;
+        *vy = dragger->velocity_y;
+    }
+}
+
+/**
+ * gtk_image_tool_dragger_prefetch_cb:
+ *
+ * Idle handler that prefetches the tiles between the viewport and
+ * where it will be in %PREFETCH_AHEAD seconds if it keeps moving at
+ * the same speed. The distance is limited to the size of the
+ * viewport.
+ **/
+static gboolean
+gtk_image_tool_dragger_prefetch_cb (gpointer data)
+{
+    GtkImageToolDragger *dragger = GTK_IMAGE_TOOL_DRAGGER (data);
+    GdkRectangle viewport;
+    if ((!dragger->mouse_handler->dragging && !dragger->frame_id) ||
+        !gtk_image_view_get_viewport (dragger->view, &viewport))
+    {
+        dragger->prefetch_id = 0;
+        return FALSE;
+    }
+    gdouble vx, vy;
+    gtk_image_tool_dragger_get_velocity (dragger, &vx, &vy);
+    int dx = CLAMP (vx * PREFETCH_AHEAD, -viewport.width, viewport.width);
+    int dy = CLAMP (vy * PREFETCH_AHEAD, -viewport.height, viewport.height);
+
+    GdkRectangle ahead = viewport;
+    ahead.x += dx;
+    ahead.y += dy;
+    gdk_rectangle_union (&viewport, &ahead, &ahead);
+    if (gdk_pixbuf_draw_cache_prefetch (dragger->cache, &ahead))
+        return TRUE;
+    dragger->prefetch_id = 0;
+    return FALSE;
+}
+
+static void
+gtk_image_tool_dragger_queue_prefetch (GtkImageToolDragger *dragger)
+{
+    if (!dragger->prefetch_id)
+        dragger->prefetch_id =
+            g_idle_add_full (G_PRIORITY_LOW,
+                             gtk_image_tool_dragger_prefetch_cb,
+                             dragger, NULL);
+}
+
+/**
+ * gtk_image_tool_dragger_frame_cb:
+ *
+ * Draws one frame of kinetic scrolling. While the mouse button is
+ * held, the distance dragged since the last frame is scrolled so
+ * that the view is redrawn at most once per frame, however many
+ * motion events arrived. After a fling, the image is moved by its
+ * velocity which decays exponentially with the time since the last
+ * frame. Fractions of pixels are carried over to the next frame so
+ * that slow flings do not stall.
+ *
+ * Each frame is a normal scroll of the view, so only the strips
+ * that scroll into view are scaled. The fling stops when it is slow
+ * enough or when it hits the edges of the image.
+ **/
+static gboolean
+gtk_image_tool_dragger_frame_cb (gpointer data)
+{
+    GtkImageToolDragger *dragger = GTK_IMAGE_TOOL_DRAGGER (data);
+    gdouble dt = g_timer_elapsed (dragger->frame_timer, NULL);
+    g_timer_start (dragger->frame_timer);
+
+    GdkRectangle viewport;
+    if (!gtk_image_view_get_viewport (dragger->view, &viewport))
+    {
+        dragger->frame_id = 0;
+        return FALSE;
+    }
+
+    int dx = dragger->pending_x;
+    int dy = dragger->pending_y;
+    dragger->pending_x = 0;
+    dragger->pending_y = 0;
+    gboolean pressed = dragger->mouse_handler->pressed;
+    if (!pressed)
+    {
+        gdouble decay = exp (-dt / KINETIC_TIME_CONSTANT);
+        dragger->velocity_x *= decay;
+        dragger->velocity_y *= decay;
+        dragger->remainder_x += dragger->velocity_x * dt;
+        dragger->remainder_y += dragger->velocity_y * dt;
+        int step_x = (int) dragger->remainder_x;
+        int step_y = (int) dragger->remainder_y;
+        dragger->remainder_x -= step_x;
+        dragger->remainder_y -= step_y;
+        dx += step_x;
+        dy += step_y;
+    }
+    if (dx || dy)
+    {
+        gtk_image_view_set_offset (dragger->view,
+                                   viewport.x + dx, viewport.y + dy,
+                                   FALSE);
+        GdkRectangle moved;
+        gtk_image_view_get_viewport (dragger->view, &moved);
+        if (dx && moved.x == viewport.x)
+            dragger->velocity_x = 0.0;
+        if (dy && moved.y == viewport.y)
+            dragger->velocity_y = 0.0;
+        gtk_image_tool_dragger_queue_prefetch (dragger);
+    }
+    if (pressed ||
+        hypot (dragger->velocity_x,
+               dragger->velocity_y) < KINETIC_MIN_VELOCITY)
+    {
+        dragger->velocity_x = 0.0;
+        dragger->velocity_y = 0.0;
+        dragger->frame_id = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+gtk_image_tool_dragger_start_frames (GtkImageToolDragger *dragger)
+{
+    if (dragger->frame_id)
+        return;
+    g_timer_start (dragger->frame_timer);
+    dragger->frame_id = g_timeout_add (KINETIC_FRAME_INTERVAL,
+                                       gtk_image_tool_dragger_frame_cb,
+                                       dragger);
+}
+
+/**
+ * gtk_image_tool_dragger_stop_frames:
+ *
+ * Stops a running fling. A drag distance that has not been scrolled
+ * yet is thrown away.
+ **/
+static void
+gtk_image_tool_dragger_stop_frames (GtkImageToolDragger *dragger)
+{
+    if (dragger->frame_id)
+    {
+        g_source_remove (dragger->frame_id);
+        dragger->frame_id = 0;
+    }
+    dragger->pending_x = 0;
+    dragger->pending_y = 0;
+    dragger->velocity_x = 0.0;
+    dragger->velocity_y = 0.0;
+    dragger->remainder_x = 0.0;
+    dragger->remainder_y = 0.0;
+}
+
 /*************************************************************/
 /***** Implementation of the GtkIImageTool interface *********/
 /*************************************************************/
@@ -90,6 +341,8 @@ button_press (GtkIImageTool  *tool,
     GtkImageToolDragger *dragger = GTK_IMAGE_TOOL_DRAGGER (tool);
     if (!gtk_image_tool_dragger_is_draggable (dragger, ev->x, ev->y))
         return FALSE;
+    if (ev->button == 1)
+        gtk_image_tool_dragger_stop_frames (dragger);
     return mouse_handler_button_press (dragger->mouse_handler, ev);
 }
 
@@ -98,7 +351,18 @@ button_release (GtkIImageTool  *tool,
                 GdkEventButton *ev)
 {
     GtkImageToolDragger *dragger = GTK_IMAGE_TOOL_DRAGGER (tool);
-    return mouse_handler_button_release (dragger->mouse_handler, ev);
+    MouseHandler *mouse_handler = dragger->mouse_handler;
+    if (dragger->kinetic && ev->button == 1 && mouse_handler->dragging &&
+        ev->time - mouse_handler->last_time < KINETIC_RELEASE_DELAY)
+    {
+        gtk_image_tool_dragger_get_velocity (dragger,
+                                             &dragger->velocity_x,
+                                             &dragger->velocity_y);
+        dragger->remainder_x = 0.0;
+        dragger->remainder_y = 0.0;
+        gtk_image_tool_dragger_start_frames (dragger);
+    }
+    return mouse_handler_button_release (mouse_handler, ev);
 }
 
 static gboolean
@@ -117,17 +381,28 @@ motion_notify (GtkIImageTool  *tool,
     if (abs (dx) < 1 && abs (dy) < 1)
         return FALSE;
     
-    GdkRectangle viewport;
-    gtk_image_view_get_viewport (dragger->view, &viewport);
+    if (dragger->kinetic)
+    {
+        /* Scrolled in the next frame. */
+        dragger->pending_x += dx;
+        dragger->pending_y += dy;
+        gtk_image_tool_dragger_start_frames (dragger);
+    }
+    else
+    {
+        GdkRectangle viewport;
+        gtk_image_view_get_viewport (dragger->view, &viewport);
 
-    int offset_x = viewport.x + dx;
-    int offset_y = viewport.y + dy;
+        int offset_x = viewport.x + dx;
+        int offset_y = viewport.y + dy;
 
-    gtk_image_view_set_offset (dragger->view, offset_x, offset_y, FALSE);
+        gtk_image_view_set_offset (dragger->view, offset_x, offset_y, FALSE);
+    }
 
     mouse_handler->drag_base_x = mouse_handler->drag_ofs_x;
     mouse_handler->drag_base_y = mouse_handler->drag_ofs_y;
-    
+
+    gtk_image_tool_dragger_queue_prefetch (dragger);
     return TRUE;
 }
 
@@ -137,7 +412,10 @@ pixbuf_changed (GtkIImageTool *tool,
                 GdkRectangle  *rect)
 {
     GtkImageToolDragger *dragger = GTK_IMAGE_TOOL_DRAGGER (tool);
-    gdk_pixbuf_draw_cache_invalidate (dragger->cache);
+    if (rect)
+        gdk_pixbuf_draw_cache_invalidate_area (dragger->cache, rect);
+    else
+        gdk_pixbuf_draw_cache_invalidate (dragger->cache);
 }
 
 static void
@@ -179,6 +457,10 @@ gtk_image_tool_dragger_finalize (GObject *object)
     gdk_cursor_unref (dragger->open_hand);
     gdk_cursor_unref (dragger->closed_hand);
     g_free (dragger->mouse_handler);
+    if (dragger->prefetch_id)
+        g_source_remove (dragger->prefetch_id);
+    gtk_image_tool_dragger_stop_frames (dragger);
+    g_timer_destroy (dragger->frame_timer);
     gdk_pixbuf_draw_cache_free (dragger->cache);
     
     /* Chain up */
@@ -227,6 +509,19 @@ gtk_image_tool_dragger_init (GtkImageToolDragger *tool)
     tool->mouse_handler = mouse_handler_new (tool->closed_hand);
     tool->view = NULL;
     tool->cache = gdk_pixbuf_draw_cache_new ();
+    tool->prefetch_id = 0;
+    tool->kinetic = FALSE;
+    tool->frame_id = 0;
+    tool->frame_timer = g_timer_new ();
+    tool->pending_x = 0;
+    tool->pending_y = 0;
+    tool->velocity_x = 0.0;
+    tool->velocity_y = 0.0;
+    tool->remainder_x = 0.0;
+    tool->remainder_y = 0.0;
+    gdk_pixbuf_draw_cache_set_ready_func (tool->cache,
+                                          gtk_image_tool_dragger_tile_ready_cb,
+                                          tool);
 }
 
 /**
@@ -246,3 +541,45 @@ gtk_image_tool_dragger_new (GtkImageView *view)
     return GTK_IIMAGE_TOOL (data);
 }
 
+/*************************************************************/
+/***** Read-write properties *********************************/
+/*************************************************************/
+/**
+ * gtk_image_tool_dragger_set_kinetic:
+ * @dragger: a #GtkImageToolDragger
+ * @kinetic: %TRUE to turn kinetic scrolling on
+ *
+ * Sets whether the image should keep moving after it has been
+ * dragged and the mouse button released, as if it had been flung.
+ * The image then slows down until it stops, or until it reaches its
+ * edges or is grabbed again.
+ *
+ * Kinetic scrolling also paces the drag itself. Instead of scrolling
+ * the view for each motion event, the movement is collected and the
+ * view scrolled once per frame, at about 60 frames per second.
+ *
+ * The default is %FALSE.
+ **/
+void
+gtk_image_tool_dragger_set_kinetic (GtkImageToolDragger *dragger,
+                                    gboolean             kinetic)
+{
+    g_return_if_fail (GTK_IS_IMAGE_TOOL_DRAGGER (dragger));
+    dragger->kinetic = kinetic;
+    if (!kinetic && !dragger->mouse_handler->pressed)
+        gtk_image_tool_dragger_stop_frames (dragger);
+}
+
+/**
+ * gtk_image_tool_dragger_get_kinetic:
+ * @dragger: a #GtkImageToolDragger
+ * @returns: %TRUE if kinetic scrolling is on
+ *
+ * Returns whether kinetic scrolling is on.
+ **/
+gboolean
+gtk_image_tool_dragger_get_kinetic (GtkImageToolDragger *dragger)
+{
+    g_return_val_if_fail (GTK_IS_IMAGE_TOOL_DRAGGER (dragger), FALSE);
+    return dragger->kinetic;
+}
@@ -27,6 +27,18 @@ struct _GtkImageToolDragger
     MouseHandler       *mouse_handler;
     GtkImageView       *view;
     GdkPixbufDrawCache *cache;
+    guint               prefetch_id;
+
+    /* Kinetic scrolling. */
+    gboolean            kinetic;
+    guint               frame_id;
+    GTimer             *frame_timer;
+    int                 pending_x;
+    int                 pending_y;
+    gdouble             velocity_x;
+    gdouble             velocity_y;
+    gdouble             remainder_x;
+    gdouble             remainder_y;
 };
 
 struct _GtkImageToolDraggerClass
@@ -39,5 +51,10 @@ GType         gtk_image_tool_dragger_get_type     (void);
 /* Constructors */
 GtkIImageTool *gtk_image_tool_dragger_new   (GtkImageView *view);
 
+/* Read-write properties */
+void          gtk_image_tool_dragger_set_kinetic  (GtkImageToolDragger *dragger,
+                                                   gboolean             kinetic);
+gboolean      gtk_image_tool_dragger_get_kinetic  (GtkImageToolDragger *dragger);
+
 G_END_DECLS
 #endif
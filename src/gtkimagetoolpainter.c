@@ -19,6 +19,7 @@
  */
 #include <math.h>
 #include "gtkimagetoolpainter.h"
+#include "utils.h"
 
 /*************************************************************/
 /***** Static stuff ******************************************/
@@ -34,14 +35,15 @@ gtk_image_view_widget_to_image_rect (GtkImageView *view,
     if (!gtk_image_view_get_draw_rect (view, &draw_rect))
         return FALSE;
 
-    rect_out->x = viewport.x - draw_rect.x + rect_in->x;
-    rect_out->y = viewport.y - draw_rect.y + rect_in->y;
-    gdouble zoom = gtk_image_view_get_zoom (view);
-    rect_out->x = (int) ((gdouble) rect_out->x / zoom);
-    rect_out->y = (int) ((gdouble) rect_out->y / zoom);
-
-    rect_out->width = (int) MAX((gdouble) rect_in->width / zoom, 1);
-    rect_out->height = (int) MAX((gdouble) rect_in->height / zoom, 1);
+    // The image pixels drawn on any part of the widget rectangle.
+    GdkRectangle zoom_rect = {
+        viewport.x - draw_rect.x + rect_in->x,
+        viewport.y - draw_rect.y + rect_in->y,
+        rect_in->width,
+        rect_in->height
+    };
+    gdk_rectangle_unzoom (&zoom_rect, gtk_image_view_get_zoom (view),
+                          rect_out);
 
     // Clip it to the pixbufs area.
     GdkPixbuf *pixbuf = gtk_image_view_get_pixbuf (view);
@@ -76,20 +78,48 @@ gtk_image_tool_painter_paint (GtkImageToolPainter *painter,
         }
 }
 
+/**
+ * gtk_image_tool_painter_paint_line:
+ *
+ * Paints dabs from the widget point @x0, @y0 to @x1, @y1, close
+ * enough to form a continuous stroke. Motion hints only report where
+ * the pointer is now, so a fast stroke would otherwise be painted as
+ * dots. The painted pixels are damaged in one go.
+ **/
 static void
-gtk_image_tool_painter_paint_at (GtkImageToolPainter *painter,
-                                 int                  wx,
-                                 int                  wy)
+gtk_image_tool_painter_paint_line (GtkImageToolPainter *painter,
+                                   int                  x0,
+                                   int                  y0,
+                                   int                  x1,
+                                   int                  y1)
 {
     GtkImageView *view = painter->view;
 
-    GdkRectangle wid_rect = {wx, wy, 4, 4};
-    GdkRectangle image_rect;
-    if (!gtk_image_view_widget_to_image_rect (view, &wid_rect, &image_rect))
-        return;
-
-    gtk_image_tool_painter_paint (painter, &image_rect);
-    gtk_image_view_damage_pixels (view, &image_rect);
+    /* The dabs are 4 pixels wide, so they overlap at every other
+       pixel. */
+    int n_steps = MAX (ABS (x1 - x0), ABS (y1 - y0)) / 2;
+    GdkRectangle damage = {0, 0, 0, 0};
+    for (int n = 0; n <= n_steps; n++)
+    {
+        int wx = x0, wy = y0;
+        if (n_steps)
+        {
+            wx += (x1 - x0) * n / n_steps;
+            wy += (y1 - y0) * n / n_steps;
+        }
+        GdkRectangle wid_rect = {wx, wy, 4, 4};
+        GdkRectangle image_rect;
+        if (!gtk_image_view_widget_to_image_rect (view, &wid_rect,
+                                                  &image_rect))
+            continue;
+        gtk_image_tool_painter_paint (painter, &image_rect);
+        if (damage.width)
+            gdk_rectangle_union (&damage, &image_rect, &damage);
+        else
+            damage = image_rect;
+    }
+    if (damage.width)
+        gtk_image_view_damage_pixels (view, &damage);
 }
 
 /*************************************************************/
@@ -109,10 +139,11 @@ button_press (GtkIImageTool  *tool,
               GdkEventButton *ev)
 {
     GtkImageToolPainter *painter = GTK_IMAGE_TOOL_PAINTER (tool);
-    if (ev->button != 1)
+    // Only pixbufs can be painted on, not image sources.
+    if (ev->button != 1 || !gtk_image_view_get_pixbuf (painter->view))
         return FALSE;
 
-    gtk_image_tool_painter_paint_at (painter, ev->x, ev->y);
+    gtk_image_tool_painter_paint_line (painter, ev->x, ev->y, ev->x, ev->y);
 
     return mouse_handler_button_press (painter->mouse_handler, ev);
 }
@@ -130,11 +161,18 @@ motion_notify (GtkIImageTool  *tool,
                GdkEventMotion *ev)
 {
     GtkImageToolPainter *painter = GTK_IMAGE_TOOL_PAINTER (tool);
-    mouse_handler_motion_notify (painter->mouse_handler, ev);
-    if (!painter->mouse_handler->dragging)
+    MouseHandler *mouse_handler = painter->mouse_handler;
+    int x0 = mouse_handler->drag_ofs_x;
+    int y0 = mouse_handler->drag_ofs_y;
+    mouse_handler_motion_notify (mouse_handler, ev);
+    if (!mouse_handler->dragging)
         return FALSE;
 
-    gtk_image_tool_painter_paint_at (painter, ev->x, ev->y);
+    /* For a motion hint, the stroke goes to where the pointer is and
+       not to where the event was. */
+    gtk_image_tool_painter_paint_line (painter, x0, y0,
+                                       mouse_handler->drag_ofs_x,
+                                       mouse_handler->drag_ofs_y);
 
     return FALSE;
 }
@@ -145,7 +183,10 @@ pixbuf_changed (GtkIImageTool *tool,
                 GdkRectangle  *rect)
 {
     GtkImageToolPainter *painter = GTK_IMAGE_TOOL_PAINTER (tool);
-    gdk_pixbuf_draw_cache_invalidate (painter->cache);
+    if (rect)
+        gdk_pixbuf_draw_cache_invalidate_area (painter->cache, rect);
+    else
+        gdk_pixbuf_draw_cache_invalidate (painter->cache);
 }
 
 static void
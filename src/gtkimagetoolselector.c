@@ -88,11 +88,18 @@
  *     is no way to solve this bug on GtkImageView's level (but if
  *     someone knows how, I'd really like to know).
  *   </para>  
+ *   <para>
+ *     The error is bounded though. gdk_pixbuf_get_scale_margin()
+ *     computes how far from their exact place the pixels may be
+ *     drawn, which GtkImageView uses to redraw just the pixels that
+ *     changed when a part of the pixbuf is damaged.
+ *   </para>
  * </refsect2>
  **/ 
 
 #include <stdlib.h>
 #include "cursors.h"
+#include "gdkpixbufmemory.h"
 #include "gtkimagetoolselector.h"
 
 #define MIN_AUTOSCROLL      6
@@ -396,7 +403,7 @@ button_press (GtkIImageTool  *tool,
               GdkEventButton *ev)
 {
     GtkImageToolSelector *selector = GTK_IMAGE_TOOL_SELECTOR (tool);
-    if (ev->button != 1)
+    if (ev->button != 1 || !gtk_image_view_get_pixbuf (selector->view))
         return FALSE;
 
     selector->hotspot_type =
@@ -474,15 +481,19 @@ motion_notify (GtkIImageTool  *tool,
                GdkEventMotion *ev)
 {
     GtkImageToolSelector *selector = GTK_IMAGE_TOOL_SELECTOR (tool);
-    mouse_handler_motion_notify (selector->mouse_handler, ev);
-    if (!selector->mouse_handler->dragging)
+    MouseHandler *mouse_handler = selector->mouse_handler;
+    mouse_handler_motion_notify (mouse_handler, ev);
+    if (!mouse_handler->dragging)
         return FALSE;
     
     gtk_image_tool_selector_update_selection (selector);
 
-    /* Check if, and how much the view should be autoscrolled. */
+    /* Check if, and how much the view should be autoscrolled. For a
+       motion hint, the position is the pointer's and not the
+       event's. */
     gtk_image_tool_selector_calc_autoscroll (selector,
-                                             ev->x, ev->y,
+                                             mouse_handler->drag_ofs_x,
+                                             mouse_handler->drag_ofs_y,
                                              &selector->outside_x,
                                              &selector->outside_y);
     if (selector->outside_x || selector->outside_y)
@@ -498,6 +509,46 @@ motion_notify (GtkIImageTool  *tool,
     return TRUE;
 }
 
+/**
+ * gtk_image_tool_selector_new_background:
+ *
+ * Replaces the background with a shaded copy of @pixbuf.
+ **/
+static void
+gtk_image_tool_selector_new_background (GtkImageToolSelector *selector,
+                                        GdkPixbuf            *pixbuf)
+{
+    if (selector->background)
+        g_object_unref (selector->background);
+    selector->background = gdk_pixbuf_copy (pixbuf);
+    gdk_pixbuf_shade (selector->background, NULL);
+    gdk_pixbuf_memory_track_pixbuf (selector->background,
+                                    GDK_PIXBUF_MEMORY_SELECTIONS);
+}
+
+/**
+ * gtk_image_tool_selector_shrink_cb:
+ *
+ * Frees the background when memory is short, unless it has been
+ * painted since the last time the selector was asked to. It is
+ * created again when it is next painted.
+ **/
+static void
+gtk_image_tool_selector_shrink_cb (gpointer data)
+{
+    GtkImageToolSelector *selector = data;
+    if (selector->background_used)
+    {
+        selector->background_used = FALSE;
+        return;
+    }
+    if (!selector->background)
+        return;
+    g_object_unref (selector->background);
+    selector->background = NULL;
+    gdk_pixbuf_draw_cache_invalidate (selector->bg_cache);
+}
+
 static void
 pixbuf_changed (GtkIImageTool *tool,
                 gboolean       reset_fit,
@@ -511,24 +562,19 @@ pixbuf_changed (GtkIImageTool *tool,
     if (!pixbuf)
         return;
 
-    if (rect)
+    if (rect && selector->background)
     {
         // Copy the damaged area from the foreground to the
-        // background.
+        // background and shade it.
         gdk_pixbuf_copy_area (pixbuf,
                               rect->x, rect->y,
                               rect->width, rect->height,
                               selector->background,
                               rect->x, rect->y);
+        gdk_pixbuf_shade (selector->background, rect);
     }
     else
-    {
-        if (selector->background)
-            g_object_unref (selector->background);
-        selector->background = gdk_pixbuf_copy (pixbuf);
-    }
-    // Update the relevant area of the background.
-    gdk_pixbuf_shade (selector->background, rect);
+        gtk_image_tool_selector_new_background (selector, pixbuf);
 
     // Clear caches
     gdk_pixbuf_draw_cache_invalidate (selector->bg_cache);
@@ -542,9 +588,24 @@ paint_image (GtkIImageTool     *tool,
 {
     GtkImageToolSelector *selector = GTK_IMAGE_TOOL_SELECTOR (tool);
 
-    // Draw the shaded background.
+    // Image sources are too large to keep a shaded copy of, so they
+    // are drawn without a selection.
+    if (opts->source)
+    {
+        gdk_pixbuf_draw_cache_draw (selector->fg_cache, opts, drawable);
+        return;
+    }
+
+    // Draw the shaded background, which may have been freed to save
+    // memory.
+    if (!selector->background)
+        gtk_image_tool_selector_new_background (selector, opts->pixbuf);
+    selector->background_used = TRUE;
     GdkPixbufDrawOpts bg_opts = *opts;
     bg_opts.pixbuf = selector->background;
+    // The shaded background is private to the selector so there is
+    // no one to share its tiles with.
+    bg_opts.shared = FALSE;
     gdk_pixbuf_draw_cache_draw (selector->bg_cache, &bg_opts, drawable);
 
     // Draw the selected area.
@@ -615,6 +676,8 @@ static void
 gtk_image_tool_selector_finalize (GObject *object)
 {
     GtkImageToolSelector *selector = GTK_IMAGE_TOOL_SELECTOR (object);
+    gdk_pixbuf_memory_remove_shrinker (gtk_image_tool_selector_shrink_cb,
+                                       selector);
     if (selector->background)
         g_object_unref (selector->background);
     gdk_pixbuf_draw_cache_free (selector->bg_cache);
@@ -715,6 +778,7 @@ static void
 gtk_image_tool_selector_init (GtkImageToolSelector *tool)
 {
     tool->background = NULL;
+    tool->background_used = FALSE;
     tool->view = NULL;
     tool->sel_rect = (GdkRectangle){0, 0, 0, 0};
     tool->bg_cache = gdk_pixbuf_draw_cache_new ();
@@ -726,6 +790,9 @@ gtk_image_tool_selector_init (GtkImageToolSelector *tool)
 
     // Init hotspots cursors.
     hotspot_list_init (tool->hotspots);
+
+    gdk_pixbuf_memory_add_shrinker (GDK_PIXBUF_MEMORY_SELECTIONS,
+                                    gtk_image_tool_selector_shrink_cb, tool);
 }
 
 /**
@@ -51,6 +51,10 @@ struct _GtkImageToolSelector
     /* A darkened version of the views pixbuf. */
     GdkPixbuf          *background;
 
+    /* Whether the background has been painted since the selector was
+       last asked to free it because memory is short. */
+    gboolean            background_used;
+
     /* Currently selected rectangle in image space coordinates. */
     GdkRectangle        sel_rect;
 
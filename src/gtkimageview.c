@@ -126,6 +126,15 @@
  *         </tr>  
  *       </tbody>
  *   </table>
+ *   <para>
+ *     The window of the view asks for motion hints
+ *     (%GDK_POINTER_MOTION_HINT_MASK), so that motion does not pile
+ *     up while the view is redrawn. Handlers connected to
+ *     #GtkWidget::motion-notify-event therefore get one event with
+ *     <structfield>is_hint</structfield> set for each time the
+ *     pointer has moved, and must call gdk_window_get_pointer() both
+ *     to get where the pointer is now and to receive the next one.
+ *   </para>
  * </refsect2>
  * <refsect2>
  *   <title>Coordinate systems</title>
@@ -213,6 +222,31 @@
  *     </programlisting>
  *   </informalexample>
  * </refsect2>
+ * <refsect2>
+ *   <title>Images larger than memory</title>
+ *   <para>
+ *     Images too large to decode into a #GdkPixbuf, such as
+ *     multi-gigabyte scans, can be shown with
+ *     gtk_image_view_set_source() instead. The view then reads only
+ *     the tiles it draws from the #GtkIImageSource, at the
+ *     resolution it draws them at, so the memory used is bounded by
+ *     the size of the view and of its tile cache:
+ *   </para>
+ *   <informalexample>
+ *     <programlisting>
+ *       GtkIImageSource *source =
+ *           gtk_image_source_mapped_new ("scan.ppm", NULL);
+ *       gtk_image_view_set_source (GTK_IMAGE_VIEW (view), source, TRUE);
+ *       g_object_unref (source);
+ *     </programlisting>
+ *   </informalexample>
+ *   <para>
+ *     The pixels of a source cannot be changed, so there is nothing
+ *     to damage, and the tools that edit or shade the pixbuf, such as
+ *     #GtkImageToolPainter and #GtkImageToolSelector, only show the
+ *     image.
+ *   </para>
+ * </refsect2>
  * <refsect1>
  *   <title>Example</title>
  *   <para>
@@ -262,6 +296,7 @@
 #include <gdk/gdkkeysyms.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "cursors.h"
 #include "gtkimagetooldragger.h"
@@ -280,6 +315,29 @@
     g_signal_handlers_unblock_matched ((instance), G_SIGNAL_MATCH_DATA, \
                                        0, 0, NULL, NULL, (data))
 
+/* Exposed rectangles are painted as one when that paints at most this
+   many extra pixels. */
+#define EXPOSE_MERGE_SLACK      (64 * 64)
+
+/* Regions with more rectangles than this are painted as a whole. */
+#define EXPOSE_MAX_RECTS        16
+
+/* Milliseconds between redraws of damaged pixels. */
+#define DAMAGE_FRAME_INTERVAL   16
+
+/* Milliseconds between the frames of a zoom animation, and seconds
+   painting one frame may take before the animation skips to its
+   end. */
+#define ZOOM_FRAME_INTERVAL     16
+#define ZOOM_FRAME_BUDGET       0.012
+
+/* Factor one notch of the mouse wheel zooms by in continuous zoom
+   mode, and milliseconds the zoom must have been left alone, by the
+   wheel or by resizing a fitting view, before the image is drawn at
+   full quality. */
+#define ZOOM_WHEEL_FACTOR       1.1
+#define ZOOM_SETTLE_DELAY       150
+
 /*************************************************************/
 /***** Private data ******************************************/
 /*************************************************************/
@@ -319,10 +377,26 @@ gtk_image_view_get_bg_argb (GtkImageView *view)
     return base;
 }
     
+/**
+ * gtk_image_view_has_image:
+ *
+ * Returns whether the view shows a pixbuf or an image source.
+ **/
+static gboolean
+gtk_image_view_has_image (GtkImageView *view)
+{
+    return view->pixbuf || view->source;
+}
+
 static Size
 gtk_image_view_get_pixbuf_size (GtkImageView *view)
 {
     Size s = {0, 0};
+    if (view->source)
+    {
+        gtk_iimage_source_get_size (view->source, &s.width, &s.height);
+        return s;
+    }
     if (!view->pixbuf)
         return s;
     
@@ -416,8 +490,8 @@ gtk_image_view_update_adjustments (GtkImageView *view)
 }
 
 /**
- * This method must only be used by gtk_image_view_zoom_to_fit () and
- * gtk_image_view_set_zoom ().
+ * This method must only be used by gtk_image_view_zoom_to_fit (),
+ * gtk_image_view_set_zoom () and the zoom animation.
  **/
 static void
 gtk_image_view_set_zoom_with_center (GtkImageView *view,
@@ -436,6 +510,7 @@ gtk_image_view_set_zoom_with_center (GtkImageView *view,
     offset_y = (int) round ((gdouble) ((gdouble)view->offset_y + center_y) * zoom_ratio -
                             (gdouble) alloc.height / 2.0);
     view->zoom = zoom;
+    view->generation++;
 
     gtk_image_view_clamp_offset (view, &offset_x, &offset_y);
 
@@ -490,6 +565,140 @@ gtk_image_view_zoom_to_fit (GtkImageView *view,
     gtk_image_view_set_zoom_no_center (view, zoom, is_allocating);
 }
 
+/**
+ * gtk_image_view_finish_zoom_animation:
+ *
+ * Stops the running zoom animation, if any, and sets the zoom it was
+ * heading for right away.
+ **/
+static void
+gtk_image_view_finish_zoom_animation (GtkImageView *view)
+{
+    if (!view->zoom_anim_id)
+        return;
+    g_source_remove (view->zoom_anim_id);
+    view->zoom_anim_id = 0;
+    gtk_image_view_set_zoom_with_center (view, view->zoom_to,
+                                         view->zoom_center_x,
+                                         view->zoom_center_y,
+                                         FALSE);
+}
+
+/**
+ * gtk_image_view_get_target_zoom:
+ *
+ * Returns the zoom the view is animating towards, or the current zoom
+ * if it is not animating.
+ **/
+static gdouble
+gtk_image_view_get_target_zoom (GtkImageView *view)
+{
+    return view->zoom_anim_id ? view->zoom_to : view->zoom;
+}
+
+/**
+ * gtk_image_view_zoom_frame_cb:
+ *
+ * Moves the zoom of a running zoom animation to where it should be
+ * by now. The zoom is interpolated in log space, where zooming looks
+ * uniform, and eases out towards the end. The animation jumps to its
+ * last frame if painting a frame takes longer than the budget, as it
+ * could not look smooth anyway.
+ **/
+static gboolean
+gtk_image_view_zoom_frame_cb (gpointer data)
+{
+    GtkImageView *view = GTK_IMAGE_VIEW (data);
+    gdouble elapsed = g_timer_elapsed (view->zoom_timer, NULL) * 1000.0;
+    gdouble t = elapsed / view->zoom_duration;
+
+    gdouble zoom = view->zoom_to;
+    gboolean done = t >= 1.0 || view->zoom_frame_time > ZOOM_FRAME_BUDGET;
+    if (done)
+        view->zoom_anim_id = 0;
+    else
+    {
+        t = 1.0 - (1.0 - t) * (1.0 - t);
+        zoom = view->zoom_from * pow (view->zoom_to / view->zoom_from, t);
+    }
+    view->zoom_frame_time = 0.0;
+    gtk_image_view_set_zoom_with_center (view, zoom,
+                                         view->zoom_center_x,
+                                         view->zoom_center_y,
+                                         FALSE);
+    return !done;
+}
+
+/**
+ * gtk_image_view_settle_cb:
+ *
+ * Redraws the view at full quality once the zoom has stopped
+ * changing in continuous zoom mode.
+ **/
+static gboolean
+gtk_image_view_settle_cb (gpointer data)
+{
+    GtkImageView *view = GTK_IMAGE_VIEW (data);
+    view->settle_id = 0;
+    gtk_widget_queue_draw (GTK_WIDGET (view));
+    return FALSE;
+}
+
+/**
+ * gtk_image_view_queue_settle:
+ *
+ * Makes the view draw previews until the zoom has not been changed
+ * for the settle delay. Zooming continuously, or resizing a view
+ * that fits its image, therefore only rescales the image at full
+ * quality once, when the user stops.
+ **/
+static void
+gtk_image_view_queue_settle (GtkImageView *view)
+{
+    if (view->settle_id)
+        g_source_remove (view->settle_id);
+    view->settle_id = g_timeout_add (ZOOM_SETTLE_DELAY,
+                                     gtk_image_view_settle_cb, view);
+}
+
+/**
+ * gtk_image_view_animate_zoom:
+ *
+ * Zooms the view to @zoom keeping the widget point @center_x,
+ * @center_y in place, animated over the zoom duration if one is set.
+ **/
+static void
+gtk_image_view_animate_zoom (GtkImageView *view,
+                             gdouble       zoom,
+                             gdouble       center_x,
+                             gdouble       center_y)
+{
+    if (view->zoom_anim_id)
+    {
+        g_source_remove (view->zoom_anim_id);
+        view->zoom_anim_id = 0;
+    }
+    if (!view->zoom_duration || !gtk_image_view_has_image (view) ||
+        zoom == view->zoom)
+    {
+        if (view->continuous_zoom && gtk_image_view_has_image (view) &&
+            zoom != view->zoom)
+            gtk_image_view_queue_settle (view);
+        gtk_image_view_set_zoom_with_center (view, zoom,
+                                             center_x, center_y, FALSE);
+        return;
+    }
+    view->fitting = FALSE;
+    view->zoom_from = view->zoom;
+    view->zoom_to = zoom;
+    view->zoom_center_x = center_x;
+    view->zoom_center_y = center_y;
+    view->zoom_frame_time = 0.0;
+    g_timer_start (view->zoom_timer);
+    view->zoom_anim_id = g_timeout_add (ZOOM_FRAME_INTERVAL,
+                                        gtk_image_view_zoom_frame_cb, view);
+}
+
 static void
 gtk_image_view_draw_background (GtkImageView *view,
                                 GdkRectangle *image_area,
@@ -515,6 +724,53 @@ gtk_image_view_draw_background (GtkImageView *view,
     }
 }
 
+static gboolean gtk_image_view_refine_cb (gpointer data);
+
+/**
+ * gtk_image_view_cancel_refine:
+ *
+ * Removes the pending high quality refinement of the view, if any.
+ **/
+static void
+gtk_image_view_cancel_refine (GtkImageView *view)
+{
+    if (view->refine_id)
+    {
+        g_source_remove (view->refine_id);
+        view->refine_id = 0;
+    }
+}
+
+/**
+ * gtk_image_view_queue_refine:
+ *
+ * Schedules a repaint of the whole view with the configured
+ * interpolation after the refine delay has elapsed. A refinement
+ * already scheduled is cancelled so that it only runs once the view
+ * has not been repainted for the whole delay.
+ **/
+static void
+gtk_image_view_queue_refine (GtkImageView *view)
+{
+    gtk_image_view_cancel_refine (view);
+    view->refine_id = g_timeout_add (view->refine_delay,
+                                     gtk_image_view_refine_cb, view);
+}
+
+/**
+ * gtk_image_view_pyramid_ready_cb:
+ *
+ * Called when pyramid levels have been built on a worker thread.
+ * Until then the image was painted from a larger level, so the whole
+ * view is painted again.
+ **/
+static void
+gtk_image_view_pyramid_ready_cb (GdkPixbufPyramid *pyramid,
+                                 gpointer          data)
+{
+    gtk_widget_queue_draw (GTK_WIDGET (data));
+}
+
 /**
  * gtk_image_view_repaint_area:
  * @paint_rect: The rectangle on the widget that needs to be redrawn.
@@ -546,7 +802,7 @@ gtk_image_view_repaint_area (GtkImageView *view,
         gtk_image_view_draw_background (view, &image_area, alloc);
     }
     GtkWidget *widget = GTK_WIDGET (view);
-    if (view->show_frame && view->pixbuf)
+    if (view->show_frame && gtk_image_view_has_image (view))
     {
         GdkGC *light_gc = widget->style->light_gc[GTK_STATE_NORMAL];
         GdkGC *dark_gc = widget->style->dark_gc[GTK_STATE_NORMAL];
@@ -559,12 +815,28 @@ gtk_image_view_repaint_area (GtkImageView *view,
     gboolean intersects = gdk_rectangle_intersect (&image_area,
                                                    paint_rect,
                                                    &paint_area);
-    if (intersects && view->pixbuf)
+    if (intersects && gtk_image_view_has_image (view))
     {
         GdkInterpType interp = view->interp;
-        if (view->zoom == 1.0)
+        gboolean preview = view->zoom_anim_id || view->settle_id;
+        if (view->zoom == 1.0 || preview)
             interp = GDK_INTERP_NEAREST;
 
+        /* In progressive mode, tiles that are not cached are painted
+           quickly now and refined later. */
+        gboolean progressive = view->refine_delay && !view->is_refining;
+
+        /* Zoomed out images are scaled from the image pyramid. Image
+           sources have levels of their own. */
+        if (view->use_pyramid && !view->pyramid && view->pixbuf &&
+            view->zoom <= 0.5)
+        {
+            view->pyramid = gdk_pixbuf_pyramid_new (view->pixbuf);
+            gdk_pixbuf_pyramid_set_ready_func (view->pyramid,
+                                               gtk_image_view_pyramid_ready_cb,
+                                               view);
+        }
+
         int src_x = view->offset_x + paint_area.x - image_area.x; 
         int src_y = view->offset_y + paint_area.y - image_area.y; 
 
@@ -576,106 +848,66 @@ gtk_image_view_repaint_area (GtkImageView *view,
             interp,
             view->pixbuf,
             view->check_color1,
-            view->check_color2
+            view->check_color2,
+            view->n_threads,
+            view->async,
+            view->generation,
+            view->use_pyramid ? view->pyramid : NULL,
+            &view->stats,
+            preview,
+            view->shared_tiles,
+            progressive,
+            view->source
         };
+        guint n_incomplete = view->stats.n_incomplete;
         gtk_iimage_tool_paint_image (view->tool, &opts, widget->window);
+        if (progressive && view->stats.n_incomplete != n_incomplete)
+            gtk_image_view_queue_refine (view);
     }
 
     view->is_rendering = FALSE;
     return TRUE;
 }
 
+/**
+ * gtk_image_view_refine_cb:
+ *
+ * Queues a repaint of the view with the configured interpolation
+ * once input has been quiet for the refine delay. The next expose
+ * scales the tiles that were painted quickly.
+ **/
+static gboolean
+gtk_image_view_refine_cb (gpointer data)
+{
+    GtkImageView *view = GTK_IMAGE_VIEW (data);
+    view->refine_id = 0;
+    view->is_refining = TRUE;
+    gtk_widget_queue_draw (GTK_WIDGET (view));
+    return FALSE;
+}
+
 /**
  * gtk_image_view_fast_scroll:
  *
- * Actually scroll the views window using gdk_draw_drawable().
+ * Actually scroll the views window using gdk_window_scroll() and
+ * repaint the strips of the image that became visible right away.
  * GTK_WIDGET (view)->window is guaranteed to be non-NULL in this
  * function.
+ *
+ * The pixels are copied by the server without waiting for it. X11
+ * does not remember how the parts of a window beneath other windows
+ * look, so they can not be copied. GDK invalidates them when the
+ * server reports them and they are repainted from the normal expose
+ * queue, so the image is not left corrupted when windows overlap it.
  **/
 static void
 gtk_image_view_fast_scroll (GtkImageView *view,
                             int           delta_x,
                             int           delta_y)
 {
-    GdkDrawable *drawable = GTK_WIDGET (view)->window;
-    
-    int src_x, src_y;
-    int dest_x, dest_y;
-    if (delta_x < 0)
-    {
-        src_x = 0;
-        dest_x = -delta_x;
-    }
-    else
-    {
-        src_x = delta_x;
-        dest_x = 0;
-    }
-    if (delta_y < 0)
-    {
-        src_y = 0;
-        dest_y = -delta_y;
-    }
-    else
-    {
-        src_y = delta_y;
-        dest_y = 0;
-    }
-
-    /* First move the part of the image that did not become hidden or
-       shown by this operation. gdk_draw_drawable is probably very
-       fast because it does not involve sending any data to the X11
-       server.
-
-       Remember that X11 is weird shit. It does not remember how
-       windows beneath other windows look like. So if another window
-       overlaps this window, it will temporarily look corrupted. We
-       fix that later by turning on "exposures." See below. */
-    
-    GdkGC *gc = gdk_gc_new (drawable);
-    Size alloc = gtk_image_view_get_allocated_size (view);
-
-    gdk_gc_set_exposures (gc, TRUE);
-    gdk_draw_drawable (drawable,
-                       gc,
-                       drawable,
-                       src_x, src_y,
-                       dest_x, dest_y,
-                       alloc.width - abs (delta_x),
-                       alloc.height - abs (delta_y));
-    g_object_unref (gc);
-
-    /* If we moved in both the x and y directions, two "strips" of the
-      image becomes visible. One horizontal strip and one vertical
-      strip. */
-    GdkRectangle horiz_strip = {
-        0,
-        (delta_y < 0) ? 0 : alloc.height - abs (delta_y),
-        alloc.width,
-        abs (delta_y)
-    };
-    gtk_image_view_repaint_area (view, &horiz_strip);
-
-    GdkRectangle vert_strip = {
-        (delta_x < 0) ? 0 : alloc.width - abs (delta_x),
-        0,
-        abs (delta_x),
-        alloc.height
-    };
-    gtk_image_view_repaint_area (view, &vert_strip);
-
-    // Here is where we fix the weirdness mentioned above. I do not
-    // really know why it works, but it does!
-    GdkEvent *ev;
-    while ((ev = gdk_event_get_graphics_expose (drawable)) != NULL)
-    {
-        GdkEventExpose *expose = (GdkEventExpose *)ev;
-        int exp_count = expose->count;
-        gtk_image_view_repaint_area (view, &expose->area);
-        gdk_event_free (ev);
-        if (exp_count == 0)
-            break;
-    }
+    GdkWindow *window = GTK_WIDGET (view)->window;
+    gdk_window_scroll (window, -delta_x, -delta_y);
+    gdk_window_process_updates (window, FALSE);
 }
 
 /**
@@ -710,6 +942,7 @@ gtk_image_view_scroll_to (GtkImageView *view,
 
     view->offset_x = offset_x;
     view->offset_y = offset_y;
+    view->generation++;
     gtk_image_view_update_cursor (view);
 
     if (GTK_WIDGET (view)->window)
@@ -780,12 +1013,17 @@ gtk_image_view_realize (GtkWidget *widget)
     attrs.wclass = GDK_INPUT_OUTPUT;
     attrs.visual = gtk_widget_get_visual (widget);
     attrs.colormap = gtk_widget_get_colormap (widget);
+    /* With motion hints, the server reports one motion event and then
+       waits until the pointer is queried before it reports the
+       next. A fast mouse then cannot queue up motion while the view
+       is being redrawn. */
     attrs.event_mask = (gtk_widget_get_events (widget)
                         | GDK_EXPOSURE_MASK
                         | GDK_BUTTON_MOTION_MASK
                         | GDK_BUTTON_PRESS_MASK
                         | GDK_BUTTON_RELEASE_MASK
-                        | GDK_POINTER_MOTION_MASK);
+                        | GDK_POINTER_MOTION_MASK
+                        | GDK_POINTER_MOTION_HINT_MASK);
                         
     int attr_mask = (GDK_WA_X | GDK_WA_Y | GDK_WA_VISUAL | GDK_WA_COLORMAP);
     GdkWindow *parent = gtk_widget_get_parent_window (widget);
@@ -804,19 +1042,38 @@ static void
 gtk_image_view_unrealize (GtkWidget *widget)
 {
     GtkImageView *view = GTK_IMAGE_VIEW (widget);
+    gtk_image_view_cancel_refine (view);
     gdk_cursor_unref (view->void_cursor);
     GTK_WIDGET_CLASS (gtk_image_view_parent_class)->unrealize (widget);
 }
 
+/**
+ * gtk_image_view_size_allocate:
+ *
+ * Fits the image to the new size if the view is fitting. While the
+ * window is resized interactively, allocations arrive about as fast
+ * as frames and each one changes the zoom. The view then draws
+ * previews, stretched from the last frame or a pyramid level, and
+ * only scales the image at full quality once the size has settled.
+ **/
 static void
 gtk_image_view_size_allocate (GtkWidget     *widget,
                               GtkAllocation *alloc)
 {
     GtkImageView *view = GTK_IMAGE_VIEW (widget);
+    gboolean resized = (alloc->width != widget->allocation.width ||
+                        alloc->height != widget->allocation.height);
     widget->allocation = *alloc;
 
-    if (view->pixbuf && view->fitting)
+    if (gtk_image_view_has_image (view) && view->fitting)
+    {
+        /* Only a resize settles. Fitting a new pixbuf into the same
+           allocation draws at full quality right away. */
+        gdouble zoom = view->zoom;
         gtk_image_view_zoom_to_fit (view, TRUE);
+        if (widget->window && resized && view->zoom != zoom)
+            gtk_image_view_queue_settle (view);
+    }
 
     gtk_image_view_clamp_offset (view, &view->offset_x, &view->offset_y);
 
@@ -842,11 +1099,64 @@ gtk_image_view_style_set (GtkWidget *widget,
     view->check_color2 = argb;
 }
 
+/**
+ * gtk_image_view_expose:
+ *
+ * Repaints the rectangles of the exposed region instead of its
+ * bounding box, so that for example uncovering two corners of the
+ * view does not repaint all of it. Rectangles that lie close together
+ * are merged first, and regions made of very many rectangles are
+ * repainted as a whole.
+ **/
 static int
 gtk_image_view_expose (GtkWidget      *widget,
                        GdkEventExpose *ev)
 {
-    return gtk_image_view_repaint_area (GTK_IMAGE_VIEW (widget), &ev->area);
+    GtkImageView *view = GTK_IMAGE_VIEW (widget);
+    GdkRectangle *rects = NULL;
+    int n_rects = 0;
+    /* Synthesized expose events may lack a region, in which case
+       their whole area is repainted. */
+    if (ev->region)
+        gdk_region_get_rectangles (ev->region, &rects, &n_rects);
+    if (n_rects > 1 && n_rects <= EXPOSE_MAX_RECTS)
+        n_rects = gdk_rectangles_merge (rects, n_rects, EXPOSE_MERGE_SLACK);
+
+    /* The statistics count each expose once, however many rectangles
+       it is painted in. */
+    g_timer_start (view->expose_timer);
+    int retval = TRUE;
+    gboolean painted = FALSE;
+    if (n_rects <= 1 || n_rects > EXPOSE_MAX_RECTS)
+        retval = painted = gtk_image_view_repaint_area (view, &ev->area);
+    else
+    {
+        gint64 saved = (gint64) ev->area.width * ev->area.height;
+        for (int n = 0; n < n_rects; n++)
+        {
+            if (gtk_image_view_repaint_area (view, &rects[n]))
+                painted = TRUE;
+            saved -= (gint64) rects[n].width * rects[n].height;
+        }
+        if (saved > 0)
+            view->stats.n_pixels_saved += saved;
+    }
+    g_free (rects);
+
+    if (painted)
+    {
+        gdouble elapsed = g_timer_elapsed (view->expose_timer, NULL);
+        view->stats.n_exposes++;
+        view->stats.expose_time += elapsed;
+        view->stats.max_expose_time = MAX (view->stats.max_expose_time,
+                                           elapsed);
+        if (view->zoom_anim_id)
+            view->zoom_frame_time += elapsed;
+    }
+
+    /* A queued refinement is done once the view has been repainted. */
+    view->is_refining = FALSE;
+    return retval;
 }
 
 static int
@@ -871,7 +1181,13 @@ gtk_image_view_motion_notify (GtkWidget      *widget,
 {
     GtkImageView *view = GTK_IMAGE_VIEW (widget);
     if (view->is_rendering)
+    {
+        /* Ask for the next motion hint even though this one is
+           dropped. */
+        if (ev->is_hint)
+            gdk_window_get_pointer (ev->window, NULL, NULL, NULL);
         return FALSE;
+    }
     gtk_image_view_update_cursor (view);
     return gtk_iimage_tool_motion_notify (view->tool, ev);
 }
@@ -911,10 +1227,17 @@ gtk_image_view_scroll_event (GtkWidget      *widget,
     // Horizontal scroll left is equivalent to scroll up and right is
     // like scroll down. No idea if that is correct -- I have no input
     // device that can do horizontal scrolls.
-    gdouble zoom = gtk_zooms_get_zoom_out (view->zoom);
-    if (ev->direction == GDK_SCROLL_UP || ev->direction == GDK_SCROLL_LEFT)
-        zoom = gtk_zooms_get_zoom_in (view->zoom);
-    gtk_image_view_set_zoom_with_center (view, zoom, ev->x, ev->y, FALSE);
+    gboolean in = (ev->direction == GDK_SCROLL_UP ||
+                   ev->direction == GDK_SCROLL_LEFT);
+    gdouble zoom = gtk_image_view_get_target_zoom (view);
+    if (view->continuous_zoom)
+        zoom = gtk_zooms_clamp_zoom (in ? zoom * ZOOM_WHEEL_FACTOR
+                                     : zoom / ZOOM_WHEEL_FACTOR);
+    else if (in)
+        zoom = gtk_zooms_get_zoom_in (zoom);
+    else
+        zoom = gtk_zooms_get_zoom_out (zoom);
+    gtk_image_view_animate_zoom (view, zoom, ev->x, ev->y);
     
     return TRUE;
 }
@@ -950,6 +1273,85 @@ gtk_image_view_set_scroll_adjustments (GtkImageView  *view,
     }
 }
 
+/**
+ * gtk_image_view_drop_damage:
+ *
+ * Forgets the damage that has not been handled yet.
+ **/
+static void
+gtk_image_view_drop_damage (GtkImageView *view)
+{
+    if (view->damage_id)
+    {
+        g_source_remove (view->damage_id);
+        view->damage_id = 0;
+    }
+    view->damage = (GdkRectangle){0, 0, 0, 0};
+    view->damage_all = FALSE;
+}
+
+/**
+ * gtk_image_view_damage_flush_cb:
+ *
+ * Draws the damage accumulated since the last frame.
+ **/
+static gboolean
+gtk_image_view_damage_flush_cb (gpointer data)
+{
+    GtkImageView *view = GTK_IMAGE_VIEW (data);
+    view->damage_id = 0;
+    gtk_image_view_flush_damage (view);
+    return FALSE;
+}
+
+/**
+ * gtk_image_view_unbind_loader:
+ *
+ * Disconnects the view from its loader.
+ **/
+static void
+gtk_image_view_unbind_loader (GtkImageView *view)
+{
+    if (view->loader)
+    {
+        g_signal_handlers_disconnect_by_data (G_OBJECT (view->loader), view);
+        g_object_unref (view->loader);
+        view->loader = NULL;
+    }
+}
+
+static void
+gtk_image_view_loader_area_prepared_cb (GdkPixbufLoader *loader,
+                                        GtkImageView    *view)
+{
+    gtk_image_view_set_pixbuf (view,
+                               gdk_pixbuf_loader_get_pixbuf (loader),
+                               TRUE);
+}
+
+static void
+gtk_image_view_loader_area_updated_cb (GdkPixbufLoader *loader,
+                                       int              x,
+                                       int              y,
+                                       int              width,
+                                       int              height,
+                                       GtkImageView    *view)
+{
+    /* The pixbuf may have been replaced by the user. */
+    if (view->pixbuf != gdk_pixbuf_loader_get_pixbuf (loader))
+        return;
+    gtk_image_view_damage_pixels (view,
+                                  &(GdkRectangle){x, y, width, height});
+}
+
+static void
+gtk_image_view_loader_closed_cb (GdkPixbufLoader *loader,
+                                 GtkImageView    *view)
+{
+    gtk_image_view_flush_damage (view);
+    gtk_image_view_unbind_loader (view);
+}
+
 
 /*************************************************************/
 /***** Stuff that deals with the type ************************/
@@ -963,6 +1365,7 @@ gtk_image_view_init (GtkImageView *view)
     view->black_bg = FALSE;
     view->fitting = TRUE;
     view->pixbuf = NULL;
+    view->source = NULL;
     view->zoom = 1.0;
     view->offset_x = 0;
     view->offset_y = 0;
@@ -975,6 +1378,26 @@ gtk_image_view_init (GtkImageView *view)
     view->check_color1 = 0x666666;
     view->check_color2 = 0x999999;
     view->transp = GTK_IMAGE_TRANSP_GRID;
+    view->n_threads = 1;
+    view->refine_delay = 0;
+    view->refine_id = 0;
+    view->is_refining = FALSE;
+    view->zoom_duration = 0;
+    view->zoom_anim_id = 0;
+    view->zoom_timer = g_timer_new ();
+    view->continuous_zoom = FALSE;
+    view->settle_id = 0;
+    view->async = FALSE;
+    view->generation = 0;
+    view->use_pyramid = FALSE;
+    view->pyramid = NULL;
+    view->shared_tiles = FALSE;
+    gtk_image_view_reset_stats (view);
+    view->expose_timer = g_timer_new ();
+    view->loader = NULL;
+    view->damage = (GdkRectangle){0, 0, 0, 0};
+    view->damage_all = FALSE;
+    view->damage_id = 0;
 
     view->hadj = GTK_ADJUSTMENT (gtk_adjustment_new (0.0, 1.0, 0.0,
                                                      1.0, 1.0, 1.0));
@@ -1011,6 +1434,24 @@ gtk_image_view_finalize (GObject *object)
         g_object_unref (view->pixbuf);
         view->pixbuf = NULL;
     }
+    if (view->source)
+    {
+        g_object_unref (view->source);
+        view->source = NULL;
+    }
+    if (view->pyramid)
+    {
+        gdk_pixbuf_pyramid_free (view->pyramid);
+        view->pyramid = NULL;
+    }
+    gtk_image_view_unbind_loader (view);
+    gtk_image_view_drop_damage (view);
+    if (view->zoom_anim_id)
+        g_source_remove (view->zoom_anim_id);
+    if (view->settle_id)
+        g_source_remove (view->settle_id);
+    g_timer_destroy (view->zoom_timer);
+    g_timer_destroy (view->expose_timer);
     g_object_unref (view->tool);
     /* Chain up. */
     G_OBJECT_CLASS (gtk_image_view_parent_class)->finalize (object);
@@ -1396,7 +1837,7 @@ gboolean
 gtk_image_view_get_viewport (GtkImageView *view,
                              GdkRectangle *rect)
 {
-    gboolean ret_val = (view->pixbuf != NULL);
+    gboolean ret_val = gtk_image_view_has_image (view);
     if (!rect || !ret_val)
         return ret_val;
     
@@ -1433,7 +1874,7 @@ gboolean
 gtk_image_view_get_draw_rect (GtkImageView *view,
                               GdkRectangle *rect)
 {
-    if (!view->pixbuf)
+    if (!gtk_image_view_has_image (view))
         return FALSE;
     Size alloc = gtk_image_view_get_allocated_size (view);
     Size zoomed = gtk_image_view_get_zoomed_size (view);
@@ -1460,9 +1901,13 @@ gtk_image_view_get_draw_rect (GtkImageView *view,
  * pixbuf, then the conversion was unsuccessful, %FALSE is returned
  * and @rect_out is left unmodified.
  *
- * The size of @rect_out is rounded up. For example, if the zoom
- * factor is 0.25 and the width of the input rectangle is 2, then its
- * with in widget space coordinates is 0.5 which is rounded up to 1.
+ * @rect_out is the smallest rectangle of whole widget pixels that
+ * contains the area the pixels in @rect_in are drawn on. For example,
+ * if the zoom factor is 0.25 and the input rectangle is 2 pixels wide
+ * starting at x = 3, it covers widget space x = 0.75 to 1.25, so
+ * @rect_out starts at 0 and is 2 pixels wide. Note that interpolation
+ * may also change the color of a few pixels outside of it, see
+ * gdk_pixbuf_get_scale_margin().
  *
  * Note that this function may return a rectangle that is not visible
  * on the widget.
@@ -1472,13 +1917,8 @@ gtk_image_view_image_to_widget_rect (GtkImageView *view,
                                      GdkRectangle *rect_in,
                                      GdkRectangle *rect_out)
 {
-    gdouble zoom = gtk_image_view_get_zoom (view);
-    GdkRectangle zoom_rect = {
-        rect_in->x * zoom,
-        rect_in->y * zoom,
-        ceil (rect_in->width * zoom),
-        ceil (rect_in->height * zoom)
-    };
+    GdkRectangle zoom_rect;
+    gdk_rectangle_zoom (rect_in, gtk_image_view_get_zoom (view), &zoom_rect);
 
     GdkRectangle image_rect, viewport = {0};
     if (!gtk_image_view_get_draw_rect (view, &image_rect))
@@ -1602,7 +2042,10 @@ gtk_image_view_set_transp (GtkImageView   *view,
         view->check_color1 = transp_color;
         view->check_color2 = transp_color;
     }
-    gtk_image_view_set_pixbuf (view, view->pixbuf, FALSE);
+    if (view->source)
+        gtk_image_view_set_source (view, view->source, FALSE);
+    else
+        gtk_image_view_set_pixbuf (view, view->pixbuf, FALSE);
 }
 
 /*************************************************************/
@@ -1639,16 +2082,84 @@ gtk_image_view_set_fitting (GtkImageView *view,
                             gboolean      fitting)
 {
     g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    if (fitting)
+        gtk_image_view_finish_zoom_animation (view);
     view->fitting = fitting;
     gtk_widget_queue_resize (GTK_WIDGET (view));
 }
 
+/**
+ * gtk_image_view_set_image:
+ *
+ * Does the work of gtk_image_view_set_pixbuf() and
+ * gtk_image_view_set_source(). At most one of @pixbuf and @source is
+ * non-%NULL.
+ **/
+static void
+gtk_image_view_set_image (GtkImageView    *view,
+                          GdkPixbuf       *pixbuf,
+                          GtkIImageSource *source,
+                          gboolean         reset_fit)
+{
+    if (view->pixbuf != pixbuf || view->source != source)
+    {
+        gtk_image_view_finish_zoom_animation (view);
+        if (view->pixbuf)
+            g_object_unref (view->pixbuf);
+        view->pixbuf = pixbuf;
+        if (view->pixbuf)
+            g_object_ref (pixbuf);
+        if (source)
+            g_object_ref (source);
+        if (view->source)
+            g_object_unref (view->source);
+        view->source = source;
+        if (view->pyramid)
+        {
+            gdk_pixbuf_pyramid_free (view->pyramid);
+            view->pyramid = NULL;
+        }
+    }
+    else if (pixbuf)
+    {
+        /* The pixels of the same pixbuf may have changed anywhere, so
+           its pyramid and the tiles shared with other views are
+           updated as if all of it was damaged. */
+        if (view->pyramid)
+            gdk_pixbuf_pyramid_damage (view->pyramid, NULL);
+        gdk_pixbuf_draw_cache_invalidate_shared (pixbuf, NULL);
+    }
+    /* Everything is redrawn anyway, which covers pending damage. */
+    gtk_image_view_drop_damage (view);
+
+    if (reset_fit)
+        gtk_image_view_set_fitting (view, TRUE);
+    else
+    {
+        /*
+          If the size of the pixbuf changes, the offset might point to
+          pixels outside it so we use gtk_image_view_scroll_to() to
+          make it valid again. And if the size is different, naturally
+          we must also update the adjustments.
+         */
+        gtk_image_view_scroll_to (view, view->offset_x, view->offset_y,
+                                  FALSE, FALSE);
+        gtk_image_view_update_adjustments (view);
+        gtk_widget_queue_draw (GTK_WIDGET (view));
+    }
+    
+    g_signal_emit (G_OBJECT (view),
+                   gtk_image_view_signals[PIXBUF_CHANGED], 0);
+    gtk_iimage_tool_pixbuf_changed (view->tool, reset_fit, NULL);
+}
+
 /**
  * gtk_image_view_get_pixbuf:
  * @view: A #GtkImageView.
  * @returns: The pixbuf this view shows.
  *
- * Returns the pixbuf this view shows.
+ * Returns the pixbuf this view shows, or %NULL if it shows an image
+ * source or nothing.
  **/
 GdkPixbuf *
 gtk_image_view_get_pixbuf (GtkImageView *view)
@@ -1673,7 +2184,12 @@ gtk_image_view_get_pixbuf (GtkImageView *view)
  * which leaves the fit mode of the view untouched.
  *
  * This method should not be used if merely the contents of the pixbuf
- * has changed. See gtk_image_view_damage_pixels() for that.
+ * has changed. See gtk_image_view_damage_pixels() for that. Setting
+ * the pixbuf the view already shows redraws all of it, as if all of
+ * it was damaged.
+ *
+ * The pixbuf replaces the image source set with
+ * gtk_image_view_set_source(), if any.
  *
  * If @reset_fit is %TRUE, the ::zoom-changed signal is emitted,
  * otherwise not. The ::pixbuf-changed signal is also emitted.
@@ -1685,34 +2201,121 @@ gtk_image_view_set_pixbuf (GtkImageView *view,
                            GdkPixbuf    *pixbuf,
                            gboolean      reset_fit)
 {
-    if (view->pixbuf != pixbuf)
-    {
-        if (view->pixbuf)
-            g_object_unref (view->pixbuf);
-        view->pixbuf = pixbuf;
-        if (view->pixbuf)
-            g_object_ref (pixbuf);
-    }
+    gtk_image_view_set_image (view, pixbuf, NULL, reset_fit);
+}
 
-    if (reset_fit)
-        gtk_image_view_set_fitting (view, TRUE);
-    else
-    {
-        /*
-          If the size of the pixbuf changes, the offset might point to
-          pixels outside it so we use gtk_image_view_scroll_to() to
-          make it valid again. And if the size is different, naturally
-          we must also update the adjustments.
-         */
-        gtk_image_view_scroll_to (view, view->offset_x, view->offset_y,
-                                  FALSE, FALSE);
-        gtk_image_view_update_adjustments (view);
-        gtk_widget_queue_draw (GTK_WIDGET (view));
-    }
-    
-    g_signal_emit (G_OBJECT (view),
-                   gtk_image_view_signals[PIXBUF_CHANGED], 0);
-    gtk_iimage_tool_pixbuf_changed (view->tool, reset_fit, NULL);
+/**
+ * gtk_image_view_get_source:
+ * @view: a #GtkImageView
+ * @returns: the image source this view shows, or %NULL
+ *
+ * Returns the image source set with gtk_image_view_set_source().
+ **/
+GtkIImageSource *
+gtk_image_view_get_source (GtkImageView *view)
+{
+    g_return_val_if_fail (GTK_IS_IMAGE_VIEW (view), NULL);
+    return view->source;
+}
+
+/**
+ * gtk_image_view_set_source:
+ * @view: a #GtkImageView
+ * @source: the #GtkIImageSource to display, or %NULL
+ * @reset_fit: whether to reset fitting or not
+ *
+ * Displays an image source instead of a pixbuf. It is drawn the same
+ * way as a pixbuf is, except that each tile of the draw cache is
+ * scaled from the pixels of the source that it needs, read when the
+ * tile is scaled. Images far larger than memory can so be shown. See
+ * #GtkIImageSource.
+ *
+ * The source replaces the pixbuf of the view, so
+ * gtk_image_view_get_pixbuf() returns %NULL until a pixbuf is set
+ * again. @reset_fit and the signals emitted are the same as for
+ * gtk_image_view_set_pixbuf().
+ **/
+void
+gtk_image_view_set_source (GtkImageView    *view,
+                           GtkIImageSource *source,
+                           gboolean         reset_fit)
+{
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    gtk_image_view_set_image (view, NULL, source, reset_fit);
+}
+
+/**
+ * gtk_image_view_set_loader:
+ * @view: a #GtkImageView
+ * @loader: a #GdkPixbufLoader or %NULL
+ *
+ * Shows the image @loader decodes while it is being decoded, instead
+ * of waiting for the whole image to be loaded. As soon as the loader
+ * knows the size of the image, its pixbuf is set as the view's
+ * pixbuf with gtk_image_view_set_pixbuf(). The rows decoded after
+ * that are damaged with gtk_image_view_damage_pixels() as they
+ * arrive, so they are redrawn at most once per frame however fast
+ * the loader decodes.
+ *
+ * The view keeps a reference to @loader until the loader is closed,
+ * another loader is set or @loader is %NULL. Setting another pixbuf
+ * with gtk_image_view_set_pixbuf() while the loader is bound stops
+ * the updates from being shown.
+ *
+ * <informalexample>
+ *   <programlisting>
+ *     GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
+ *     gtk_image_view_set_loader (view, loader);
+ *     // Feed the loader from an idle handler or an I/O watch.
+ *     gdk_pixbuf_loader_write (loader, buf, n_bytes, NULL);
+ *     ...
+ *     gdk_pixbuf_loader_close (loader, NULL);
+ *     g_object_unref (loader);
+ *   </programlisting>
+ * </informalexample>
+ **/
+void
+gtk_image_view_set_loader (GtkImageView    *view,
+                           GdkPixbufLoader *loader)
+{
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    g_return_if_fail (!loader || GDK_IS_PIXBUF_LOADER (loader));
+    if (loader == view->loader)
+        return;
+    gtk_image_view_unbind_loader (view);
+    if (!loader)
+        return;
+
+    view->loader = g_object_ref (loader);
+    g_signal_connect (G_OBJECT (loader), "area-prepared",
+                      G_CALLBACK (gtk_image_view_loader_area_prepared_cb),
+                      view);
+    g_signal_connect (G_OBJECT (loader), "area-updated",
+                      G_CALLBACK (gtk_image_view_loader_area_updated_cb),
+                      view);
+    g_signal_connect (G_OBJECT (loader), "closed",
+                      G_CALLBACK (gtk_image_view_loader_closed_cb),
+                      view);
+
+    /* The loader may have been fed before it was bound. */
+    GdkPixbuf *pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+    if (pixbuf)
+        gtk_image_view_set_pixbuf (view, pixbuf, TRUE);
+}
+
+/**
+ * gtk_image_view_get_loader:
+ * @view: a #GtkImageView
+ * @returns: the #GdkPixbufLoader whose image is shown, or %NULL
+ *
+ * Returns the loader set with gtk_image_view_set_loader(), if it has
+ * not been closed yet.
+ **/
+GdkPixbufLoader *
+gtk_image_view_get_loader (GtkImageView *view)
+{
+    g_return_val_if_fail (GTK_IS_IMAGE_VIEW (view), NULL);
+    return view->loader;
 }
 
 /**
@@ -1720,7 +2323,8 @@ gtk_image_view_set_pixbuf (GtkImageView *view,
  * @view: a #GtkImageView
  * @returns: the current zoom factor
  *
- * Get the current zoom factor of the view.
+ * Get the current zoom factor of the view. While a zoom animation is
+ * running, this is the zoom of the frame shown.
  **/
 gdouble
 gtk_image_view_get_zoom (GtkImageView *view)
@@ -1739,6 +2343,10 @@ gtk_image_view_get_zoom (GtkImageView *view)
  * Fitting is always disabled after this method has run. The
  * ::zoom-changed signal is unconditionally emitted.
  *
+ * If a zoom duration is set with gtk_image_view_set_zoom_duration(),
+ * the view is zoomed gradually instead and ::zoom-changed is emitted
+ * for each frame of the animation.
+ *
  * The default value is 1.0.
  **/
 void
@@ -1747,7 +2355,9 @@ gtk_image_view_set_zoom (GtkImageView *view,
 {
     g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
     zoom = gtk_zooms_clamp_zoom (zoom);
-    gtk_image_view_set_zoom_no_center (view, zoom, FALSE);
+    Size alloc = gtk_image_view_get_allocated_size (view);
+    gtk_image_view_animate_zoom (view, zoom,
+                                 alloc.width / 2.0, alloc.height / 2.0);
 }
 
 /**
@@ -1895,6 +2505,365 @@ gtk_image_view_get_interpolation (GtkImageView *view)
     return view->interp;
 }
 
+/**
+ * gtk_image_view_set_n_threads:
+ * @view: a #GtkImageView
+ * @n_threads: number of threads to scale with
+ *
+ * Sets the number of threads the view uses to scale the image when
+ * it is redrawn. The area to redraw is split into horizontal bands
+ * that are scaled concurrently on a worker pool. The output is
+ * identical to scaling in one thread, only faster on machines with
+ * several cores.
+ *
+ * Scaling is only done in parallel if the application has
+ * initialized the GLib thread system with g_thread_init(). Otherwise
+ * this setting has no effect.
+ *
+ * The default is 1, which means that all scaling is done in the main
+ * thread.
+ **/
+void
+gtk_image_view_set_n_threads (GtkImageView *view,
+                              int           n_threads)
+{
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    g_return_if_fail (n_threads > 0);
+    view->n_threads = n_threads;
+}
+
+/**
+ * gtk_image_view_get_n_threads:
+ * @view: a #GtkImageView
+ * @returns: the number of threads used for scaling
+ *
+ * Returns the number of threads the view uses to scale the image.
+ **/
+int
+gtk_image_view_get_n_threads (GtkImageView *view)
+{
+    g_return_val_if_fail (GTK_IS_IMAGE_VIEW (view), 1);
+    return view->n_threads;
+}
+
+/**
+ * gtk_image_view_set_refine_delay:
+ * @view: a #GtkImageView
+ * @delay: milliseconds of quiet before refining, or 0
+ *
+ * Turns progressive rendering on or off. When @delay is non-zero,
+ * the parts of an expose whose scaled tiles are not cached yet are
+ * painted immediately with %GDK_INTERP_NEAREST, which is very
+ * fast. Once no such quick pixels have been painted for @delay
+ * milliseconds, the view is redrawn with the interpolation set with
+ * gtk_image_view_set_interpolation(). If the view is zoomed or
+ * scrolled to uncached parts before that, the refinement is
+ * postponed. Exposes that only need cached tiles are painted at full
+ * quality right away.
+ *
+ * Progressive rendering keeps the view responsive during zoom and
+ * drag interactions on large images with slow interpolation modes.
+ *
+ * The default is 0 which means that each expose is painted with the
+ * configured interpolation right away.
+ **/
+void
+gtk_image_view_set_refine_delay (GtkImageView *view,
+                                 guint         delay)
+{
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    view->refine_delay = delay;
+    if (!delay)
+        gtk_image_view_cancel_refine (view);
+    gtk_widget_queue_draw (GTK_WIDGET (view));
+}
+
+/**
+ * gtk_image_view_get_refine_delay:
+ * @view: a #GtkImageView
+ * @returns: the refine delay in milliseconds
+ *
+ * Returns the delay after which the view refines a progressively
+ * rendered image, or 0 if progressive rendering is turned off.
+ **/
+guint
+gtk_image_view_get_refine_delay (GtkImageView *view)
+{
+    g_return_val_if_fail (GTK_IS_IMAGE_VIEW (view), 0);
+    return view->refine_delay;
+}
+
+/**
+ * gtk_image_view_set_zoom_duration:
+ * @view: a #GtkImageView
+ * @duration: milliseconds a change of zoom is animated over, or 0
+ *
+ * Turns animated zooming on or off. When @duration is non-zero,
+ * gtk_image_view_set_zoom(), gtk_image_view_zoom_in(),
+ * gtk_image_view_zoom_out() and zooming with the mouse wheel change
+ * the zoom gradually over @duration milliseconds instead of jumping
+ * to the new zoom. A duration of about 150 milliseconds looks smooth
+ * without slowing the user down.
+ *
+ * The frames of the animation are drawn with %GDK_INTERP_NEAREST by
+ * rescaling the last image drawn at full quality, or the pixbuf where
+ * that does not cover the view, so their cost does not depend on the
+ * size of the image. The image is only drawn with the configured
+ * interpolation at the final zoom. If a frame still takes too long to
+ * draw, the animation skips to its end.
+ *
+ * The default is 0 which means that the zoom is changed immediately.
+ **/
+void
+gtk_image_view_set_zoom_duration (GtkImageView *view,
+                                  guint         duration)
+{
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    view->zoom_duration = duration;
+    if (!duration)
+        gtk_image_view_finish_zoom_animation (view);
+}
+
+/**
+ * gtk_image_view_get_zoom_duration:
+ * @view: a #GtkImageView
+ * @returns: the zoom duration in milliseconds
+ *
+ * Returns how long changes of zoom are animated, or 0 if animated
+ * zooming is turned off.
+ **/
+guint
+gtk_image_view_get_zoom_duration (GtkImageView *view)
+{
+    g_return_val_if_fail (GTK_IS_IMAGE_VIEW (view), 0);
+    return view->zoom_duration;
+}
+
+/**
+ * gtk_image_view_set_continuous_zoom:
+ * @view: a #GtkImageView
+ * @continuous: %TRUE to zoom to any zoom factor with the mouse wheel
+ *
+ * Sets whether zooming is continuous. Normally the mouse wheel steps
+ * through a fixed list of zoom factors. In continuous mode each notch
+ * of the wheel zooms by 10% instead, which together with
+ * gtk_image_view_set_zoom() called for each step of a gesture allows
+ * smooth zooming.
+ *
+ * Each zoom factor would need a full rescale of the image, so while
+ * the zoom keeps changing the view is drawn by cheaply rescaling the
+ * last image drawn at full quality, like the frames of a zoom
+ * animation. The image is drawn with the configured interpolation
+ * once the zoom has stayed the same for a moment.
+ *
+ * The default is %FALSE.
+ **/
+void
+gtk_image_view_set_continuous_zoom (GtkImageView *view,
+                                    gboolean      continuous)
+{
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    view->continuous_zoom = continuous;
+}
+
+/**
+ * gtk_image_view_get_continuous_zoom:
+ * @view: a #GtkImageView
+ * @returns: %TRUE if zooming is continuous
+ *
+ * Returns whether the mouse wheel zooms to any zoom factor instead
+ * of stepping through a fixed list of them.
+ **/
+gboolean
+gtk_image_view_get_continuous_zoom (GtkImageView *view)
+{
+    g_return_val_if_fail (GTK_IS_IMAGE_VIEW (view), FALSE);
+    return view->continuous_zoom;
+}
+
+/**
+ * gtk_image_view_set_async:
+ * @view: a #GtkImageView
+ * @async: %TRUE to scale the image on worker threads
+ *
+ * Sets whether the image should be scaled asynchronously. When
+ * %TRUE, tools that support it, such as #GtkImageToolDragger, do not
+ * scale the image inside the expose handler. The parts of the image
+ * that are not already cached are first drawn quickly at low quality
+ * while worker threads scale them. They are redrawn as soon as the
+ * threads are done, which keeps the view responsive to input even
+ * for huge images and slow interpolation modes. Work queued for
+ * parts of the image that are not visible anymore after the view
+ * has been zoomed or scrolled is skipped.
+ *
+ * The number of worker threads is the one set with
+ * gtk_image_view_set_n_threads(). Asynchronous scaling requires that
+ * the application has initialized the GLib thread system with
+ * g_thread_init(). Otherwise this setting has no effect.
+ *
+ * The default is %FALSE.
+ **/
+void
+gtk_image_view_set_async (GtkImageView *view,
+                          gboolean      async)
+{
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    view->async = async;
+}
+
+/**
+ * gtk_image_view_get_async:
+ * @view: a #GtkImageView
+ * @returns: %TRUE if the image is scaled asynchronously
+ *
+ * Returns whether the image is scaled asynchronously.
+ **/
+gboolean
+gtk_image_view_get_async (GtkImageView *view)
+{
+    g_return_val_if_fail (GTK_IS_IMAGE_VIEW (view), FALSE);
+    return view->async;
+}
+
+/**
+ * gtk_image_view_set_use_pyramid:
+ * @view: a #GtkImageView
+ * @use_pyramid: %TRUE to scale zoomed out images from an image pyramid
+ *
+ * Sets whether zoomed out images should be scaled from a
+ * #GdkPixbufPyramid. When %TRUE and the zoom factor is 0.5 or less,
+ * the image is not scaled from the full size pixbuf but from a copy
+ * of it that has been repeatedly halved in size, which is much
+ * faster and reduces aliasing. The pyramid is built the first time
+ * the image is drawn zoomed out and uses up to a third more memory
+ * than the pixbuf itself.
+ *
+ * The default is %FALSE.
+ **/
+void
+gtk_image_view_set_use_pyramid (GtkImageView *view,
+                                gboolean      use_pyramid)
+{
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    if (view->use_pyramid == use_pyramid)
+        return;
+    view->use_pyramid = use_pyramid;
+    if (!use_pyramid && view->pyramid)
+    {
+        /* Tiles scaled from the pyramid are useless now and the
+           tool must not refer to it anymore. */
+        gtk_iimage_tool_pixbuf_changed (view->tool, FALSE, NULL);
+        gdk_pixbuf_pyramid_free (view->pyramid);
+        view->pyramid = NULL;
+    }
+    gtk_widget_queue_draw (GTK_WIDGET (view));
+}
+
+/**
+ * gtk_image_view_get_use_pyramid:
+ * @view: a #GtkImageView
+ * @returns: %TRUE if zoomed out images are scaled from an image
+ *   pyramid
+ *
+ * Returns whether zoomed out images are scaled from an image pyramid.
+ **/
+gboolean
+gtk_image_view_get_use_pyramid (GtkImageView *view)
+{
+    g_return_val_if_fail (GTK_IS_IMAGE_VIEW (view), FALSE);
+    return view->use_pyramid;
+}
+
+/**
+ * gtk_image_view_set_shared_tiles:
+ * @view: a #GtkImageView
+ * @shared_tiles: %TRUE to share scaled tiles with other views
+ *
+ * Sets whether the view's tool should keep the tiles it scales in
+ * the process-wide tile store instead of in a cache of its own, see
+ * #GdkPixbufTileStore. Views that show the same
+ * pixbuf at the same zoom and interpolation then only scale each
+ * part of it once, for example when several views are kept in sync
+ * to compare images, and all the tiles stay within one memory limit.
+ *
+ * Pixels damaged with gtk_image_view_damage_pixels() are discarded
+ * from the shared tiles too. The other views showing the pixbuf must
+ * be damaged as well to be redrawn.
+ *
+ * The default is %FALSE.
+ **/
+void
+gtk_image_view_set_shared_tiles (GtkImageView *view,
+                                 gboolean      shared_tiles)
+{
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    if (view->shared_tiles == shared_tiles)
+        return;
+    view->shared_tiles = shared_tiles;
+    gtk_widget_queue_draw (GTK_WIDGET (view));
+}
+
+/**
+ * gtk_image_view_get_shared_tiles:
+ * @view: a #GtkImageView
+ * @returns: %TRUE if the view shares scaled tiles with other views
+ *
+ * Returns whether the view shares scaled tiles with other views.
+ **/
+gboolean
+gtk_image_view_get_shared_tiles (GtkImageView *view)
+{
+    g_return_val_if_fail (GTK_IS_IMAGE_VIEW (view), FALSE);
+    return view->shared_tiles;
+}
+
+/**
+ * gtk_image_view_get_stats:
+ * @view: a #GtkImageView
+ * @stats: a #GdkPixbufDrawStats to fill in
+ *
+ * Copies the rendering statistics of the view to @stats. The
+ * statistics count how the view has been drawn since it was created
+ * or since the last call to gtk_image_view_reset_stats(): how many
+ * times each #GdkPixbufDrawMethod was used, how many pixels were
+ * scaled and how many were drawn, how long the exposes took and how
+ * much memory the scaled image cache uses. Applications can log
+ * them or display them to find out why drawing is slow:
+ *
+ * <informalexample>
+ *   <programlisting>
+ *     GdkPixbufDrawStats stats;
+ *     gtk_image_view_get_stats (view, &stats);
+ *     printf ("%u exposes, %.1f ms max, %llu pixels scaled\n",
+ *             stats.n_exposes, stats.max_expose_time * 1000.0,
+ *             stats.n_pixels_scaled);
+ *   </programlisting>
+ * </informalexample>
+ **/
+void
+gtk_image_view_get_stats (GtkImageView       *view,
+                          GdkPixbufDrawStats *stats)
+{
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    *stats = view->stats;
+}
+
+/**
+ * gtk_image_view_reset_stats:
+ * @view: a #GtkImageView
+ *
+ * Resets all rendering statistics of the view to zero, except for
+ * the cache size which is updated on the next draw.
+ **/
+void
+gtk_image_view_reset_stats (GtkImageView *view)
+{
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    gsize cache_size = view->stats.cache_size;
+    memset (&view->stats, 0, sizeof (GdkPixbufDrawStats));
+    view->stats.cache_size = cache_size;
+}
+
 /**
  * gtk_image_view_set_tool:
  * @view: A #GtkImageView.
@@ -1958,7 +2927,8 @@ gtk_image_view_get_tool (GtkImageView *view)
 void
 gtk_image_view_zoom_in (GtkImageView *view)
 {
-    gdouble zoom = gtk_zooms_get_zoom_in (view->zoom);
+    gdouble zoom = gtk_image_view_get_target_zoom (view);
+    zoom = gtk_zooms_get_zoom_in (zoom);
     gtk_image_view_set_zoom (view, zoom);
 }
 
@@ -1972,7 +2942,8 @@ gtk_image_view_zoom_in (GtkImageView *view)
 void
 gtk_image_view_zoom_out (GtkImageView *view)
 {
-    gdouble zoom = gtk_zooms_get_zoom_out (view->zoom);
+    gdouble zoom = gtk_image_view_get_target_zoom (view);
+    zoom = gtk_zooms_get_zoom_out (zoom);
     gtk_image_view_set_zoom (view, zoom);
 }
 
@@ -1985,8 +2956,7 @@ gtk_image_view_zoom_out (GtkImageView *view)
  * Mark the pixels in the rectangle as damaged. That the pixels are
  * damaged, means that they have been modified and that the view must
  * redraw them to ensure that the visible part of the image
- * corresponds to the pixels in that image. Calling this method emits
- * the ::pixbuf-changed signal.
+ * corresponds to the pixels in that image.
  *
  * This method must be used when <emphasis>modifying</emphasis> the
  * image data:
@@ -2003,30 +2973,78 @@ gtk_image_view_zoom_out (GtkImageView *view)
  * If the whole pixbuf has been modified then @rect should be %NULL to
  * indicate that a total update is needed.
  *
+ * The damage is not handled right away. Rectangles damaged within
+ * the same frame are merged into their bounding box, which is
+ * redrawn once at the end of the frame, when the ::pixbuf-changed
+ * signal is emitted once for all of them. Use
+ * gtk_image_view_flush_damage() to handle the damage immediately.
+ *
  * See also gtk_image_view_set_pixbuf().
  **/
 void
 gtk_image_view_damage_pixels (GtkImageView *view,
                               GdkRectangle *rect)
 {
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    if (!rect)
+        view->damage_all = TRUE;
+    else if (rect->width <= 0 || rect->height <= 0)
+        return;
+    else if (!view->damage.width || !view->damage.height)
+        view->damage = *rect;
+    else
+        gdk_rectangle_union (&view->damage, rect, &view->damage);
+
+    if (!view->damage_id)
+        view->damage_id = g_timeout_add (DAMAGE_FRAME_INTERVAL,
+                                         gtk_image_view_damage_flush_cb,
+                                         view);
+}
+
+/**
+ * gtk_image_view_flush_damage:
+ * @view: a #GtkImageView
+ *
+ * Handles the damage accumulated by gtk_image_view_damage_pixels()
+ * without waiting for the end of the frame. The ::pixbuf-changed
+ * signal is emitted and the damaged area is queued for redraw. Does
+ * nothing if no pixels are damaged.
+ **/
+void
+gtk_image_view_flush_damage (GtkImageView *view)
+{
+    g_return_if_fail (GTK_IS_IMAGE_VIEW (view));
+    if (!view->damage_all && (!view->damage.width || !view->damage.height))
+        return;
+    GdkRectangle damage = view->damage;
+    GdkRectangle *rect = view->damage_all ? NULL : &damage;
+    gtk_image_view_drop_damage (view);
+
+    if (view->pyramid)
+        gdk_pixbuf_pyramid_damage (view->pyramid, rect);
+    /* Other views may be using the pixbuf's shared tiles. */
+    gdk_pixbuf_draw_cache_invalidate_shared (view->pixbuf, rect);
     g_signal_emit (G_OBJECT (view),
                    gtk_image_view_signals[PIXBUF_CHANGED], 0);
     gtk_iimage_tool_pixbuf_changed (view->tool, FALSE, rect);
 
     if (rect)
     {
-        // Convert rect to widget coordinates.
-        GdkRectangle wid_rect = {0};
-        gtk_image_view_image_to_widget_rect (view, rect, &wid_rect);
-
-        // The conversion from image to widget space coordinates is
-        // very inaccurate which is why a much larger area than the
-        // damaged has to be drawn. See the "Zoom bug" chapter in
-        // GtkImageToolSelector for more information.
+        GdkRectangle wid_rect;
+        if (!gtk_image_view_image_to_widget_rect (view, rect, &wid_rect))
+            return;
+
+        // Interpolation and the drift of the scaler's sample positions
+        // change the pixels a little outside of the damaged area too.
+        gdouble zoom = gtk_image_view_get_zoom (view);
+        Size size = gtk_image_view_get_pixbuf_size (view);
+        int extent = MAX (size.width, size.height) * zoom;
+        int margin = gdk_pixbuf_get_scale_margin (zoom, view->interp, extent);
         gtk_widget_queue_draw_area (GTK_WIDGET (view),
-                                    wid_rect.x - wid_rect.width * 2,
-                                    wid_rect.y - wid_rect.height * 2,
-                                    wid_rect.width * 4, wid_rect.height * 4);
+                                    wid_rect.x - margin,
+                                    wid_rect.y - margin,
+                                    wid_rect.width + 2 * margin,
+                                    wid_rect.height + 2 * margin);
     }
     else
         gtk_widget_queue_draw (GTK_WIDGET (view));
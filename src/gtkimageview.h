@@ -79,6 +79,8 @@ struct _GtkImageView
     GdkInterpType    interp;
     gboolean         fitting;
     GdkPixbuf       *pixbuf;
+    /* Image source shown instead of a pixbuf, or NULL. */
+    GtkIImageSource *source;
     gdouble          zoom;
     /* Offset in zoom space coordinates of the image area in the
        widget. */
@@ -95,6 +97,59 @@ struct _GtkImageView
     GtkImageTransp   transp;
     int              check_color1;
     int              check_color2;
+
+    int              n_threads;
+
+    /* Progressive rendering. */
+    guint            refine_delay;
+    guint            refine_id;
+    gboolean         is_refining;
+
+    /* Animated zoom. Each frame the zoom moves from zoom_from towards
+       zoom_to around the widget point zoom_center_x, zoom_center_y
+       until zoom_duration milliseconds have passed on
+       zoom_timer. zoom_frame_time is the time the last frame took to
+       paint. */
+    guint            zoom_duration;
+    guint            zoom_anim_id;
+    GTimer          *zoom_timer;
+    gdouble          zoom_from;
+    gdouble          zoom_to;
+    gdouble          zoom_center_x;
+    gdouble          zoom_center_y;
+    gdouble          zoom_frame_time;
+
+    /* Continuous zoom, and fitting while the view is resized. Until
+       the zoom has not changed for a while, which the settle timeout
+       waits for, frames are previews. */
+    gboolean         continuous_zoom;
+    guint            settle_id;
+
+    /* Asynchronous rendering. The generation is increased each time
+       the view is zoomed or scrolled. */
+    gboolean         async;
+    guint            generation;
+
+    /* Image pyramid of the pixbuf, built when first needed. */
+    gboolean          use_pyramid;
+    GdkPixbufPyramid *pyramid;
+
+    /* Whether the tools keep their scaled tiles in the store shared
+       with other views. */
+    gboolean          shared_tiles;
+
+    /* Render statistics, and the timer that times paints for them. */
+    GdkPixbufDrawStats stats;
+    GTimer           *expose_timer;
+
+    /* Loader whose image is shown while it is decoded. */
+    GdkPixbufLoader  *loader;
+
+    /* Image space area damaged since the last frame, or the whole
+       pixbuf if damage_all is set, and the timeout that handles it. */
+    GdkRectangle      damage;
+    gboolean          damage_all;
+    guint             damage_id;
 };
 
 struct _GtkImageViewClass
@@ -156,10 +211,18 @@ GdkPixbuf    *gtk_image_view_get_pixbuf      (GtkImageView    *view);
 void          gtk_image_view_set_pixbuf      (GtkImageView    *view,
                                               GdkPixbuf       *pixbuf,
                                               gboolean         reset_fit);
+GtkIImageSource *gtk_image_view_get_source   (GtkImageView    *view);
+void          gtk_image_view_set_source      (GtkImageView    *view,
+                                              GtkIImageSource *source,
+                                              gboolean         reset_fit);
 gdouble       gtk_image_view_get_zoom        (GtkImageView    *view);
 void          gtk_image_view_set_zoom        (GtkImageView    *view,
                                               gdouble          zoom);
 
+void          gtk_image_view_set_loader      (GtkImageView    *view,
+                                              GdkPixbufLoader *loader);
+GdkPixbufLoader *gtk_image_view_get_loader   (GtkImageView    *view);
+
 void          gtk_image_view_set_black_bg    (GtkImageView    *view,
 											  gboolean         black_bg);
 gboolean      gtk_image_view_get_black_bg    (GtkImageView    *view);
@@ -172,6 +235,38 @@ void          gtk_image_view_set_interpolation (GtkImageView  *view,
                                                 GdkInterpType  interp);
 GdkInterpType gtk_image_view_get_interpolation (GtkImageView  *view);
 
+void          gtk_image_view_set_n_threads   (GtkImageView    *view,
+                                              int              n_threads);
+int           gtk_image_view_get_n_threads   (GtkImageView    *view);
+
+void          gtk_image_view_set_refine_delay (GtkImageView   *view,
+                                               guint           delay);
+guint         gtk_image_view_get_refine_delay (GtkImageView   *view);
+
+void          gtk_image_view_set_zoom_duration (GtkImageView  *view,
+                                                guint          duration);
+guint         gtk_image_view_get_zoom_duration (GtkImageView  *view);
+
+void          gtk_image_view_set_continuous_zoom (GtkImageView *view,
+                                                  gboolean      continuous);
+gboolean      gtk_image_view_get_continuous_zoom (GtkImageView *view);
+
+void          gtk_image_view_set_async       (GtkImageView    *view,
+                                              gboolean         async);
+gboolean      gtk_image_view_get_async       (GtkImageView    *view);
+
+void          gtk_image_view_set_use_pyramid (GtkImageView    *view,
+                                              gboolean         use_pyramid);
+gboolean      gtk_image_view_get_use_pyramid (GtkImageView    *view);
+
+void          gtk_image_view_set_shared_tiles (GtkImageView   *view,
+                                               gboolean        shared_tiles);
+gboolean      gtk_image_view_get_shared_tiles (GtkImageView   *view);
+
+void          gtk_image_view_get_stats       (GtkImageView       *view,
+                                              GdkPixbufDrawStats *stats);
+void          gtk_image_view_reset_stats     (GtkImageView       *view);
+
 void          gtk_image_view_set_show_cursor (GtkImageView    *view,
                                               gboolean         show_cursor);
 gboolean      gtk_image_view_get_show_cursor (GtkImageView    *view);
@@ -185,6 +280,7 @@ void          gtk_image_view_zoom_in	     (GtkImageView    *view);
 void          gtk_image_view_zoom_out	     (GtkImageView    *view);
 void          gtk_image_view_damage_pixels   (GtkImageView    *view,
                                               GdkRectangle    *rect);
+void          gtk_image_view_flush_damage    (GtkImageView    *view);
 
 /* Version info */
 const char   *gtk_image_view_library_version (void);
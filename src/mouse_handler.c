@@ -39,6 +39,9 @@ mouse_handler_new (GdkCursor *grab_cursor)
     mh->drag_base_y = 0;
     mh->drag_ofs_x = 0;
     mh->drag_ofs_y = 0;
+    mh->velocity_x = 0.0;
+    mh->velocity_y = 0.0;
+    mh->last_time = 0;
     mh->grab_cursor = grab_cursor;
     return mh;
 }
@@ -70,7 +73,8 @@ mouse_handler_grab_pointer (MouseHandler *mh,
  *
  * Handles a button press event. If left mouse button is pressed an
  * attempt to grab the pointer is made. The drag base and drag offset
- * is reset to the coordinate for the button event.
+ * is reset to the coordinate for the button event and the velocity
+ * to zero.
  **/
 gboolean
 mouse_handler_button_press (MouseHandler   *mh,
@@ -84,6 +88,9 @@ mouse_handler_button_press (MouseHandler   *mh,
     mh->drag_base_y = ev->y;
     mh->drag_ofs_x = ev->x;
     mh->drag_ofs_y = ev->y;
+    mh->velocity_x = 0.0;
+    mh->velocity_y = 0.0;
+    mh->last_time = ev->time;
     return TRUE;
 }
 
@@ -96,18 +103,49 @@ mouse_handler_button_release (MouseHandler   *mh,
     gdk_pointer_ungrab (ev->time);
     mh->pressed = FALSE;
     mh->dragging = FALSE;
+    mh->velocity_x = 0.0;
+    mh->velocity_y = 0.0;
     return TRUE;
 }
 
+/**
+ * mouse_handler_motion_notify:
+ * @mh: a #MouseHandler
+ * @ev: the #GdkEventMotion event to handle.
+ *
+ * Handles a motion event. While the button is pressed, the velocity
+ * is updated from the distance moved since the last motion
+ * event. Each new measurement is averaged with the old velocity so
+ * that one jerky event does not throw it off.
+ *
+ * For a motion hint, the position is read from the pointer, which
+ * also asks for the next hint.
+ **/
 void
 mouse_handler_motion_notify (MouseHandler   *mh,
                              GdkEventMotion *ev)
 {
+    int x = ev->x;
+    int y = ev->y;
+    if (ev->is_hint && ev->window)
+        gdk_window_get_pointer (ev->window, &x, &y, NULL);
+
     if (mh->pressed)
+    {
         mh->dragging = TRUE;
+        guint32 dt = ev->time - mh->last_time;
+        if (dt > 0)
+        {
+            gdouble vx = (x - mh->drag_ofs_x) * 1000.0 / dt;
+            gdouble vy = (y - mh->drag_ofs_y) * 1000.0 / dt;
+            mh->velocity_x = (mh->velocity_x + vx) / 2.0;
+            mh->velocity_y = (mh->velocity_y + vy) / 2.0;
+            mh->last_time = ev->time;
+        }
+    }
 
-    mh->drag_ofs_x = ev->x;
-    mh->drag_ofs_y = ev->y;
+    mh->drag_ofs_x = x;
+    mh->drag_ofs_y = y;
 }
 
 /**
@@ -125,3 +163,19 @@ mouse_handler_get_drag_delta (MouseHandler *mh,
     *y = mh->drag_base_y - mh->drag_ofs_y;
 }
 
+
+/**
+ * mouse_handler_get_velocity:
+ *
+ * Sets @x and @y to the speed, in pixels per second, with which the
+ * mouse is being dragged. Both are zero when the mouse is not
+ * pressed.
+ **/
+void
+mouse_handler_get_velocity (MouseHandler *mh,
+                            gdouble      *x,
+                            gdouble      *y)
+{
+    *x = mh->velocity_x;
+    *y = mh->velocity_y;
+}
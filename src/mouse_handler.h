@@ -37,6 +37,12 @@ typedef struct
     int              drag_ofs_x;
     int              drag_ofs_y;
 
+    /* Smoothed speed of the mouse while dragging, in pixels per
+       second, and the time of the last motion event. */
+    gdouble          velocity_x;
+    gdouble          velocity_y;
+    guint32          last_time;
+
     /* Cursor to use when grabbing. */
     GdkCursor       *grab_cursor; 
 } MouseHandler;
@@ -51,5 +57,8 @@ void          mouse_handler_motion_notify    (MouseHandler    *mh,
 void          mouse_handler_get_drag_delta   (MouseHandler    *mh,
                                               int             *x,
                                               int             *y);
+void          mouse_handler_get_velocity     (MouseHandler    *mh,
+                                              gdouble         *x,
+                                              gdouble         *y);
 
 #endif
@@ -0,0 +1,991 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; coding: utf-8 -*-
+ *
+ * Copyright © 2007-2008 Björn Lindqvist <bjourne@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/**
+ * SECTION:pixops
+ * @short_description: Specialized scaling kernels
+ *
+ * <para>
+ *   The pixops functions scale 8 bit RGB and RGBA pixbufs with
+ *   %GDK_INTERP_NEAREST, or with %GDK_INTERP_BILINEAR when
+ *   magnifying, onto a checkerboard. Those are the cases
+ *   #GtkImageView draws nearly all the time and gdk-pixbuf's general
+ *   scaler is not specialized for them. Other cases are left to
+ *   gdk-pixbuf.
+ * </para>
+ * <para>
+ *   The pixels sampled are the same as gdk-pixbuf samples, so the
+ *   output differs from gdk-pixbuf's only by rounding. The source
+ *   rows used are first converted to premultiplied 32 bit pixels,
+ *   which the kernels interpolate and composite over the
+ *   checkerboard. There are portable C kernels and kernels using
+ *   SSE2 and AVX2. The fastest kernels the CPU supports are selected
+ *   the first time they are needed.
+ * </para>
+ * <para>
+ *   Pixbufs with alpha can also be scaled to premultiplied pixels
+ *   without a checkerboard with pixops_scale_premultiplied() and
+ *   composited over one later with pixops_composite_checks().
+ *   #GdkPixbufDrawCache caches such pixels so that the checkerboard
+ *   can change without rescaling.
+ * </para>
+ * <para>
+ *   pixops_scale_area() scales a pixbuf holding only an area of a
+ *   larger image, as read from a #GtkIImageSource, and samples it
+ *   as if the whole image was there. Tiles scaled from different
+ *   areas then join without seams.
+ * </para>
+ **/
+#include <math.h>
+#include <string.h>
+#include "pixops.h"
+
+#if (defined (__i386__) || defined (__x86_64__)) &&                 \
+    (defined (__clang__) ||                                         \
+     (defined (__GNUC__) &&                                         \
+      (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define PIXOPS_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* Number of bits of subpixel precision of the bilinear weights. Same
+   as gdk-pixbuf uses. */
+#define SUBSAMPLE_BITS  4
+#define SCALE_SHIFT     16
+
+typedef struct
+{
+    /* Interpolates four taps per pixel from the two rows r0 and r1
+       and writes the result to out. */
+    void (*lerp_row) (const guint32 *r0,
+                      const guint32 *r1,
+                      const int     *x0,
+                      const int     *x1,
+                      const guint16 *wx,
+                      int            wy,
+                      guint32       *out,
+                      int            n);
+    /* Composites the premultiplied pixels in src over the opaque
+       pixels in bg. */
+    void (*over_row) (const guint32 *src,
+                      const guint32 *bg,
+                      guint32       *out,
+                      int            n);
+} PixopsKernels;
+
+static inline int
+div255 (int x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+/*************************************************************/
+/***** Portable C kernels ************************************/
+/*************************************************************/
+static void
+lerp_row_c (const guint32 *r0,
+            const guint32 *r1,
+            const int     *x0,
+            const int     *x1,
+            const guint16 *wx,
+            int            wy,
+            guint32       *out,
+            int            n)
+{
+    for (int j = 0; j < n; j++)
+    {
+        const guchar *a = (const guchar *) &r0[x0[j]];
+        const guchar *b = (const guchar *) &r0[x1[j]];
+        const guchar *c = (const guchar *) &r1[x0[j]];
+        const guchar *d = (const guchar *) &r1[x1[j]];
+        guchar *o = (guchar *) &out[j];
+        int w = wx[j];
+        for (int ch = 0; ch < 4; ch++)
+        {
+            int h0 = a[ch] * (16 - w) + b[ch] * w;
+            int h1 = c[ch] * (16 - w) + d[ch] * w;
+            o[ch] = (h0 * (16 - wy) + h1 * wy + 128) >> 8;
+        }
+    }
+}
+
+static void
+over_row_c (const guint32 *src,
+            const guint32 *bg,
+            guint32       *out,
+            int            n)
+{
+    for (int j = 0; j < n; j++)
+    {
+        const guchar *s = (const guchar *) &src[j];
+        const guchar *b = (const guchar *) &bg[j];
+        guchar *o = (guchar *) &out[j];
+        int ia = 255 - s[3];
+        o[0] = s[0] + div255 (b[0] * ia);
+        o[1] = s[1] + div255 (b[1] * ia);
+        o[2] = s[2] + div255 (b[2] * ia);
+        o[3] = 255;
+    }
+}
+
+static const PixopsKernels kernels_c = {lerp_row_c, over_row_c};
+
+#ifdef PIXOPS_HAVE_X86
+/*************************************************************/
+/***** SSE2 kernels ******************************************/
+/*************************************************************/
+__attribute__ ((target ("sse2"))) static void
+lerp_row_sse2 (const guint32 *r0,
+               const guint32 *r1,
+               const int     *x0,
+               const int     *x1,
+               const guint16 *wx,
+               int            wy,
+               guint32       *out,
+               int            n)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i sixteen = _mm_set1_epi16 (16);
+    const __m128i round = _mm_set1_epi16 (128);
+    const __m128i vwy1 = _mm_set1_epi16 (wy);
+    const __m128i vwy0 = _mm_set1_epi16 (16 - wy);
+    int j = 0;
+    for (; j + 4 <= n; j += 4)
+    {
+        __m128i a = _mm_set_epi32 (r0[x0[j + 3]], r0[x0[j + 2]],
+                                   r0[x0[j + 1]], r0[x0[j]]);
+        __m128i b = _mm_set_epi32 (r0[x1[j + 3]], r0[x1[j + 2]],
+                                   r0[x1[j + 1]], r0[x1[j]]);
+        __m128i c = _mm_set_epi32 (r1[x0[j + 3]], r1[x0[j + 2]],
+                                   r1[x0[j + 1]], r1[x0[j]]);
+        __m128i d = _mm_set_epi32 (r1[x1[j + 3]], r1[x1[j + 2]],
+                                   r1[x1[j + 1]], r1[x1[j]]);
+
+        /* Spread each pixel's weight over its four channels. */
+        __m128i w = _mm_loadl_epi64 ((const __m128i *) (wx + j));
+        w = _mm_unpacklo_epi16 (w, zero);
+        w = _mm_or_si128 (w, _mm_slli_epi32 (w, 16));
+        __m128i w1[2] = {_mm_unpacklo_epi32 (w, w),
+                         _mm_unpackhi_epi32 (w, w)};
+        __m128i w0[2] = {_mm_sub_epi16 (sixteen, w1[0]),
+                         _mm_sub_epi16 (sixteen, w1[1])};
+
+        __m128i v[2];
+        for (int half = 0; half < 2; half++)
+        {
+            __m128i pa, pb, pc, pd;
+            if (!half)
+            {
+                pa = _mm_unpacklo_epi8 (a, zero);
+                pb = _mm_unpacklo_epi8 (b, zero);
+                pc = _mm_unpacklo_epi8 (c, zero);
+                pd = _mm_unpacklo_epi8 (d, zero);
+            }
+            else
+            {
+                pa = _mm_unpackhi_epi8 (a, zero);
+                pb = _mm_unpackhi_epi8 (b, zero);
+                pc = _mm_unpackhi_epi8 (c, zero);
+                pd = _mm_unpackhi_epi8 (d, zero);
+            }
+            __m128i h0 = _mm_add_epi16 (_mm_mullo_epi16 (pa, w0[half]),
+                                        _mm_mullo_epi16 (pb, w1[half]));
+            __m128i h1 = _mm_add_epi16 (_mm_mullo_epi16 (pc, w0[half]),
+                                        _mm_mullo_epi16 (pd, w1[half]));
+            v[half] = _mm_add_epi16 (_mm_mullo_epi16 (h0, vwy0),
+                                     _mm_mullo_epi16 (h1, vwy1));
+            v[half] = _mm_srli_epi16 (_mm_add_epi16 (v[half], round), 8);
+        }
+        _mm_storeu_si128 ((__m128i *) (out + j),
+                          _mm_packus_epi16 (v[0], v[1]));
+    }
+    lerp_row_c (r0, r1, x0 + j, x1 + j, wx + j, wy, out + j, n - j);
+}
+
+__attribute__ ((target ("sse2"))) static void
+over_row_sse2 (const guint32 *src,
+               const guint32 *bg,
+               guint32       *out,
+               int            n)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i c255 = _mm_set1_epi16 (255);
+    const __m128i c128 = _mm_set1_epi16 (128);
+    int j = 0;
+    for (; j + 4 <= n; j += 4)
+    {
+        __m128i s = _mm_loadu_si128 ((const __m128i *) (src + j));
+        __m128i b = _mm_loadu_si128 ((const __m128i *) (bg + j));
+        __m128i r[2];
+        for (int half = 0; half < 2; half++)
+        {
+            __m128i ps = half ? _mm_unpackhi_epi8 (s, zero)
+                : _mm_unpacklo_epi8 (s, zero);
+            __m128i pb = half ? _mm_unpackhi_epi8 (b, zero)
+                : _mm_unpacklo_epi8 (b, zero);
+            __m128i a = _mm_shufflelo_epi16 (ps, _MM_SHUFFLE (3, 3, 3, 3));
+            a = _mm_shufflehi_epi16 (a, _MM_SHUFFLE (3, 3, 3, 3));
+            __m128i t = _mm_mullo_epi16 (pb, _mm_sub_epi16 (c255, a));
+            t = _mm_add_epi16 (t, c128);
+            t = _mm_srli_epi16 (_mm_add_epi16 (t, _mm_srli_epi16 (t, 8)), 8);
+            r[half] = _mm_add_epi16 (ps, t);
+        }
+        _mm_storeu_si128 ((__m128i *) (out + j),
+                          _mm_packus_epi16 (r[0], r[1]));
+    }
+    over_row_c (src + j, bg + j, out + j, n - j);
+}
+
+static const PixopsKernels kernels_sse2 = {lerp_row_sse2, over_row_sse2};
+
+/*************************************************************/
+/***** AVX2 kernels ******************************************/
+/*************************************************************/
+__attribute__ ((target ("avx2"))) static void
+lerp_row_avx2 (const guint32 *r0,
+               const guint32 *r1,
+               const int     *x0,
+               const int     *x1,
+               const guint16 *wx,
+               int            wy,
+               guint32       *out,
+               int            n)
+{
+    const __m256i zero = _mm256_setzero_si256 ();
+    const __m256i sixteen = _mm256_set1_epi16 (16);
+    const __m256i round = _mm256_set1_epi16 (128);
+    const __m256i vwy1 = _mm256_set1_epi16 (wy);
+    const __m256i vwy0 = _mm256_set1_epi16 (16 - wy);
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256i i0 = _mm256_loadu_si256 ((const __m256i *) (x0 + j));
+        __m256i i1 = _mm256_loadu_si256 ((const __m256i *) (x1 + j));
+        __m256i a = _mm256_i32gather_epi32 ((const int *) r0, i0, 4);
+        __m256i b = _mm256_i32gather_epi32 ((const int *) r0, i1, 4);
+        __m256i c = _mm256_i32gather_epi32 ((const int *) r1, i0, 4);
+        __m256i d = _mm256_i32gather_epi32 ((const int *) r1, i1, 4);
+
+        /* The unpacks work within 128 bit lanes, so the weights are
+           spread the same way as the pixels. */
+        __m256i w = _mm256_cvtepu16_epi32 (
+            _mm_loadu_si128 ((const __m128i *) (wx + j)));
+        w = _mm256_or_si256 (w, _mm256_slli_epi32 (w, 16));
+        __m256i w1[2] = {_mm256_unpacklo_epi32 (w, w),
+                         _mm256_unpackhi_epi32 (w, w)};
+        __m256i w0[2] = {_mm256_sub_epi16 (sixteen, w1[0]),
+                         _mm256_sub_epi16 (sixteen, w1[1])};
+
+        __m256i v[2];
+        for (int half = 0; half < 2; half++)
+        {
+            __m256i pa, pb, pc, pd;
+            if (!half)
+            {
+                pa = _mm256_unpacklo_epi8 (a, zero);
+                pb = _mm256_unpacklo_epi8 (b, zero);
+                pc = _mm256_unpacklo_epi8 (c, zero);
+                pd = _mm256_unpacklo_epi8 (d, zero);
+            }
+            else
+            {
+                pa = _mm256_unpackhi_epi8 (a, zero);
+                pb = _mm256_unpackhi_epi8 (b, zero);
+                pc = _mm256_unpackhi_epi8 (c, zero);
+                pd = _mm256_unpackhi_epi8 (d, zero);
+            }
+            __m256i h0 = _mm256_add_epi16 (_mm256_mullo_epi16 (pa, w0[half]),
+                                           _mm256_mullo_epi16 (pb, w1[half]));
+            __m256i h1 = _mm256_add_epi16 (_mm256_mullo_epi16 (pc, w0[half]),
+                                           _mm256_mullo_epi16 (pd, w1[half]));
+            v[half] = _mm256_add_epi16 (_mm256_mullo_epi16 (h0, vwy0),
+                                        _mm256_mullo_epi16 (h1, vwy1));
+            v[half] = _mm256_srli_epi16 (_mm256_add_epi16 (v[half], round),
+                                         8);
+        }
+        _mm256_storeu_si256 ((__m256i *) (out + j),
+                             _mm256_packus_epi16 (v[0], v[1]));
+    }
+    lerp_row_sse2 (r0, r1, x0 + j, x1 + j, wx + j, wy, out + j, n - j);
+}
+
+__attribute__ ((target ("avx2"))) static void
+over_row_avx2 (const guint32 *src,
+               const guint32 *bg,
+               guint32       *out,
+               int            n)
+{
+    const __m256i zero = _mm256_setzero_si256 ();
+    const __m256i c255 = _mm256_set1_epi16 (255);
+    const __m256i c128 = _mm256_set1_epi16 (128);
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256i s = _mm256_loadu_si256 ((const __m256i *) (src + j));
+        __m256i b = _mm256_loadu_si256 ((const __m256i *) (bg + j));
+        __m256i r[2];
+        for (int half = 0; half < 2; half++)
+        {
+            __m256i ps = half ? _mm256_unpackhi_epi8 (s, zero)
+                : _mm256_unpacklo_epi8 (s, zero);
+            __m256i pb = half ? _mm256_unpackhi_epi8 (b, zero)
+                : _mm256_unpacklo_epi8 (b, zero);
+            __m256i a = _mm256_shufflelo_epi16 (ps, _MM_SHUFFLE (3, 3, 3, 3));
+            a = _mm256_shufflehi_epi16 (a, _MM_SHUFFLE (3, 3, 3, 3));
+            __m256i t = _mm256_mullo_epi16 (pb, _mm256_sub_epi16 (c255, a));
+            t = _mm256_add_epi16 (t, c128);
+            t = _mm256_srli_epi16 (_mm256_add_epi16 (t,
+                                                     _mm256_srli_epi16 (t, 8)),
+                                   8);
+            r[half] = _mm256_add_epi16 (ps, t);
+        }
+        _mm256_storeu_si256 ((__m256i *) (out + j),
+                             _mm256_packus_epi16 (r[0], r[1]));
+    }
+    over_row_sse2 (src + j, bg + j, out + j, n - j);
+}
+
+static const PixopsKernels kernels_avx2 = {lerp_row_avx2, over_row_avx2};
+#endif
+
+/*************************************************************/
+/***** Kernel selection **************************************/
+/*************************************************************/
+static volatile gint current_impl = -1;
+
+/**
+ * pixops_get_best_impl:
+ * @returns: the fastest #PixopsImpl the CPU supports
+ *
+ * Detects which kernels the CPU supports and returns the fastest of
+ * them.
+ **/
+PixopsImpl
+pixops_get_best_impl (void)
+{
+#ifdef PIXOPS_HAVE_X86
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+        return PIXOPS_IMPL_AVX2;
+    if (__builtin_cpu_supports ("sse2"))
+        return PIXOPS_IMPL_SSE2;
+#endif
+    return PIXOPS_IMPL_C;
+}
+
+/**
+ * pixops_get_impl:
+ * @returns: the kernels pixops_scale_blend() uses
+ *
+ * Returns the kernels pixops_scale_blend() uses. Unless they have
+ * been set with pixops_set_impl(), they are the ones returned by
+ * pixops_get_best_impl().
+ **/
+PixopsImpl
+pixops_get_impl (void)
+{
+    gint impl = g_atomic_int_get (&current_impl);
+    if (impl < 0)
+    {
+        impl = pixops_get_best_impl ();
+        g_atomic_int_set (&current_impl, impl);
+    }
+    return impl;
+}
+
+/**
+ * pixops_set_impl:
+ * @impl: the kernels to use
+ * @returns: %TRUE if the kernels were set, %FALSE if the CPU does
+ *   not support them
+ *
+ * Sets which kernels pixops_scale_blend() uses. This is only useful
+ * to test and benchmark the kernels against each other. Setting
+ * %PIXOPS_IMPL_GENERIC makes all scaling go through gdk-pixbuf.
+ **/
+gboolean
+pixops_set_impl (PixopsImpl impl)
+{
+    if (impl > pixops_get_best_impl ())
+        return FALSE;
+    g_atomic_int_set (&current_impl, impl);
+    return TRUE;
+}
+
+/**
+ * pixops_impl_get_name:
+ * @impl: a #PixopsImpl
+ * @returns: a short name of @impl
+ *
+ * Returns the name of the kernels, for printing.
+ **/
+const char *
+pixops_impl_get_name (PixopsImpl impl)
+{
+    static const char *names[] = {"generic", "c", "sse2", "avx2"};
+    g_return_val_if_fail (impl <= PIXOPS_IMPL_AVX2, NULL);
+    return names[impl];
+}
+
+static const PixopsKernels *
+pixops_get_kernels (void)
+{
+    switch (pixops_get_impl ())
+    {
+#ifdef PIXOPS_HAVE_X86
+    case PIXOPS_IMPL_AVX2:
+        return &kernels_avx2;
+    case PIXOPS_IMPL_SSE2:
+        return &kernels_sse2;
+#endif
+    case PIXOPS_IMPL_C:
+        return &kernels_c;
+    default:
+        return NULL;
+    }
+}
+
+/*************************************************************/
+/***** Scaling ***********************************************/
+/*************************************************************/
+
+/* Two source rows converted to 32 bit pixels. Adjacent destination
+   rows mostly sample the same source rows, so they are kept until
+   they are not needed anymore. */
+typedef struct
+{
+    GdkPixbuf *src;
+    int        x;
+    int        width;
+    int        y[2];
+    guint32   *rows[2];
+} RowCache;
+
+static void
+row_cache_convert (RowCache *cache,
+                   int       slot,
+                   int       y)
+{
+    int n_chans = gdk_pixbuf_get_n_channels (cache->src);
+    const guchar *s = gdk_pixbuf_get_pixels (cache->src)
+        + y * gdk_pixbuf_get_rowstride (cache->src)
+        + cache->x * n_chans;
+    guchar *d = (guchar *) cache->rows[slot];
+    if (n_chans == 3)
+        for (int x = 0; x < cache->width; x++, s += 3, d += 4)
+        {
+            d[0] = s[0];
+            d[1] = s[1];
+            d[2] = s[2];
+            d[3] = 255;
+        }
+    else
+        for (int x = 0; x < cache->width; x++, s += 4, d += 4)
+        {
+            d[0] = div255 (s[0] * s[3]);
+            d[1] = div255 (s[1] * s[3]);
+            d[2] = div255 (s[2] * s[3]);
+            d[3] = s[3];
+        }
+    cache->y[slot] = y;
+}
+
+/**
+ * row_cache_get:
+ *
+ * Sets @r0 and @r1 to the converted source rows @y0 and @y1,
+ * converting them if they are not cached.
+ **/
+static void
+row_cache_get (RowCache       *cache,
+               int             y0,
+               int             y1,
+               const guint32 **r0,
+               const guint32 **r1)
+{
+    int s0 = cache->y[0] == y0 ? 0 : cache->y[1] == y0 ? 1 : -1;
+    int s1 = cache->y[0] == y1 ? 0 : cache->y[1] == y1 ? 1 : -1;
+    if (s0 < 0)
+    {
+        s0 = s1 == 0 ? 1 : 0;
+        row_cache_convert (cache, s0, y0);
+    }
+    if (s1 < 0)
+    {
+        s1 = !s0;
+        row_cache_convert (cache, s1, y1);
+    }
+    *r0 = cache->rows[s0];
+    *r1 = cache->rows[s1];
+}
+
+/**
+ * pixops_fill_checks:
+ *
+ * Fills @row with the checkerboard pixels of a destination row.
+ **/
+static void
+pixops_fill_checks (guint32 *row,
+                    int      n,
+                    int      check_x,
+                    int      check_shift,
+                    int      color1,
+                    int      color2)
+{
+    guint32 colors[2];
+    int cols[2] = {color1, color2};
+    for (int k = 0; k < 2; k++)
+    {
+        guchar *p = (guchar *) &colors[k];
+        p[0] = (cols[k] >> 16) & 0xff;
+        p[1] = (cols[k] >> 8) & 0xff;
+        p[2] = cols[k] & 0xff;
+        p[3] = 255;
+    }
+    for (int x = 0; x < n; x++)
+        row[x] = colors[((x + check_x) >> check_shift) & 1];
+}
+
+/**
+ * pixops_pack_row:
+ *
+ * Writes the color channels of the opaque 32 bit pixels in @src to
+ * the 24 bit pixels in @dst.
+ **/
+static void
+pixops_pack_row (const guint32 *src,
+                 guchar        *dst,
+                 int            n)
+{
+    const guchar *s = (const guchar *) src;
+    for (int j = 0; j < n; j++, s += 4, dst += 3)
+    {
+        dst[0] = s[0];
+        dst[1] = s[1];
+        dst[2] = s[2];
+    }
+}
+
+/**
+ * pixops_clamp_tap:
+ *
+ * Clamps the image coordinate @pos to the image, of size
+ * @image_size, and returns where it is in the area of it starting at
+ * @origin and @size pixels long. Coordinates outside of the area are
+ * clamped to it too.
+ **/
+static inline int
+pixops_clamp_tap (int pos,
+                  int image_size,
+                  int origin,
+                  int size)
+{
+    pos = CLAMP (pos, 0, image_size - 1) - origin;
+    return CLAMP (pos, 0, size - 1);
+}
+
+/**
+ * pixops_scale:
+ *
+ * Does the work of pixops_scale_blend(), pixops_scale_premultiplied()
+ * and pixops_scale_area(). @src holds the area of the image at
+ * @src_x, @src_y and the image is @image_width by @image_height
+ * pixels. Sources with alpha are composited over the checkerboard if
+ * @dst has no alpha channel, and stored premultiplied otherwise. Any
+ * interpolation other than %GDK_INTERP_NEAREST is done bilinearly.
+ **/
+static gboolean
+pixops_scale (const PixopsKernels *kernels,
+              GdkPixbuf           *src,
+              int                  src_x,
+              int                  src_y,
+              int                  image_width,
+              int                  image_height,
+              GdkPixbuf           *dst,
+              int                  dst_x,
+              int                  dst_y,
+              int                  dst_width,
+              int                  dst_height,
+              gdouble              offset_x,
+              gdouble              offset_y,
+              gdouble              zoom,
+              GdkInterpType        interp,
+              int                  check_x,
+              int                  check_y,
+              int                  check_size,
+              int                  color1,
+              int                  color2)
+{
+    gboolean has_alpha = gdk_pixbuf_get_has_alpha (src);
+    gboolean dst_alpha = gdk_pixbuf_get_has_alpha (dst);
+    if (gdk_pixbuf_get_colorspace (src) != GDK_COLORSPACE_RGB ||
+        gdk_pixbuf_get_bits_per_sample (src) != 8 ||
+        gdk_pixbuf_get_n_channels (src) != (has_alpha ? 4 : 3) ||
+        gdk_pixbuf_get_bits_per_sample (dst) != 8 ||
+        gdk_pixbuf_get_n_channels (dst) != (dst_alpha ? 4 : 3))
+        return FALSE;
+
+    gboolean nearest = interp == GDK_INTERP_NEAREST;
+
+    /* Destinations with alpha get the premultiplied pixels as they
+       are, without the checkerboard. */
+    gboolean blend = has_alpha && !dst_alpha;
+    int check_shift = 0;
+    if (blend)
+    {
+        if (check_size <= 0 || (check_size & (check_size - 1)))
+            return FALSE;
+        while ((1 << check_shift) < check_size)
+            check_shift++;
+    }
+    if (dst_width <= 0 || dst_height <= 0)
+        return TRUE;
+
+    int src_width = gdk_pixbuf_get_width (src);
+    int src_height = gdk_pixbuf_get_height (src);
+    /* gdk-pixbuf rounds the offsets to whole pixels. */
+    int render_x0 = dst_x - (int) floor (offset_x + 0.5);
+    int render_y0 = dst_y - (int) floor (offset_y + 0.5);
+    int step = (int) ((1 << SCALE_SHIFT) / zoom);
+    gint64 offset = nearest ? step / 2
+        : (gint64) floor (0.5 * (1 / zoom - 1) * (1 << SCALE_SHIFT));
+
+    /* Horizontal taps and weights are the same for all rows. */
+    int *x0 = g_new (int, dst_width * 2);
+    int *x1 = x0 + dst_width;
+    guint16 *wx = g_new (guint16, dst_width);
+    for (int j = 0; j < dst_width; j++)
+    {
+        gint64 x = (gint64) (render_x0 + j) * step + offset;
+        int xs = (int) (x >> SCALE_SHIFT);
+        x0[j] = pixops_clamp_tap (xs, image_width, src_x, src_width);
+        x1[j] = nearest ? x0[j]
+            : pixops_clamp_tap (xs + 1, image_width, src_x, src_width);
+        wx[j] = (x >> (SCALE_SHIFT - SUBSAMPLE_BITS)) & 15;
+    }
+    RowCache cache = {src, x0[0], x1[dst_width - 1] - x0[0] + 1, {-1, -1}};
+    for (int j = 0; j < dst_width; j++)
+    {
+        x0[j] -= cache.x;
+        x1[j] -= cache.x;
+    }
+    cache.rows[0] = g_new (guint32, cache.width * 2);
+    cache.rows[1] = cache.rows[0] + cache.width;
+
+    guint32 *out = g_new (guint32, dst_width * 3);
+    guint32 *checks[2] = {out + dst_width, out + dst_width * 2};
+    if (blend)
+    {
+        pixops_fill_checks (checks[0], dst_width, check_x, check_shift,
+                            color1, color2);
+        pixops_fill_checks (checks[1], dst_width, check_x, check_shift,
+                            color2, color1);
+    }
+
+    guchar *dst_pixels = gdk_pixbuf_get_pixels (dst)
+        + dst_y * gdk_pixbuf_get_rowstride (dst)
+        + dst_x * gdk_pixbuf_get_n_channels (dst);
+    for (int i = 0; i < dst_height; i++)
+    {
+        gint64 y = (gint64) (render_y0 + i) * step + offset;
+        int ys = (int) (y >> SCALE_SHIFT);
+        int y0 = pixops_clamp_tap (ys, image_height, src_y, src_height);
+        int y1 = nearest ? y0
+            : pixops_clamp_tap (ys + 1, image_height, src_y, src_height);
+        const guint32 *r0, *r1;
+        row_cache_get (&cache, y0, y1, &r0, &r1);
+
+        if (nearest)
+            for (int j = 0; j < dst_width; j++)
+                out[j] = r0[x0[j]];
+        else
+            kernels->lerp_row (r0, r1, x0, x1, wx,
+                               (y >> (SCALE_SHIFT - SUBSAMPLE_BITS)) & 15,
+                               out, dst_width);
+        if (blend)
+            kernels->over_row (out,
+                               checks[((i + check_y) >> check_shift) & 1],
+                               out, dst_width);
+
+        guchar *d = dst_pixels + i * gdk_pixbuf_get_rowstride (dst);
+        if (dst_alpha)
+            memcpy (d, out, dst_width * 4);
+        else
+            pixops_pack_row (out, d, dst_width);
+    }
+    g_free (out);
+    g_free (cache.rows[0]);
+    g_free (wx);
+    g_free (x0);
+    return TRUE;
+}
+
+/**
+ * pixops_get_kernels_for:
+ *
+ * Returns the kernels to scale with @interp at @zoom, or %NULL if
+ * gdk-pixbuf has been selected or if the case is left to it.
+ * gdk-pixbuf filters minified bilinear images with a box filter,
+ * which the kernels do not implement.
+ **/
+static const PixopsKernels *
+pixops_get_kernels_for (GdkInterpType interp,
+                        gdouble       zoom)
+{
+    if (interp != GDK_INTERP_NEAREST &&
+        !(interp == GDK_INTERP_BILINEAR && zoom > 1.0))
+        return NULL;
+    return pixops_get_kernels ();
+}
+
+/**
+ * pixops_scale_blend:
+ * @returns: %TRUE if the pixels were scaled, %FALSE if the case is
+ *   not supported
+ *
+ * Scales and composites exactly like gdk_pixbuf_scale_blend(), if
+ * the source, destination and interpolation is supported by the
+ * kernels. Otherwise does nothing and returns %FALSE.
+ **/
+gboolean
+pixops_scale_blend (GdkPixbuf    *src,
+                    GdkPixbuf    *dst,
+                    int           dst_x,
+                    int           dst_y,
+                    int           dst_width,
+                    int           dst_height,
+                    gdouble       offset_x,
+                    gdouble       offset_y,
+                    gdouble       zoom,
+                    GdkInterpType interp,
+                    int           check_x,
+                    int           check_y,
+                    int           check_size,
+                    int           color1,
+                    int           color2)
+{
+    const PixopsKernels *kernels = pixops_get_kernels_for (interp, zoom);
+    if (!kernels || gdk_pixbuf_get_has_alpha (dst))
+        return FALSE;
+    return pixops_scale (kernels, src, 0, 0,
+                         gdk_pixbuf_get_width (src),
+                         gdk_pixbuf_get_height (src),
+                         dst, dst_x, dst_y, dst_width, dst_height,
+                         offset_x, offset_y, zoom, interp,
+                         check_x, check_y, check_size, color1, color2);
+}
+
+/**
+ * pixops_scale_premultiplied:
+ * @returns: %TRUE if the pixels were scaled, %FALSE if the case is
+ *   not supported
+ *
+ * Scales like gdk_pixbuf_scale_premultiplied(), if the source,
+ * destination and interpolation is supported by the
+ * kernels. Otherwise does nothing and returns %FALSE.
+ **/
+gboolean
+pixops_scale_premultiplied (GdkPixbuf    *src,
+                            GdkPixbuf    *dst,
+                            int           dst_x,
+                            int           dst_y,
+                            int           dst_width,
+                            int           dst_height,
+                            gdouble       offset_x,
+                            gdouble       offset_y,
+                            gdouble       zoom,
+                            GdkInterpType interp)
+{
+    const PixopsKernels *kernels = pixops_get_kernels_for (interp, zoom);
+    if (!kernels || !gdk_pixbuf_get_has_alpha (dst))
+        return FALSE;
+    return pixops_scale (kernels, src, 0, 0,
+                         gdk_pixbuf_get_width (src),
+                         gdk_pixbuf_get_height (src),
+                         dst, dst_x, dst_y, dst_width, dst_height,
+                         offset_x, offset_y, zoom, interp,
+                         0, 0, 0, 0, 0);
+}
+
+/**
+ * pixops_scale_area:
+ * @src: an 8 bit RGB or RGBA #GdkPixbuf with the pixels of an area
+ *   of a larger image
+ * @src_x: left edge of the area in the image
+ * @src_y: top edge of the area in the image
+ * @image_width: width of the image
+ * @image_height: height of the image
+ * @returns: %TRUE if the pixels were scaled, %FALSE if the pixbufs or
+ *   @check_size are not supported
+ *
+ * Scales an image of which only the area in @src is in memory, as
+ * pixops_scale_blend() would scale the whole image, or as
+ * pixops_scale_premultiplied() would if @dst has alpha. The other
+ * arguments are the same as theirs. The pixels sampled and the edges
+ * the taps are clamped to are those of the whole image, so areas
+ * scaled from different parts of it fit together exactly. @src must
+ * hold all pixels the destination samples.
+ *
+ * There is no gdk-pixbuf fallback, so %GDK_INTERP_NEAREST is done
+ * with nearest neighbour and all other interpolations bilinearly,
+ * also when minifying. Minifying by more than a factor of two aliases
+ * and should be done from a downsampled image. The portable C
+ * kernels are used if gdk-pixbuf has been selected.
+ **/
+gboolean
+pixops_scale_area (GdkPixbuf    *src,
+                   int           src_x,
+                   int           src_y,
+                   int           image_width,
+                   int           image_height,
+                   GdkPixbuf    *dst,
+                   int           dst_x,
+                   int           dst_y,
+                   int           dst_width,
+                   int           dst_height,
+                   gdouble       offset_x,
+                   gdouble       offset_y,
+                   gdouble       zoom,
+                   GdkInterpType interp,
+                   int           check_x,
+                   int           check_y,
+                   int           check_size,
+                   int           color1,
+                   int           color2)
+{
+    const PixopsKernels *kernels = pixops_get_kernels ();
+    if (!kernels)
+        kernels = &kernels_c;
+    return pixops_scale (kernels, src, src_x, src_y,
+                         image_width, image_height,
+                         dst, dst_x, dst_y, dst_width, dst_height,
+                         offset_x, offset_y, zoom, interp,
+                         check_x, check_y, check_size, color1, color2);
+}
+
+/*************************************************************/
+/***** Compositing *******************************************/
+/*************************************************************/
+
+/**
+ * pixops_premultiply:
+ * @pixbuf: an 8 bit RGBA #GdkPixbuf
+ * @rect: the area to premultiply
+ *
+ * Multiplies the color channels of the pixels in @rect of @pixbuf
+ * by their alpha, so that they can be composited with
+ * pixops_composite_checks().
+ **/
+void
+pixops_premultiply (GdkPixbuf    *pixbuf,
+                    GdkRectangle *rect)
+{
+    g_return_if_fail (gdk_pixbuf_get_n_channels (pixbuf) == 4);
+    int rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+    guchar *base = gdk_pixbuf_get_pixels (pixbuf)
+        + rect->y * rowstride + rect->x * 4;
+    for (int y = 0; y < rect->height; y++)
+    {
+        guchar *p = base + y * rowstride;
+        for (int x = 0; x < rect->width; x++, p += 4)
+        {
+            p[0] = div255 (p[0] * p[3]);
+            p[1] = div255 (p[1] * p[3]);
+            p[2] = div255 (p[2] * p[3]);
+        }
+    }
+}
+
+/**
+ * pixops_composite_checks:
+ * @src: an 8 bit RGBA #GdkPixbuf with premultiplied pixels
+ * @src_x: left edge of the area to composite in @src
+ * @src_y: top edge of the area to composite in @src
+ * @width: width of the area
+ * @height: height of the area
+ * @dst: an 8 bit RGB #GdkPixbuf
+ * @dst_x: left edge of the area in @dst
+ * @dst_y: top edge of the area in @dst
+ * @check_x: horizontal checkerboard offset of the area
+ * @check_y: vertical checkerboard offset of the area
+ * @check_size: size of the checks, a power of two
+ * @color1: color of the check at the upper left
+ * @color2: color of the other check
+ *
+ * Composites premultiplied pixels, such as those scaled by
+ * pixops_scale_premultiplied(), over a checkerboard
+ * and stores the result in @dst. The checkerboard is the same as
+ * gdk_pixbuf_scale_blend() draws, so scaling with alpha first and
+ * compositing later gives the same pixels as doing both at once.
+ *
+ * Unlike scaling, this is always done with the kernels, using the
+ * portable C kernels if gdk-pixbuf has been selected.
+ **/
+void
+pixops_composite_checks (GdkPixbuf *src,
+                         int        src_x,
+                         int        src_y,
+                         int        width,
+                         int        height,
+                         GdkPixbuf *dst,
+                         int        dst_x,
+                         int        dst_y,
+                         int        check_x,
+                         int        check_y,
+                         int        check_size,
+                         int        color1,
+                         int        color2)
+{
+    g_return_if_fail (gdk_pixbuf_get_n_channels (src) == 4);
+    g_return_if_fail (gdk_pixbuf_get_n_channels (dst) == 3);
+    g_return_if_fail (check_size > 0 && !(check_size & (check_size - 1)));
+    if (width <= 0 || height <= 0)
+        return;
+
+    const PixopsKernels *kernels = pixops_get_kernels ();
+    if (!kernels)
+        kernels = &kernels_c;
+    int check_shift = 0;
+    while ((1 << check_shift) < check_size)
+        check_shift++;
+
+    guint32 *out = g_new (guint32, width * 3);
+    guint32 *checks[2] = {out + width, out + width * 2};
+    pixops_fill_checks (checks[0], width, check_x, check_shift,
+                        color1, color2);
+    pixops_fill_checks (checks[1], width, check_x, check_shift,
+                        color2, color1);
+
+    int src_stride = gdk_pixbuf_get_rowstride (src);
+    int dst_stride = gdk_pixbuf_get_rowstride (dst);
+    const guchar *s = gdk_pixbuf_get_pixels (src)
+        + src_y * src_stride + src_x * 4;
+    guchar *d = gdk_pixbuf_get_pixels (dst) + dst_y * dst_stride + dst_x * 3;
+    for (int i = 0; i < height; i++, s += src_stride, d += dst_stride)
+    {
+        /* Pixbuf rows are 4 byte aligned. */
+        kernels->over_row ((const guint32 *) s,
+                           checks[((i + check_y) >> check_shift) & 1],
+                           out, width);
+        pixops_pack_row (out, d, width);
+    }
+    g_free (out);
+}
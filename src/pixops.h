@@ -0,0 +1,106 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; coding: utf-8 -*-
+ *
+ * Copyright © 2007-2008 Björn Lindqvist <bjourne@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef __PIXOPS_H__
+#define __PIXOPS_H__
+
+#include <gdk/gdk.h>
+
+/**
+ * PixopsImpl:
+ * @PIXOPS_IMPL_GENERIC: Always scale with gdk-pixbuf.
+ * @PIXOPS_IMPL_C: Portable C kernels.
+ * @PIXOPS_IMPL_SSE2: SSE2 kernels.
+ * @PIXOPS_IMPL_AVX2: AVX2 kernels.
+ *
+ * The kernels used by pixops_scale_blend().
+ **/
+typedef enum
+{
+    PIXOPS_IMPL_GENERIC,
+    PIXOPS_IMPL_C,
+    PIXOPS_IMPL_SSE2,
+    PIXOPS_IMPL_AVX2
+} PixopsImpl;
+
+PixopsImpl    pixops_get_best_impl           (void);
+PixopsImpl    pixops_get_impl                (void);
+gboolean      pixops_set_impl                (PixopsImpl       impl);
+const char   *pixops_impl_get_name           (PixopsImpl       impl);
+gboolean      pixops_scale_blend             (GdkPixbuf       *src,
+                                              GdkPixbuf       *dst,
+                                              int              dst_x,
+                                              int              dst_y,
+                                              int              dst_width,
+                                              int              dst_height,
+                                              gdouble          offset_x,
+                                              gdouble          offset_y,
+                                              gdouble          zoom,
+                                              GdkInterpType    interp,
+                                              int              check_x,
+                                              int              check_y,
+                                              int              check_size,
+                                              int              color1,
+                                              int              color2);
+gboolean      pixops_scale_premultiplied     (GdkPixbuf       *src,
+                                              GdkPixbuf       *dst,
+                                              int              dst_x,
+                                              int              dst_y,
+                                              int              dst_width,
+                                              int              dst_height,
+                                              gdouble          offset_x,
+                                              gdouble          offset_y,
+                                              gdouble          zoom,
+                                              GdkInterpType    interp);
+gboolean      pixops_scale_area              (GdkPixbuf       *src,
+                                              int              src_x,
+                                              int              src_y,
+                                              int              image_width,
+                                              int              image_height,
+                                              GdkPixbuf       *dst,
+                                              int              dst_x,
+                                              int              dst_y,
+                                              int              dst_width,
+                                              int              dst_height,
+                                              gdouble          offset_x,
+                                              gdouble          offset_y,
+                                              gdouble          zoom,
+                                              GdkInterpType    interp,
+                                              int              check_x,
+                                              int              check_y,
+                                              int              check_size,
+                                              int              color1,
+                                              int              color2);
+void          pixops_premultiply             (GdkPixbuf       *pixbuf,
+                                              GdkRectangle    *rect);
+void          pixops_composite_checks        (GdkPixbuf       *src,
+                                              int              src_x,
+                                              int              src_y,
+                                              int              width,
+                                              int              height,
+                                              GdkPixbuf       *dst,
+                                              int              dst_x,
+                                              int              dst_y,
+                                              int              check_x,
+                                              int              check_y,
+                                              int              check_size,
+                                              int              color1,
+                                              int              color2);
+
+#endif
@@ -17,6 +17,8 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
  * 02111-1307, USA.
  */
+#include <math.h>
+#include "pixops.h"
 #include "utils.h"
 
 /**
@@ -63,7 +65,13 @@ gdk_pixbuf_shade (GdkPixbuf    *pixbuf,
  *
  * A utility function that either scales or composites color depending
  * on the number of channels in the source image. The last four
- * parameters are only used in the composite color case.
+ * parameters are only used in the composite color case. The common
+ * cases are handled by the kernels in pixops.c and the rest by
+ * gdk-pixbuf.
+ *
+ * If @dst has an alpha channel, the pixels written to it are still
+ * composited over the checkerboard and are opaque. Use
+ * gdk_pixbuf_scale_premultiplied() to keep the alpha.
  **/
 void
 gdk_pixbuf_scale_blend (GdkPixbuf    *src,
@@ -82,6 +90,10 @@ gdk_pixbuf_scale_blend (GdkPixbuf    *src,
                         int           color1,
                         int           color2)
 {
+    if (pixops_scale_blend (src, dst, dst_x, dst_y, dst_width, dst_height,
+                            offset_x, offset_y, zoom, interp,
+                            check_x, check_y, check_size, color1, color2))
+        return;
     if (gdk_pixbuf_get_has_alpha (src))
         gdk_pixbuf_composite_color (src, dst,
                                     dst_x, dst_y, dst_width, dst_height,
@@ -100,6 +112,255 @@ gdk_pixbuf_scale_blend (GdkPixbuf    *src,
                           interp);
 }
 
+/**
+ * gdk_pixbuf_scale_premultiplied:
+ *
+ * Scales like gdk_pixbuf_scale_blend() into @dst, which must have an
+ * alpha channel, but does not composite anything. The scaled pixels
+ * are stored premultiplied by alpha, ready for
+ * pixops_composite_checks().
+ **/
+void
+gdk_pixbuf_scale_premultiplied (GdkPixbuf    *src,
+                                GdkPixbuf    *dst,
+                                int           dst_x,
+                                int           dst_y,
+                                int           dst_width,
+                                int           dst_height,
+                                gdouble       offset_x,
+                                gdouble       offset_y,
+                                gdouble       zoom,
+                                GdkInterpType interp)
+{
+    g_return_if_fail (gdk_pixbuf_get_has_alpha (dst));
+    if (pixops_scale_premultiplied (src, dst,
+                                    dst_x, dst_y, dst_width, dst_height,
+                                    offset_x, offset_y, zoom, interp))
+        return;
+    gdk_pixbuf_scale (src, dst,
+                      dst_x, dst_y, dst_width, dst_height,
+                      offset_x, offset_y,
+                      zoom, zoom,
+                      interp);
+    GdkRectangle rect = {dst_x, dst_y, dst_width, dst_height};
+    pixops_premultiply (dst, &rect);
+}
+
+/* Bands less high than this are not worth handing off to a worker
+   thread. */
+#define SCALE_BAND_MIN_HEIGHT   32
+
+typedef struct
+{
+    GMutex *mutex;
+    GCond  *cond;
+    int     n_pending;
+} ScaleBatch;
+
+typedef struct
+{
+    ScaleBatch    *batch;
+    GdkPixbuf     *src;
+    GdkPixbuf     *dst;
+    int            dst_x;
+    int            dst_y;
+    int            dst_width;
+    int            dst_height;
+    gdouble        offset_x;
+    gdouble        offset_y;
+    gdouble        zoom;
+    GdkInterpType  interp;
+    int            check_x;
+    int            check_y;
+    int            check_size;
+    int            color1;
+    int            color2;
+    gboolean       premultiply;
+} ScaleBand;
+
+G_LOCK_DEFINE_STATIC (scale_pool);
+static GThreadPool *scale_pool = NULL;
+
+static void
+scale_band_run (ScaleBand *band)
+{
+    if (band->premultiply)
+    {
+        gdk_pixbuf_scale_premultiplied (band->src, band->dst,
+                                        band->dst_x, band->dst_y,
+                                        band->dst_width, band->dst_height,
+                                        band->offset_x, band->offset_y,
+                                        band->zoom,
+                                        band->interp);
+        return;
+    }
+    gdk_pixbuf_scale_blend (band->src, band->dst,
+                            band->dst_x, band->dst_y,
+                            band->dst_width, band->dst_height,
+                            band->offset_x, band->offset_y,
+                            band->zoom,
+                            band->interp,
+                            band->check_x, band->check_y,
+                            band->check_size,
+                            band->color1, band->color2);
+}
+
+static void
+scale_band_func (gpointer data,
+                 gpointer user_data)
+{
+    ScaleBand *band = data;
+    scale_band_run (band);
+
+    ScaleBatch *batch = band->batch;
+    g_mutex_lock (batch->mutex);
+    batch->n_pending--;
+    g_cond_signal (batch->cond);
+    g_mutex_unlock (batch->mutex);
+}
+
+static GThreadPool *
+scale_pool_get (int n_workers)
+{
+    G_LOCK (scale_pool);
+    if (!scale_pool)
+        scale_pool = g_thread_pool_new (scale_band_func, NULL,
+                                        n_workers, FALSE, NULL);
+    else if (g_thread_pool_get_max_threads (scale_pool) < n_workers)
+        g_thread_pool_set_max_threads (scale_pool, n_workers, NULL);
+    G_UNLOCK (scale_pool);
+    return scale_pool;
+}
+
+/**
+ * gdk_pixbuf_scale_bands:
+ *
+ * Splits the rectangle @whole is to scale in up to @n_threads
+ * horizontal bands that are scaled concurrently. The calling thread
+ * scales the first band and the rest are handed to a shared worker
+ * pool. The function returns when all bands are done.
+ **/
+static void
+gdk_pixbuf_scale_bands (ScaleBand *whole,
+                        int        n_threads)
+{
+    int n_bands = MIN (n_threads, whole->dst_height / SCALE_BAND_MIN_HEIGHT);
+    if (n_bands < 2 || !g_thread_supported ())
+    {
+        scale_band_run (whole);
+        return;
+    }
+
+    GThreadPool *pool = scale_pool_get (n_bands - 1);
+    ScaleBatch batch = {g_mutex_new (), g_cond_new (), n_bands - 1};
+    ScaleBand *bands = g_new (ScaleBand, n_bands);
+
+    int band_height = whole->dst_height / n_bands;
+    for (int n = 0; n < n_bands; n++)
+    {
+        int y = n * band_height;
+        bands[n] = *whole;
+        bands[n].batch = &batch;
+        bands[n].dst_y += y;
+        bands[n].dst_height = band_height;
+        if (n == n_bands - 1)
+            bands[n].dst_height = whole->dst_height - y;
+        bands[n].check_y += y;
+        if (n > 0)
+            g_thread_pool_push (pool, &bands[n], NULL);
+    }
+    scale_band_run (&bands[0]);
+
+    g_mutex_lock (batch.mutex);
+    while (batch.n_pending)
+        g_cond_wait (batch.cond, batch.mutex);
+    g_mutex_unlock (batch.mutex);
+
+    g_mutex_free (batch.mutex);
+    g_cond_free (batch.cond);
+    g_free (bands);
+}
+
+/**
+ * gdk_pixbuf_scale_blend_parallel:
+ * @n_threads: the number of threads to scale with
+ *
+ * Like gdk_pixbuf_scale_blend(), but splits the destination
+ * rectangle in up to @n_threads horizontal bands that are scaled
+ * concurrently.
+ *
+ * Each band writes to disjoint rows of @dst and uses the same offset
+ * as the whole rectangle would, with the checkerboard origin moved
+ * down by the band's position, so the result is bit-identical to
+ * what gdk_pixbuf_scale_blend() produces.
+ *
+ * If threads are not supported or g_thread_init() has not been
+ * called, or if the rectangle is too small to be worth splitting,
+ * the rectangle is scaled serially.
+ **/
+void
+gdk_pixbuf_scale_blend_parallel (GdkPixbuf    *src,
+                                 GdkPixbuf    *dst,
+                                 int           dst_x,
+                                 int           dst_y,
+                                 int           dst_width,
+                                 int           dst_height,
+                                 gdouble       offset_x,
+                                 gdouble       offset_y,
+                                 gdouble       zoom,
+                                 GdkInterpType interp,
+                                 int           check_x,
+                                 int           check_y,
+                                 int           check_size,
+                                 int           color1,
+                                 int           color2,
+                                 int           n_threads)
+{
+    ScaleBand whole = {NULL, src, dst,
+                       dst_x, dst_y,
+                       dst_width, dst_height,
+                       offset_x, offset_y,
+                       zoom,
+                       interp,
+                       check_x, check_y,
+                       check_size,
+                       color1, color2,
+                       FALSE};
+    gdk_pixbuf_scale_bands (&whole, n_threads);
+}
+
+/**
+ * gdk_pixbuf_scale_premultiplied_parallel:
+ * @n_threads: the number of threads to scale with
+ *
+ * Like gdk_pixbuf_scale_premultiplied(), but scales in up to
+ * @n_threads bands concurrently, like
+ * gdk_pixbuf_scale_blend_parallel() does.
+ **/
+void
+gdk_pixbuf_scale_premultiplied_parallel (GdkPixbuf    *src,
+                                         GdkPixbuf    *dst,
+                                         int           dst_x,
+                                         int           dst_y,
+                                         int           dst_width,
+                                         int           dst_height,
+                                         gdouble       offset_x,
+                                         gdouble       offset_y,
+                                         gdouble       zoom,
+                                         GdkInterpType interp,
+                                         int           n_threads)
+{
+    ScaleBand whole = {NULL, src, dst,
+                       dst_x, dst_y,
+                       dst_width, dst_height,
+                       offset_x, offset_y,
+                       zoom,
+                       interp,
+                       0, 0, 0, 0, 0,
+                       TRUE};
+    gdk_pixbuf_scale_bands (&whole, n_threads);
+}
+
 /**
  * gdk_rectangle_to_str:
  * @rect: a #GdkRectangle
@@ -241,3 +502,121 @@ gdk_rectangle_get_rects_around (GdkRectangle *outer,
     };
 }
 
+
+/**
+ * gdk_rectangles_merge:
+ * @rects: array of rectangles, modified in place
+ * @n_rects: number of rectangles in @rects
+ * @slack: number of pixels that may be painted needlessly to save
+ *   painting one rectangle
+ * @returns: the number of rectangles left in @rects
+ *
+ * Merges pairs of rectangles in @rects into their bounding box as long
+ * as the bounding box is at most @slack pixels larger than the two
+ * rectangles together. Painting a rectangle has a fixed cost, so
+ * painting a few extra pixels is cheaper than painting many small
+ * rectangles that lie close together.
+ **/
+int
+gdk_rectangles_merge (GdkRectangle *rects,
+                      int           n_rects,
+                      int           slack)
+{
+    gboolean merged = TRUE;
+    while (merged)
+    {
+        merged = FALSE;
+        for (int i = 0; i < n_rects && !merged; i++)
+            for (int j = i + 1; j < n_rects; j++)
+            {
+                GdkRectangle *r1 = &rects[i];
+                GdkRectangle *r2 = &rects[j];
+                GdkRectangle u;
+                gdk_rectangle_union (r1, r2, &u);
+                gint64 area = (gint64) r1->width * r1->height +
+                    (gint64) r2->width * r2->height;
+                if ((gint64) u.width * u.height > area + slack)
+                    continue;
+                *r1 = u;
+                *r2 = rects[--n_rects];
+                merged = TRUE;
+                break;
+            }
+    }
+    return n_rects;
+}
+
+/**
+ * gdk_rectangle_zoom:
+ * @rect: a rectangle in image space coordinates
+ * @zoom: the zoom factor
+ * @out: return location for the rectangle in zoom space coordinates
+ *
+ * Computes the smallest rectangle of whole pixels in zoom space that
+ * contains the area the pixels in @rect cover when the image is drawn
+ * at @zoom. Pixel x of the image covers the interval [x * zoom, (x +
+ * 1) * zoom) so the left edge is rounded down and the right edge up.
+ **/
+void
+gdk_rectangle_zoom (GdkRectangle *rect,
+                    gdouble       zoom,
+                    GdkRectangle *out)
+{
+    int x0 = (int) floor (rect->x * zoom);
+    int y0 = (int) floor (rect->y * zoom);
+    int x1 = (int) ceil ((rect->x + rect->width) * zoom);
+    int y1 = (int) ceil ((rect->y + rect->height) * zoom);
+    *out = (GdkRectangle){x0, y0, x1 - x0, y1 - y0};
+}
+
+/**
+ * gdk_rectangle_unzoom:
+ * @rect: a rectangle in zoom space coordinates
+ * @zoom: the zoom factor
+ * @out: return location for the rectangle in image space coordinates
+ *
+ * The inverse of gdk_rectangle_zoom(). Computes the smallest
+ * rectangle of whole image pixels that covers all of @rect when the
+ * image is drawn at @zoom.
+ **/
+void
+gdk_rectangle_unzoom (GdkRectangle *rect,
+                      gdouble       zoom,
+                      GdkRectangle *out)
+{
+    int x0 = (int) floor (rect->x / zoom);
+    int y0 = (int) floor (rect->y / zoom);
+    int x1 = (int) ceil ((rect->x + rect->width) / zoom);
+    int y1 = (int) ceil ((rect->y + rect->height) / zoom);
+    *out = (GdkRectangle){x0, y0, x1 - x0, y1 - y0};
+}
+
+/**
+ * gdk_pixbuf_get_scale_margin:
+ * @zoom: the zoom factor
+ * @interp: the interpolation the image is scaled with
+ * @extent: the largest zoom space coordinate that is drawn
+ * @returns: a number of zoom space pixels
+ *
+ * Returns how far outside of the area computed by
+ * gdk_rectangle_zoom() the drawn pixels may change when the pixels of
+ * the image inside it are modified.
+ *
+ * Filters other than %GDK_INTERP_NEAREST read a pixel or two around
+ * the one they sample. Besides, both gdk-pixbuf and pixops.c step
+ * through the image in 16.16 fixed point so the sample positions
+ * drift from the exact ones by up to 1/65536 image pixel for each
+ * pixel drawn. That drift is what the selector's zoom bug is about.
+ **/
+int
+gdk_pixbuf_get_scale_margin (gdouble       zoom,
+                             GdkInterpType interp,
+                             int           extent)
+{
+    gdouble pixels = ABS (extent) / 65536.0;
+    if (interp == GDK_INTERP_HYPER)
+        pixels += 2.0;
+    else if (interp != GDK_INTERP_NEAREST)
+        pixels += 1.0;
+    return (int) ceil (pixels * zoom) + 1;
+}
@@ -45,6 +45,46 @@ void          gdk_pixbuf_scale_blend         (GdkPixbuf       *src,
                                               int              check_size,
                                               int              color1,
                                               int              color2);
+void          gdk_pixbuf_scale_blend_parallel (GdkPixbuf      *src,
+                                               GdkPixbuf      *dst,
+                                               int             dst_x,
+                                               int             dst_y,
+                                               int             dst_width,
+                                               int             dst_height,
+                                               gdouble         offset_x,
+                                               gdouble         offset_y,
+                                               gdouble         zoom,
+                                               GdkInterpType   interp,
+                                               int             check_x,
+                                               int             check_y,
+                                               int             check_size,
+                                               int             color1,
+                                               int             color2,
+                                               int             n_threads);
+/* gdk_pixbuf_scale_blend() composites sources with alpha over the
+   checkerboard even if the destination has alpha. These scale to
+   premultiplied pixels with alpha instead. */
+void          gdk_pixbuf_scale_premultiplied (GdkPixbuf       *src,
+                                              GdkPixbuf       *dst,
+                                              int              dst_x,
+                                              int              dst_y,
+                                              int              dst_width,
+                                              int              dst_height,
+                                              gdouble          offset_x,
+                                              gdouble          offset_y,
+                                              gdouble          zoom,
+                                              GdkInterpType    interp);
+void          gdk_pixbuf_scale_premultiplied_parallel (GdkPixbuf *src,
+                                                       GdkPixbuf *dst,
+                                                       int        dst_x,
+                                                       int        dst_y,
+                                                       int        dst_width,
+                                                       int        dst_height,
+                                                       gdouble    offset_x,
+                                                       gdouble    offset_y,
+                                                       gdouble    zoom,
+                                                       GdkInterpType interp,
+                                                       int        n_threads);
 char         *gdk_rectangle_to_str           (GdkRectangle     rect);
 gboolean      gdk_rectangle_eq               (GdkRectangle     r1,
                                               GdkRectangle     r2);
@@ -67,5 +107,17 @@ void          gdk_draw_rect                  (GdkDrawable     *drawable,
 void          gdk_rectangle_get_rects_around (GdkRectangle    *outer,
                                               GdkRectangle    *inner,
                                               GdkRectangle     around[4]);
+int           gdk_rectangles_merge           (GdkRectangle    *rects,
+                                              int              n_rects,
+                                              int              slack);
+void          gdk_rectangle_zoom             (GdkRectangle    *rect,
+                                              gdouble          zoom,
+                                              GdkRectangle    *out);
+void          gdk_rectangle_unzoom           (GdkRectangle    *rect,
+                                              gdouble          zoom,
+                                              GdkRectangle    *out);
+int           gdk_pixbuf_get_scale_margin    (gdouble          zoom,
+                                              GdkInterpType    interp,
+                                              int              extent);
 
 #endif
@@ -0,0 +1,93 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; coding: utf-8 -*- */
+/**
+ * This program measures how long full viewport redraws take with
+ * each of the scaling kernels in pixops.c that the CPU supports,
+ * compared to scaling with gdk-pixbuf.
+ **/
+#include <src/pixops.h>
+#include <src/utils.h>
+#include <gtk/gtk.h>
+
+#define VIEWPORT_WIDTH      1024
+#define VIEWPORT_HEIGHT     768
+#define N_FRAMES            20
+
+static GdkPixbuf *
+random_pixbuf (gboolean has_alpha, int width, int height)
+{
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, has_alpha, 8,
+                                        width, height);
+    guchar *pixels = gdk_pixbuf_get_pixels (pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+    for (int n = 0; n < rowstride * height; n++)
+        pixels[n] = g_random_int_range (0, 256);
+    return pixbuf;
+}
+
+static gdouble
+time_redraws (GdkPixbuf     *src,
+              GdkPixbuf     *dst,
+              gdouble        zoom,
+              GdkInterpType  interp)
+{
+    GTimer *timer = g_timer_new ();
+    for (int n = 0; n < N_FRAMES; n++)
+        gdk_pixbuf_scale_blend (src, dst,
+                                0, 0, VIEWPORT_WIDTH, VIEWPORT_HEIGHT,
+                                -100.0, -100.0,
+                                zoom, interp,
+                                100, 100, 16,
+                                0x666666, 0x999999);
+    gdouble ms = g_timer_elapsed (timer, NULL) * 1000.0 / N_FRAMES;
+    g_timer_destroy (timer);
+    return ms;
+}
+
+int
+main (int argc, char *argv[])
+{
+    gtk_init (&argc, &argv);
+    struct
+    {
+        gdouble        zoom;
+        GdkInterpType  interp;
+        const char    *name;
+    } cases[] = {
+        {0.5, GDK_INTERP_NEAREST, "nearest"},
+        {1.0, GDK_INTERP_NEAREST, "nearest"},
+        {2.0, GDK_INTERP_BILINEAR, "bilinear"},
+        {3.3, GDK_INTERP_BILINEAR, "bilinear"}
+    };
+    PixopsImpl best = pixops_get_best_impl ();
+    GdkPixbuf *dst = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                     VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+
+    printf ("%-6s %-9s %5s %-8s %10s %8s\n",
+            "chans", "interp", "zoom", "kernels", "ms/frame", "speedup");
+    for (int alpha = 0; alpha < 2; alpha++)
+    {
+        GdkPixbuf *src = random_pixbuf (alpha, 2000, 1500);
+        for (int i = 0; i < G_N_ELEMENTS (cases); i++)
+        {
+            gdouble generic_ms = 0.0;
+            for (PixopsImpl impl = PIXOPS_IMPL_GENERIC; impl <= best; impl++)
+            {
+                pixops_set_impl (impl);
+                gdouble ms = time_redraws (src, dst,
+                                           cases[i].zoom, cases[i].interp);
+                if (impl == PIXOPS_IMPL_GENERIC)
+                    generic_ms = ms;
+                printf ("%-6d %-9s %5.2f %-8s %10.2f %7.2fx\n",
+                        alpha ? 4 : 3,
+                        cases[i].name,
+                        cases[i].zoom,
+                        pixops_impl_get_name (impl),
+                        ms,
+                        generic_ms / ms);
+            }
+        }
+        g_object_unref (src);
+    }
+    g_object_unref (dst);
+    return 0;
+}
@@ -0,0 +1,410 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; coding: utf-8 -*- */
+/**
+ * This program benchmarks the paths GtkImageView takes to render the
+ * image. GdkPixbufDrawCache is driven directly to measure full
+ * rescales and scrolls, and a GtkImageView in a window is scrolled
+ * and zoomed to measure complete exposes. Each benchmark is run over
+ * synthetic images of several sizes, with and without alpha and with
+ * each interpolation mode.
+ *
+ * The results are printed as CSV or JSON so that they can be
+ * compared between releases:
+ *
+ *     bench-render --format=json --frames=50 > results.json
+ **/
+#include <src/gtkimageview.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VIEWPORT_WIDTH      800
+#define VIEWPORT_HEIGHT     600
+
+/* Bytes allocated through GLib since the program started. Pixel data
+   of pixbufs is allocated through GLib too, so this includes scaled
+   tiles and other temporary pixbufs. Worker threads allocate as well,
+   so the counter is only updated atomically. GLib 2.46 and later
+   ignore g_mem_set_vtable(), in which case nothing is counted. */
+static volatile gpointer bytes_allocated = NULL;
+static gboolean counting = FALSE;
+
+/* Each block is prefixed with its size, so that reallocations only
+   count the bytes they add. The header is large enough to keep the
+   block suitably aligned. */
+#define HEADER_SIZE         16
+
+static void
+count_bytes (gsize n_bytes)
+{
+    gpointer old;
+    do
+        old = g_atomic_pointer_get (&bytes_allocated);
+    while (!g_atomic_pointer_compare_and_exchange
+           ((gpointer *) &bytes_allocated,
+            old, (gpointer) ((gsize) old + n_bytes)));
+}
+
+static gsize
+get_bytes_allocated (void)
+{
+    return (gsize) g_atomic_pointer_get (&bytes_allocated);
+}
+
+static gpointer
+block_init (guchar *block,
+            gsize   n_bytes)
+{
+    if (!block)
+        return NULL;
+    *(gsize *) block = n_bytes;
+    return block + HEADER_SIZE;
+}
+
+static gpointer
+counting_malloc (gsize n_bytes)
+{
+    count_bytes (n_bytes);
+    return block_init (malloc (n_bytes + HEADER_SIZE), n_bytes);
+}
+
+static gpointer
+counting_realloc (gpointer mem,
+                  gsize    n_bytes)
+{
+    if (!mem)
+        return counting_malloc (n_bytes);
+    guchar *block = (guchar *) mem - HEADER_SIZE;
+    gsize old_bytes = *(gsize *) block;
+    if (n_bytes > old_bytes)
+        count_bytes (n_bytes - old_bytes);
+    return block_init (realloc (block, n_bytes + HEADER_SIZE), n_bytes);
+}
+
+static gpointer
+counting_calloc (gsize n_blocks,
+                 gsize n_block_bytes)
+{
+    gsize n_bytes = n_blocks * n_block_bytes;
+    count_bytes (n_bytes);
+    return block_init (calloc (1, n_bytes + HEADER_SIZE), n_bytes);
+}
+
+static void
+counting_free (gpointer mem)
+{
+    if (mem)
+        free ((guchar *) mem - HEADER_SIZE);
+}
+
+static GMemVTable counting_vtable = {
+    counting_malloc,
+    counting_realloc,
+    counting_free,
+    counting_calloc,
+    NULL,
+    NULL
+};
+
+typedef struct
+{
+    const char    *name;
+    int            width;
+    int            height;
+    gboolean       has_alpha;
+    GdkInterpType  interp;
+    int            frames;
+    gdouble        seconds;
+    gsize          bytes;
+} BenchResult;
+
+typedef void (*BenchFunc) (GdkPixbuf     *pixbuf,
+                           GdkInterpType  interp,
+                           int            frame);
+
+static char *format = "csv";
+static int n_frames = 30;
+
+static GOptionEntry entries[] = {
+    {"format", 'f', 0, G_OPTION_ARG_STRING, &format,
+     "Output format, csv or json", "FORMAT"},
+    {"frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+     "Number of frames to render per benchmark", "N"},
+    {NULL}
+};
+
+static GdkPixbufDrawCache *cache = NULL;
+static GdkPixmap *pixmap = NULL;
+static GtkImageView *view = NULL;
+
+static const gdouble zooms[] = {0.25, 0.5, 1.0, 1.5, 2.0, 3.0};
+
+static GdkPixbuf *
+synthetic_pixbuf (gboolean has_alpha,
+                  int      width,
+                  int      height)
+{
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, has_alpha, 8,
+                                        width, height);
+    guchar *pixels = gdk_pixbuf_get_pixels (pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+    int n_chans = gdk_pixbuf_get_n_channels (pixbuf);
+    for (int y = 0; y < height; y++)
+    {
+        guchar *p = pixels + y * rowstride;
+        for (int x = 0; x < width; x++, p += n_chans)
+        {
+            p[0] = x;
+            p[1] = y;
+            p[2] = x ^ y;
+            if (has_alpha)
+                p[3] = (x + y) & 0xff;
+        }
+    }
+    return pixbuf;
+}
+
+/**
+ * bench_cache_scale:
+ *
+ * Draws the draw cache with a different zoom each frame, so that
+ * every frame takes the SCALE path.
+ **/
+static void
+bench_cache_scale (GdkPixbuf     *pixbuf,
+                   GdkInterpType  interp,
+                   int            frame)
+{
+    GdkPixbufDrawOpts opts = {
+        zooms[frame % G_N_ELEMENTS (zooms)],
+        (GdkRectangle){0, 0, VIEWPORT_WIDTH, VIEWPORT_HEIGHT},
+        0, 0,
+        interp,
+        pixbuf,
+        0x666666, 0x999999,
+        1, FALSE, 0, NULL
+    };
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+}
+
+/**
+ * bench_cache_scroll:
+ *
+ * Draws the draw cache at a fixed zoom with the area moved 16 pixels
+ * each frame, so that every frame takes the SCROLL path.
+ **/
+static void
+bench_cache_scroll (GdkPixbuf     *pixbuf,
+                    GdkInterpType  interp,
+                    int            frame)
+{
+    GdkPixbufDrawOpts opts = {
+        2.0,
+        (GdkRectangle){frame * 16, frame * 16,
+                       VIEWPORT_WIDTH, VIEWPORT_HEIGHT},
+        0, 0,
+        interp,
+        pixbuf,
+        0x666666, 0x999999,
+        1, FALSE, 0, NULL
+    };
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+}
+
+static void
+view_expose_now ()
+{
+    GtkWidget *widget = GTK_WIDGET (view);
+    gdk_window_process_updates (widget->window, TRUE);
+    gdk_flush ();
+}
+
+/**
+ * bench_view_offset:
+ *
+ * Scrolls the view 16 pixels diagonally each frame.
+ **/
+static void
+bench_view_offset (GdkPixbuf     *pixbuf,
+                   GdkInterpType  interp,
+                   int            frame)
+{
+    if (!frame)
+    {
+        gtk_image_view_set_interpolation (view, interp);
+        gtk_image_view_set_pixbuf (view, pixbuf, FALSE);
+        gtk_image_view_set_zoom (view, 2.0);
+        view_expose_now ();
+    }
+    gtk_image_view_set_offset (view, frame * 16, frame * 16, FALSE);
+    view_expose_now ();
+}
+
+/**
+ * bench_view_zoom:
+ *
+ * Sets a different zoom each frame.
+ **/
+static void
+bench_view_zoom (GdkPixbuf     *pixbuf,
+                 GdkInterpType  interp,
+                 int            frame)
+{
+    if (!frame)
+    {
+        gtk_image_view_set_interpolation (view, interp);
+        gtk_image_view_set_pixbuf (view, pixbuf, FALSE);
+        view_expose_now ();
+    }
+    gtk_image_view_set_zoom (view, zooms[frame % G_N_ELEMENTS (zooms)]);
+    view_expose_now ();
+}
+
+static void
+run_bench (const char    *name,
+           BenchFunc      func,
+           GdkPixbuf     *pixbuf,
+           GdkInterpType  interp,
+           BenchResult   *result)
+{
+    if (cache)
+        gdk_pixbuf_draw_cache_invalidate (cache);
+
+    /* The first frame sets things up and is not measured. */
+    func (pixbuf, interp, 0);
+
+    gsize bytes_before = get_bytes_allocated ();
+    GTimer *timer = g_timer_new ();
+    for (int n = 1; n <= n_frames; n++)
+        func (pixbuf, interp, n);
+    gdk_flush ();
+
+    result->name = name;
+    result->width = gdk_pixbuf_get_width (pixbuf);
+    result->height = gdk_pixbuf_get_height (pixbuf);
+    result->has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
+    result->interp = interp;
+    result->frames = n_frames;
+    result->seconds = g_timer_elapsed (timer, NULL);
+    result->bytes = get_bytes_allocated () - bytes_before;
+    g_timer_destroy (timer);
+}
+
+static const char *
+interp_name (GdkInterpType interp)
+{
+    switch (interp)
+    {
+    case GDK_INTERP_NEAREST:
+        return "nearest";
+    case GDK_INTERP_TILES:
+        return "tiles";
+    case GDK_INTERP_BILINEAR:
+        return "bilinear";
+    default:
+        return "hyper";
+    }
+}
+
+static void
+print_result (BenchResult *r,
+              gboolean     first)
+{
+    gdouble fps = r->frames / r->seconds;
+    gdouble ms = r->seconds * 1000.0 / r->frames;
+    char bytes[32];
+    if (counting)
+        g_snprintf (bytes, sizeof (bytes), "%lu", (unsigned long) r->bytes);
+    if (!strcmp (format, "json"))
+        printf ("%s\n  {\"benchmark\": \"%s\", \"width\": %d, \"height\": %d, "
+                "\"channels\": %d, \"interp\": \"%s\", \"frames\": %d, "
+                "\"fps\": %.2f, \"ms_per_frame\": %.3f, "
+                "\"bytes_allocated\": %s}",
+                first ? "[" : ",",
+                r->name, r->width, r->height, r->has_alpha ? 4 : 3,
+                interp_name (r->interp), r->frames, fps, ms,
+                counting ? bytes : "\"n/a\"");
+    else
+    {
+        if (first)
+            printf ("benchmark,width,height,channels,interp,frames,"
+                    "fps,ms_per_frame,bytes_allocated\n");
+        printf ("%s,%d,%d,%d,%s,%d,%.2f,%.3f,%s\n",
+                r->name, r->width, r->height, r->has_alpha ? 4 : 3,
+                interp_name (r->interp), r->frames, fps, ms,
+                counting ? bytes : "n/a");
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+    /* Must be set before GLib allocates anything. */
+    g_mem_set_vtable (&counting_vtable);
+    g_free (g_malloc (1));
+    counting = get_bytes_allocated () != 0;
+
+    GError *error = NULL;
+    if (!gtk_init_with_args (&argc, &argv, "- benchmark rendering",
+                             entries, NULL, &error))
+    {
+        fprintf (stderr, "%s\n", error->message);
+        return 1;
+    }
+    if (strcmp (format, "csv") && strcmp (format, "json"))
+    {
+        fprintf (stderr, "Unknown format %s\n", format);
+        return 1;
+    }
+
+    struct
+    {
+        const char *name;
+        BenchFunc   func;
+    } benches[] = {
+        {"cache-scale", bench_cache_scale},
+        {"cache-scroll", bench_cache_scroll},
+        {"view-offset", bench_view_offset},
+        {"view-zoom", bench_view_zoom}
+    };
+    Size sizes[] = {{256, 256}, {1024, 768}, {4000, 3000}};
+    GdkInterpType interps[] = {GDK_INTERP_NEAREST, GDK_INTERP_BILINEAR};
+
+    cache = gdk_pixbuf_draw_cache_new ();
+    pixmap = gdk_pixmap_new (NULL, VIEWPORT_WIDTH, VIEWPORT_HEIGHT,
+                             gdk_visual_get_system ()->depth);
+
+    GtkWidget *window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+    view = GTK_IMAGE_VIEW (gtk_image_view_new ());
+    gtk_widget_set_size_request (GTK_WIDGET (view),
+                                 VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+    gtk_container_add (GTK_CONTAINER (window), GTK_WIDGET (view));
+    gtk_widget_show_all (window);
+    while (gtk_events_pending ())
+        gtk_main_iteration ();
+
+    gboolean first = TRUE;
+    for (int s = 0; s < G_N_ELEMENTS (sizes); s++)
+        for (int alpha = 0; alpha < 2; alpha++)
+        {
+            GdkPixbuf *pixbuf = synthetic_pixbuf (alpha,
+                                                  sizes[s].width,
+                                                  sizes[s].height);
+            for (int i = 0; i < G_N_ELEMENTS (interps); i++)
+                for (int b = 0; b < G_N_ELEMENTS (benches); b++)
+                {
+                    BenchResult result;
+                    run_bench (benches[b].name, benches[b].func,
+                               pixbuf, interps[i], &result);
+                    print_result (&result, first);
+                    first = FALSE;
+                }
+            gtk_image_view_set_pixbuf (view, NULL, FALSE);
+            g_object_unref (pixbuf);
+        }
+    if (!strcmp (format, "json"))
+        printf ("\n]\n");
+
+    gtk_widget_destroy (window);
+    gdk_pixbuf_draw_cache_free (cache);
+    g_object_unref (pixmap);
+    return 0;
+}
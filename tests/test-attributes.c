@@ -44,6 +44,18 @@ test_default_state ()
     assert (gtk_image_view_get_show_cursor (view));
     assert (gtk_image_view_get_show_frame (view));
     assert (gtk_image_view_get_zoom (view) == (gdouble) 1.0);
+    assert (!gtk_image_view_get_refine_delay (view));
+    assert (!gtk_image_view_get_zoom_duration (view));
+    assert (!gtk_image_view_get_continuous_zoom (view));
+    assert (!gtk_image_view_get_async (view));
+    assert (!gtk_image_view_get_use_pyramid (view));
+    assert (!gtk_image_view_get_shared_tiles (view));
+
+    GdkPixbufDrawStats stats;
+    gtk_image_view_get_stats (view, &stats);
+    assert (!stats.n_exposes);
+    assert (!stats.n_pixels_scaled);
+    assert (!stats.n_pixels_saved);
     
     // Test inherited attributes.
     GtkWidget *widget = (GtkWidget *) view;
@@ -4,7 +4,13 @@
  * class works correctly.
  **/
 #include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <src/gdkpixbufmemory.h>
+#include <src/gtkimagesourcemapped.h>
 #include <src/gtkimageview.h>
+#include <src/utils.h>
 
 /**
  * test_only_scale_op_on_new_identical_pixbuf:
@@ -165,9 +171,806 @@ test_invalidate ()
     g_object_unref (pb);
 }
 
+/**
+ * test_tiles_reused_when_returning_to_zoom:
+ *
+ * The objective of this test is to verify that no new tiles are
+ * scaled when switching back to a zoom level that was drawn before.
+ **/
+static void
+test_tiles_reused_when_returning_to_zoom ()
+{
+    printf ("test_tiles_reused_when_returning_to_zoom\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 300, 300,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 600, 600);
+
+    GdkPixbufDrawOpts o1 = {1, (GdkRectangle){100, 100, 300, 300},
+                            0, 0, GDK_INTERP_BILINEAR, pb, 0, 0};
+    GdkPixbufDrawOpts o2 = {0.25, (GdkRectangle){0, 0, 150, 150},
+                            0, 0, GDK_INTERP_BILINEAR, pb, 0, 0};
+
+    gdk_pixbuf_draw_cache_draw (cache, &o1, pixmap);
+    int n_tiles = g_hash_table_size (cache->store->tiles);
+    assert (n_tiles == 4);
+
+    gdk_pixbuf_draw_cache_draw (cache, &o2, pixmap);
+    assert (g_hash_table_size (cache->store->tiles) == n_tiles + 1);
+
+    /* Back to zoom 1, everything should come from the tiles. */
+    gsize size = cache->store->size;
+    gdk_pixbuf_draw_cache_draw (cache, &o1, pixmap);
+    assert (g_hash_table_size (cache->store->tiles) == n_tiles + 1);
+    assert (cache->store->size == size);
+
+    gdk_pixbuf_draw_cache_free (cache);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+/**
+ * test_tiles_evicted_when_over_max_size:
+ *
+ * The objective of this test is to verify that the draw cache only
+ * holds more tile memory than its limit while the tiles are those of
+ * the latest draw, and that a limit of 0 turns off tile caching.
+ **/
+static void
+test_tiles_evicted_when_over_max_size ()
+{
+    printf ("test_tiles_evicted_when_over_max_size\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 600, 600,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 600, 600);
+    GdkPixbufDrawOpts opts = {1, (GdkRectangle){0, 0, 600, 600},
+                              0, 0, GDK_INTERP_BILINEAR, pb, 0, 0};
+
+    gsize max_size = 256 * 256 * 3 * 2;
+    gdk_pixbuf_draw_cache_set_max_size (cache, max_size);
+    /* All nine tiles are needed by the draw. */
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (cache->store->size > max_size);
+    assert (g_hash_table_size (cache->store->tiles) == 9);
+
+    /* They are evicted once another draw needs the memory. */
+    opts.zoom = 0.5;
+    opts.zoom_rect = (GdkRectangle){0, 0, 300, 300};
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (g_hash_table_size (cache->store->tiles) == 4);
+
+    gdk_pixbuf_draw_cache_set_max_size (cache, 0);
+    assert (!cache->store->size);
+    gdk_pixbuf_draw_cache_invalidate (cache);
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (!g_hash_table_size (cache->store->tiles));
+
+    gdk_pixbuf_draw_cache_free (cache);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+static void
+count_ready_cb (GdkPixbufDrawCache *cache,
+                GdkRectangle       *zoom_rect,
+                gpointer            data)
+{
+    (*(int *) data)++;
+}
+
+/**
+ * test_async_draw_scales_tiles_in_workers:
+ *
+ * The objective of this test is to verify that an asynchronous draw
+ * does not scale any tiles itself, but that they are added to the
+ * cache and reported once the worker threads are done.
+ **/
+static void
+test_async_draw_scales_tiles_in_workers ()
+{
+    printf ("test_async_draw_scales_tiles_in_workers\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 300, 300,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 600, 600);
+    GdkPixbufDrawOpts opts = {1, (GdkRectangle){100, 100, 300, 300},
+                              0, 0, GDK_INTERP_BILINEAR, pb, 0, 0,
+                              2, TRUE, 1};
+    int n_ready = 0;
+    gdk_pixbuf_draw_cache_set_ready_func (cache, count_ready_cb, &n_ready);
+
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (!g_hash_table_size (cache->store->tiles));
+    assert (g_hash_table_size (cache->jobs) == 4);
+
+    /* Low quality pixels must not be reused. */
+    assert (gdk_pixbuf_draw_cache_get_method (&cache->old, &opts) ==
+            GDK_PIXBUF_DRAW_METHOD_SCALE);
+
+    while (n_ready < 4)
+        g_main_context_iteration (NULL, TRUE);
+    assert (g_hash_table_size (cache->store->tiles) == 4);
+    assert (!g_hash_table_size (cache->jobs));
+
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (gdk_pixbuf_draw_cache_get_method (&cache->old, &opts) ==
+            GDK_PIXBUF_DRAW_METHOD_CONTAINS);
+
+    gdk_pixbuf_draw_cache_free (cache);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+/**
+ * test_async_draw_over_memory_limit:
+ *
+ * The objective of this test is to verify that when the memory limit
+ * is lower than even the draw buffer, tiles scaled asynchronously are
+ * kept until they have been drawn instead of being evicted and
+ * requested again forever.
+ **/
+static void
+test_async_draw_over_memory_limit ()
+{
+    printf ("test_async_draw_over_memory_limit\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 300, 300,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 600, 600);
+    GdkPixbufDrawOpts opts = {1, (GdkRectangle){100, 100, 300, 300},
+                              0, 0, GDK_INTERP_BILINEAR, pb, 0, 0,
+                              2, TRUE, 1};
+    int n_ready = 0;
+    gdk_pixbuf_draw_cache_set_ready_func (cache, count_ready_cb, &n_ready);
+    gdk_pixbuf_memory_set_limit (300 * 300);
+
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (g_hash_table_size (cache->jobs) == 4);
+    while (n_ready < 4)
+        g_main_context_iteration (NULL, TRUE);
+    assert (g_hash_table_size (cache->store->tiles) == 4);
+
+    /* Redrawing finds all tiles and requests none again. */
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (!g_hash_table_size (cache->jobs));
+    assert (!cache->incomplete);
+
+    /* Once they are not the latest draw's, they are evicted. */
+    opts.zoom = 0.5;
+    opts.zoom_rect = (GdkRectangle){0, 0, 256, 256};
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    while (n_ready < 5)
+        g_main_context_iteration (NULL, TRUE);
+    assert (g_hash_table_size (cache->store->tiles) == 1);
+
+    gdk_pixbuf_memory_set_limit (0);
+    gdk_pixbuf_draw_cache_free (cache);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+/**
+ * test_pyramid_levels:
+ *
+ * The objective of this test is to verify that each level of a
+ * GdkPixbufPyramid is half the size of the one before it and that
+ * its pixels are the averages of 2x2 blocks.
+ **/
+static void
+test_pyramid_levels ()
+{
+    printf ("test_pyramid_levels\n");
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 5, 4);
+    guchar *pixels = gdk_pixbuf_get_pixels (pb);
+    int stride = gdk_pixbuf_get_rowstride (pb);
+    for (int y = 0; y < 4; y++)
+        for (int x = 0; x < 5; x++)
+            for (int c = 0; c < 3; c++)
+                pixels[y * stride + x * 3 + c] = (x + y) * 10;
+
+    GdkPixbufPyramid *pyramid = gdk_pixbuf_pyramid_new (pb);
+    assert (pyramid->n_levels == 4);
+    assert (gdk_pixbuf_pyramid_get_level (pyramid, 0) == pb);
+
+    GdkPixbuf *level = gdk_pixbuf_pyramid_get_level (pyramid, 1);
+    assert (gdk_pixbuf_get_width (level) == 3);
+    assert (gdk_pixbuf_get_height (level) == 2);
+    guchar *p = gdk_pixbuf_get_pixels (level);
+    /* (0 + 10 + 10 + 20) / 4 */
+    assert (p[0] == 10);
+    /* The last column only covers column 4 of the pixbuf. */
+    assert (p[2 * 3] == (40 + 40 + 50 + 50) / 4);
+
+    level = gdk_pixbuf_pyramid_get_level (pyramid, 3);
+    assert (gdk_pixbuf_get_width (level) == 1);
+    assert (gdk_pixbuf_get_height (level) == 1);
+
+    assert (gdk_pixbuf_pyramid_get_level_for_zoom (pyramid, 1.0) == 0);
+    assert (gdk_pixbuf_pyramid_get_level_for_zoom (pyramid, 0.6) == 0);
+    assert (gdk_pixbuf_pyramid_get_level_for_zoom (pyramid, 0.5) == 1);
+    assert (gdk_pixbuf_pyramid_get_level_for_zoom (pyramid, 0.3) == 1);
+    assert (gdk_pixbuf_pyramid_get_level_for_zoom (pyramid, 0.25) == 2);
+    assert (gdk_pixbuf_pyramid_get_level_for_zoom (pyramid, 0.01) == 3);
+
+    /* Damaged pixels are propagated to the built levels. */
+    memset (pixels, 0, stride * 4);
+    gdk_pixbuf_pyramid_damage (pyramid, &(GdkRectangle){0, 0, 2, 2});
+    p = gdk_pixbuf_get_pixels (gdk_pixbuf_pyramid_get_level (pyramid, 1));
+    assert (p[0] == 0);
+    assert (p[3] != 0);
+
+    gdk_pixbuf_pyramid_free (pyramid);
+    g_object_unref (pb);
+}
+
+/**
+ * test_draw_from_pyramid:
+ *
+ * The objective of this test is to verify that a zoomed out draw
+ * with a pyramid is scaled from a pyramid level and that turning the
+ * pyramid off forces a rescale.
+ **/
+static void
+test_draw_from_pyramid ()
+{
+    printf ("test_draw_from_pyramid\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 100, 100,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 400, 400);
+    gdk_pixbuf_fill (pb, 0x336699ff);
+    GdkPixbufPyramid *pyramid = gdk_pixbuf_pyramid_new (pb);
+    GdkPixbufDrawOpts opts = {0.25, (GdkRectangle){0, 0, 100, 100},
+                              0, 0, GDK_INTERP_BILINEAR, pb, 0, 0,
+                              1, FALSE, 0, pyramid};
+
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (pyramid->levels[2]);
+    guchar *p = gdk_pixbuf_get_pixels (cache->last_pixbuf);
+    assert (p[0] == 0x33 && p[1] == 0x66 && p[2] == 0x99);
+
+    GdkPixbufDrawOpts no_pyramid = opts;
+    no_pyramid.pyramid = NULL;
+    assert (gdk_pixbuf_draw_cache_get_method (&cache->old, &no_pyramid) ==
+            GDK_PIXBUF_DRAW_METHOD_SCALE);
+
+    gdk_pixbuf_draw_cache_free (cache);
+    gdk_pixbuf_pyramid_free (pyramid);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+/**
+ * test_async_draw_from_pyramid_with_check_colors:
+ *
+ * The objective of this test is to verify that tiles scaled
+ * asynchronously from a pyramid level of a transparent pixbuf, drawn
+ * with distinct check colors, are reported as ready and used by the
+ * next draw.
+ **/
+static void
+test_async_draw_from_pyramid_with_check_colors ()
+{
+    printf ("test_async_draw_from_pyramid_with_check_colors\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 200, 200,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 800, 800);
+    gdk_pixbuf_fill (pb, 0x33669980);
+    GdkPixbufPyramid *pyramid = gdk_pixbuf_pyramid_new (pb);
+    GdkPixbufDrawOpts opts = {0.25, (GdkRectangle){0, 0, 200, 200},
+                              0, 0, GDK_INTERP_BILINEAR, pb,
+                              0x777777, 0xcccccc,
+                              2, TRUE, 1, pyramid};
+    int n_ready = 0;
+    gdk_pixbuf_draw_cache_set_ready_func (cache, count_ready_cb, &n_ready);
+
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    int n_jobs = g_hash_table_size (cache->jobs);
+    assert (n_jobs);
+    while (n_ready < n_jobs)
+        g_main_context_iteration (NULL, TRUE);
+    assert (g_hash_table_size (cache->store->tiles) == n_jobs);
+
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (!g_hash_table_size (cache->jobs));
+    assert (gdk_pixbuf_draw_cache_get_method (&cache->old, &opts) ==
+            GDK_PIXBUF_DRAW_METHOD_CONTAINS);
+
+    gdk_pixbuf_draw_cache_free (cache);
+    gdk_pixbuf_pyramid_free (pyramid);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+static void
+count_pyramid_ready_cb (GdkPixbufPyramid *pyramid,
+                        gpointer          data)
+{
+    (*(int *) data)++;
+}
+
+/**
+ * test_async_draw_builds_pyramid_levels_in_worker:
+ *
+ * The objective of this test is to verify that asynchronous draws do
+ * not build missing pyramid levels themselves, but fill in from a
+ * larger level until a worker thread has built them.
+ **/
+static void
+test_async_draw_builds_pyramid_levels_in_worker ()
+{
+    printf ("test_async_draw_builds_pyramid_levels_in_worker\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 200, 200,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 800, 800);
+    GdkPixbufPyramid *pyramid = gdk_pixbuf_pyramid_new (pb);
+    GdkPixbufDrawOpts opts = {0.25, (GdkRectangle){0, 0, 200, 200},
+                              0, 0, GDK_INTERP_BILINEAR, pb, 0, 0,
+                              2, TRUE, 1, pyramid};
+    int n_ready = 0, n_levels_ready = 0;
+    gdk_pixbuf_draw_cache_set_ready_func (cache, count_ready_cb, &n_ready);
+    gdk_pixbuf_pyramid_set_ready_func (pyramid, count_pyramid_ready_cb,
+                                       &n_levels_ready);
+
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (!pyramid->levels[2]);
+    assert (pyramid->job);
+    assert (!g_hash_table_size (cache->jobs));
+    assert (cache->incomplete);
+
+    while (!n_levels_ready)
+        g_main_context_iteration (NULL, TRUE);
+    assert (pyramid->levels[1] && pyramid->levels[2]);
+    assert (!pyramid->job);
+
+    /* Now the tiles are scaled from the right level. */
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (g_hash_table_size (cache->jobs));
+
+    gdk_pixbuf_draw_cache_free (cache);
+    gdk_pixbuf_pyramid_free (pyramid);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+/**
+ * test_stats_count_draws:
+ *
+ * The objective of this test is to verify that the draw statistics
+ * count which draw method was used and how many pixels were scaled
+ * and drawn.
+ **/
+static void
+test_stats_count_draws ()
+{
+    printf ("test_stats_count_draws\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 100, 100,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 300, 300);
+    GdkPixbufDrawStats stats = {{0}};
+    GdkPixbufDrawOpts opts = {1, (GdkRectangle){0, 0, 100, 100},
+                              0, 0, GDK_INTERP_NEAREST, pb, 0, 0,
+                              1, FALSE, 0, NULL, &stats};
+
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (stats.n_draws[GDK_PIXBUF_DRAW_METHOD_SCALE] == 1);
+    assert (stats.n_pixels_drawn == 100 * 100);
+    /* A whole tile is scaled. */
+    assert (stats.n_pixels_scaled == 256 * 256);
+    assert (stats.cache_size == cache->store->size);
+
+    assert (stats.n_pixels_uploaded == 100 * 100);
+
+    /* Redrawing the same area is a copy on the server. */
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (stats.n_draws[GDK_PIXBUF_DRAW_METHOD_CONTAINS] == 1);
+    assert (stats.n_pixels_scaled == 256 * 256);
+    assert (stats.n_pixels_uploaded == 100 * 100);
+
+    opts.zoom_rect.x = 10;
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (stats.n_draws[GDK_PIXBUF_DRAW_METHOD_SCROLL] == 1);
+    /* The strip still comes from the cached tile. */
+    assert (stats.n_pixels_scaled == 256 * 256);
+    assert (stats.n_pixels_drawn == 3 * 100 * 100);
+    /* Only the newly exposed strip is uploaded. */
+    assert (stats.n_pixels_uploaded == 100 * 100 + 10 * 100);
+
+    gdk_pixbuf_draw_cache_free (cache);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+/**
+ * test_check_colors_do_not_rescale:
+ *
+ * The objective of this test is to verify that tiles of pixbufs with
+ * alpha are kept without the checkerboard, so that changing the
+ * check colors only composites the cached tiles again, and that the
+ * result looks like scaling and compositing in one go.
+ **/
+static void
+test_check_colors_do_not_rescale ()
+{
+    printf ("test_check_colors_do_not_rescale\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 100, 100,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 300, 300);
+    guchar *pixels = gdk_pixbuf_get_pixels (pb);
+    int rowstride = gdk_pixbuf_get_rowstride (pb);
+    for (int n = 0; n < rowstride * 300; n++)
+        pixels[n] = g_random_int_range (0, 256);
+    GdkPixbufDrawStats stats = {{0}};
+    GdkPixbufDrawOpts opts = {1, (GdkRectangle){0, 0, 100, 100},
+                              0, 0, GDK_INTERP_NEAREST, pb,
+                              0x666666, 0x999999,
+                              1, FALSE, 0, NULL, &stats};
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    guint64 n_scaled = stats.n_pixels_scaled;
+
+    opts.check_color1 = 0xff0000;
+    opts.check_color2 = 0x0000ff;
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (stats.n_draws[GDK_PIXBUF_DRAW_METHOD_SCALE] == 2);
+    assert (stats.n_pixels_scaled == n_scaled);
+
+    GdkPixbuf *expected = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                          100, 100);
+    gdk_pixbuf_scale_blend (pb, expected, 0, 0, 100, 100, 0, 0, 1,
+                            GDK_INTERP_NEAREST, 0, 0, 16,
+                            0xff0000, 0x0000ff);
+    for (int y = 0; y < 100; y++)
+    {
+        guchar *e = gdk_pixbuf_get_pixels (expected) +
+            y * gdk_pixbuf_get_rowstride (expected);
+        guchar *a = gdk_pixbuf_get_pixels (cache->last_pixbuf) +
+            y * gdk_pixbuf_get_rowstride (cache->last_pixbuf);
+        for (int x = 0; x < 100 * 3; x++)
+            assert (ABS (e[x] - a[x]) <= 2);
+    }
+
+    g_object_unref (expected);
+    gdk_pixbuf_draw_cache_free (cache);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+/**
+ * test_invalidate_area:
+ *
+ * The objective of this test is to verify that invalidating an area
+ * of the pixbuf only discards the tiles scaled from it.
+ **/
+static void
+test_invalidate_area ()
+{
+    printf ("test_invalidate_area\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 512, 512,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 600, 600);
+    GdkPixbufDrawOpts opts = {1, (GdkRectangle){0, 0, 512, 512},
+                              0, 0, GDK_INTERP_BILINEAR, pb, 0, 0};
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (g_hash_table_size (cache->store->tiles) == 4);
+
+    gdk_pixbuf_draw_cache_invalidate_area (cache,
+                                           &(GdkRectangle){10, 10, 5, 5});
+    assert (g_hash_table_size (cache->store->tiles) == 3);
+    assert (gdk_pixbuf_draw_cache_get_method (&cache->old, &opts) ==
+            GDK_PIXBUF_DRAW_METHOD_SCALE);
+
+    /* Pixels on the border between tiles are read by both. */
+    gdk_pixbuf_draw_cache_invalidate_area (cache,
+                                           &(GdkRectangle){256, 300, 1, 1});
+    assert (g_hash_table_size (cache->store->tiles) == 1);
+
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (g_hash_table_size (cache->store->tiles) == 4);
+
+    gdk_pixbuf_draw_cache_free (cache);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+/**
+ * test_preview_rescales_last_draw:
+ *
+ * The objective of this test is to verify that preview draws are
+ * rescaled with nearest neighbour from the last full quality draw
+ * without adding tiles, and that the next full quality draw scales
+ * or copies tiles again.
+ **/
+static void
+test_preview_rescales_last_draw ()
+{
+    printf ("test_preview_rescales_last_draw\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 100, 100,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 300, 300);
+    guchar *pixels = gdk_pixbuf_get_pixels (pb);
+    int rowstride = gdk_pixbuf_get_rowstride (pb);
+    for (int n = 0; n < rowstride * 300; n++)
+        pixels[n] = g_random_int_range (0, 256);
+    GdkPixbufDrawStats stats = {{0}};
+    GdkPixbufDrawOpts opts = {1, (GdkRectangle){50, 50, 100, 100},
+                              0, 0, GDK_INTERP_BILINEAR, pb, 0, 0,
+                              1, FALSE, 0, NULL, &stats};
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    int n_tiles = g_hash_table_size (cache->store->tiles);
+    guint64 n_scaled = stats.n_pixels_scaled;
+
+    /* Zooming in, the whole frame is inside the last draw. */
+    GdkPixbufDrawOpts preview = opts;
+    preview.zoom = 2.0;
+    preview.zoom_rect = (GdkRectangle){150, 150, 100, 100};
+    preview.preview = TRUE;
+    gdk_pixbuf_draw_cache_draw (cache, &preview, pixmap);
+    assert (cache->anchor);
+    assert (g_hash_table_size (cache->store->tiles) == n_tiles);
+    assert (stats.n_pixels_scaled == n_scaled + 100 * 100);
+    for (int y = 0; y < 100; y++)
+        for (int x = 0; x < 100; x++)
+        {
+            guchar *a = gdk_pixbuf_get_pixels (cache->last_pixbuf) +
+                y * gdk_pixbuf_get_rowstride (cache->last_pixbuf) + x * 3;
+            guchar *e = gdk_pixbuf_get_pixels (cache->anchor) +
+                (y + 50) / 2 * gdk_pixbuf_get_rowstride (cache->anchor) +
+                (x + 50) / 2 * 3;
+            assert (!memcmp (a, e, 3));
+        }
+
+    /* Zooming out, the border comes from the pixbuf. */
+    preview.zoom = 0.5;
+    preview.zoom_rect = (GdkRectangle){0, 0, 100, 100};
+    gdk_pixbuf_draw_cache_draw (cache, &preview, pixmap);
+    assert (g_hash_table_size (cache->store->tiles) == n_tiles);
+    assert (!memcmp (gdk_pixbuf_get_pixels (cache->last_pixbuf),
+                     pixels + rowstride + 3, 3));
+
+    /* The last draw was a preview, so the tiles are used again. */
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (!cache->anchor);
+    assert (stats.n_draws[GDK_PIXBUF_DRAW_METHOD_SCALE] == 4);
+    assert (stats.n_pixels_scaled == n_scaled + 2 * 100 * 100);
+
+    gdk_pixbuf_draw_cache_free (cache);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+/**
+ * test_prefetch_scales_missing_tiles:
+ *
+ * The objective of this test is to verify that prefetching scales
+ * the tiles missing in an area one at a time, with the options of
+ * the last draw, so that drawing the area afterwards scales nothing.
+ **/
+static void
+test_prefetch_scales_missing_tiles ()
+{
+    printf ("test_prefetch_scales_missing_tiles\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 300, 300,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 600, 600);
+    GdkPixbufDrawStats stats = {{0}};
+    GdkPixbufDrawOpts opts = {1, (GdkRectangle){100, 100, 300, 300},
+                              0, 0, GDK_INTERP_BILINEAR, pb, 0, 0,
+                              1, FALSE, 0, NULL, &stats};
+    GdkRectangle ahead = {300, 100, 300, 300};
+
+    /* Nothing has been drawn yet. */
+    assert (!gdk_pixbuf_draw_cache_prefetch (cache, &ahead));
+
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (g_hash_table_size (cache->store->tiles) == 4);
+    assert (gdk_pixbuf_draw_cache_prefetch (cache, &ahead));
+    assert (g_hash_table_size (cache->store->tiles) == 5);
+    assert (gdk_pixbuf_draw_cache_prefetch (cache, &ahead));
+    assert (!gdk_pixbuf_draw_cache_prefetch (cache, &ahead));
+    assert (g_hash_table_size (cache->store->tiles) == 6);
+
+    guint64 n_scaled = stats.n_pixels_scaled;
+    opts.zoom_rect = ahead;
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (stats.n_pixels_scaled == n_scaled);
+
+    gdk_pixbuf_draw_cache_invalidate (cache);
+    assert (!gdk_pixbuf_draw_cache_prefetch (cache, &ahead));
+
+    gdk_pixbuf_draw_cache_free (cache);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+/**
+ * test_shared_tiles:
+ *
+ * The objective of this test is to verify that caches sharing their
+ * tiles draw the same pixbuf without scaling it twice, that damaged
+ * tiles are discarded from the shared store and that the tiles of a
+ * pixbuf go away with it.
+ **/
+static void
+test_shared_tiles ()
+{
+    printf ("test_shared_tiles\n");
+    GdkPixbufDrawCache *cache1 = gdk_pixbuf_draw_cache_new ();
+    GdkPixbufDrawCache *cache2 = gdk_pixbuf_draw_cache_new ();
+    assert (cache1->store != cache2->store);
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 300, 300,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 600, 600);
+    GdkPixbufDrawStats stats = {{0}};
+    GdkPixbufDrawOpts opts = {1, (GdkRectangle){100, 100, 300, 300},
+                              0, 0, GDK_INTERP_BILINEAR, pb, 0, 0,
+                              1, FALSE, 0, NULL, &stats, FALSE, TRUE};
+
+    gdk_pixbuf_draw_cache_draw (cache1, &opts, pixmap);
+    assert (g_hash_table_size (cache1->store->tiles) == 4);
+    guint64 n_scaled = stats.n_pixels_scaled;
+    gdk_pixbuf_draw_cache_draw (cache2, &opts, pixmap);
+    assert (cache1->store == cache2->store);
+    assert (stats.n_pixels_scaled == n_scaled);
+    assert (g_hash_table_size (cache2->store->tiles) == 4);
+
+    // Only the tiles reading the damaged pixels are discarded.
+    GdkRectangle damage = {0, 0, 10, 10};
+    gdk_pixbuf_draw_cache_invalidate_shared (pb, &damage);
+    assert (g_hash_table_size (cache1->store->tiles) == 3);
+    gdk_pixbuf_draw_cache_invalidate (cache1);
+    assert (g_hash_table_size (cache1->store->tiles) == 3);
+
+    // A cache that stops sharing gets a store of its own.
+    opts.shared = FALSE;
+    gdk_pixbuf_draw_cache_invalidate (cache2);
+    gdk_pixbuf_draw_cache_draw (cache2, &opts, pixmap);
+    assert (cache1->store != cache2->store);
+    assert (g_hash_table_size (cache2->store->tiles) == 4);
+    assert (g_hash_table_size (cache1->store->tiles) == 3);
+
+    g_object_unref (pb);
+    assert (!g_hash_table_size (cache1->store->tiles));
+    assert (!cache1->store->size);
+
+    gdk_pixbuf_draw_cache_free (cache1);
+    gdk_pixbuf_draw_cache_free (cache2);
+    g_object_unref (pixmap);
+}
+
+/**
+ * test_scroll_wraps_ring_buffer:
+ *
+ * The objective of this test is to verify that scrolling only writes
+ * the newly exposed pixels, wrapping around the edges of the ring
+ * buffer, and that every visible pixel is kept at its zoom-space
+ * coordinate modulo the size of the buffer.
+ **/
+static void
+test_scroll_wraps_ring_buffer ()
+{
+    printf ("test_scroll_wraps_ring_buffer\n");
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 100, 100,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 300, 300);
+    guchar *pixels = gdk_pixbuf_get_pixels (pb);
+    int rowstride = gdk_pixbuf_get_rowstride (pb);
+    for (int n = 0; n < rowstride * 300; n++)
+        pixels[n] = g_random_int_range (0, 256);
+    GdkPixbufDrawStats stats = {{0}};
+    GdkPixbufDrawOpts opts = {1, (GdkRectangle){0, 0, 100, 100},
+                              0, 0, GDK_INTERP_NEAREST, pb, 0, 0,
+                              1, FALSE, 0, NULL, &stats};
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    GdkPixbuf *buffer = cache->last_pixbuf;
+
+    opts.zoom_rect.x = 30;
+    opts.zoom_rect.y = 20;
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (stats.n_draws[GDK_PIXBUF_DRAW_METHOD_SCROLL] == 1);
+    assert (cache->last_pixbuf == buffer);
+    assert (stats.n_pixels_uploaded ==
+            100 * 100 + 30 * 100 + 20 * 70);
+
+    opts.zoom_rect.x = 150;
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (cache->last_pixbuf == buffer);
+
+    for (int y = 20; y < 120; y++)
+        for (int x = 150; x < 250; x++)
+        {
+            guchar *a = gdk_pixbuf_get_pixels (buffer) +
+                y % 100 * gdk_pixbuf_get_rowstride (buffer) + x % 100 * 3;
+            assert (!memcmp (a, pixels + y * rowstride + x * 3, 3));
+        }
+
+    gdk_pixbuf_draw_cache_free (cache);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
+/**
+ * test_draw_image_source:
+ *
+ * The objective of this test is to verify that drawing an image
+ * source gives exactly the pixels of drawing a pixbuf with the same
+ * pixels, although each tile is scaled from only the pixels it
+ * samples, and that the tiles are cached.
+ **/
+static void
+test_draw_image_source ()
+{
+    printf ("test_draw_image_source\n");
+    GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 300, 200);
+    guchar *pixels = gdk_pixbuf_get_pixels (pb);
+    int stride = gdk_pixbuf_get_rowstride (pb);
+    for (int y = 0; y < 200; y++)
+        for (int x = 0; x < 300 * 3; x++)
+            pixels[y * stride + x] = (x * 7 + y * 13) ^ (x * y);
+
+    char *filename;
+    int fd = g_file_open_tmp ("test-source-XXXXXX", &filename, NULL);
+    assert (fd >= 0);
+    const char header[] = "P6\n300 200\n255\n";
+    assert (write (fd, header, sizeof (header) - 1) == sizeof (header) - 1);
+    for (int y = 0; y < 200; y++)
+        assert (write (fd, pixels + y * stride, 300 * 3) == 300 * 3);
+    close (fd);
+    GtkIImageSource *source = gtk_image_source_mapped_new (filename, NULL);
+    assert (source);
+
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 200, 150,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbufDrawOpts opts = {1.5, (GdkRectangle){40, 30, 200, 150},
+                              0, 0, GDK_INTERP_BILINEAR, pb, 0, 0};
+    GdkPixbufDrawCache *expected = gdk_pixbuf_draw_cache_new ();
+    gdk_pixbuf_draw_cache_draw (expected, &opts, pixmap);
+
+    GdkPixbufDrawOpts source_opts = opts;
+    source_opts.pixbuf = NULL;
+    source_opts.source = source;
+    GdkPixbufDrawCache *actual = gdk_pixbuf_draw_cache_new ();
+    gdk_pixbuf_draw_cache_draw (actual, &source_opts, pixmap);
+    assert (g_hash_table_size (actual->store->tiles) ==
+            g_hash_table_size (expected->store->tiles));
+
+    GdkPixbuf *a = expected->last_pixbuf;
+    GdkPixbuf *b = actual->last_pixbuf;
+    assert (gdk_pixbuf_get_width (a) == gdk_pixbuf_get_width (b));
+    assert (gdk_pixbuf_get_height (a) == gdk_pixbuf_get_height (b));
+    for (int y = 0; y < gdk_pixbuf_get_height (a); y++)
+        assert (!memcmp (gdk_pixbuf_get_pixels (a) +
+                         y * gdk_pixbuf_get_rowstride (a),
+                         gdk_pixbuf_get_pixels (b) +
+                         y * gdk_pixbuf_get_rowstride (b),
+                         gdk_pixbuf_get_width (a) * 3));
+
+    gdk_pixbuf_draw_cache_draw (actual, &source_opts, pixmap);
+    assert (gdk_pixbuf_draw_cache_get_method (&actual->old, &source_opts) ==
+            GDK_PIXBUF_DRAW_METHOD_CONTAINS);
+
+    gdk_pixbuf_draw_cache_free (expected);
+    gdk_pixbuf_draw_cache_free (actual);
+    g_object_unref (source);
+    g_unlink (filename);
+    g_free (filename);
+    g_object_unref (pixmap);
+    g_object_unref (pb);
+}
+
 int
 main(int argc, char *argv[])
 {
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
     gtk_init (&argc, &argv);
     test_only_scale_op_on_new_identical_pixbuf ();
     test_cache_is_used_on_equal_opts ();
@@ -175,5 +978,21 @@ main(int argc, char *argv[])
     test_scroll_needed_if_rect_size_not_equal ();
     test_default_draw_options ();
     test_invalidate ();
-    printf ("6 tests passed.\n");
+    test_tiles_reused_when_returning_to_zoom ();
+    test_tiles_evicted_when_over_max_size ();
+    test_async_draw_scales_tiles_in_workers ();
+    test_async_draw_over_memory_limit ();
+    test_pyramid_levels ();
+    test_draw_from_pyramid ();
+    test_async_draw_from_pyramid_with_check_colors ();
+    test_async_draw_builds_pyramid_levels_in_worker ();
+    test_stats_count_draws ();
+    test_check_colors_do_not_rescale ();
+    test_invalidate_area ();
+    test_preview_rescales_last_draw ();
+    test_prefetch_scales_missing_tiles ();
+    test_shared_tiles ();
+    test_scroll_wraps_ring_buffer ();
+    test_draw_image_source ();
+    printf ("22 tests passed.\n");
 }
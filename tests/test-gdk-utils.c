@@ -3,10 +3,17 @@
  * This file contains tests for the extra GDK functions defined in
  * utils.h.
  **/
+#include <src/gtkimagesourcemapped.h>
+#include <src/gtkzooms.h>
+#include <src/pixops.h>
 #include <src/utils.h>
 #include <gtk/gtk.h>
 
 #include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
 
 static void
 rects_around_rect_checker (GdkRectangle outer,
@@ -75,12 +82,458 @@ test_get_rects_around_rect ()
 	assert (gdk_rectangle_eq2 (arounds[3], 0, 75, 100, 25));
 }
 
+static GdkPixbuf *
+random_pixbuf (gboolean has_alpha, int width, int height)
+{
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, has_alpha, 8,
+                                        width, height);
+    guchar *pixels = gdk_pixbuf_get_pixels (pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+    for (int n = 0; n < rowstride * height; n++)
+        pixels[n] = g_random_int_range (0, 256);
+    return pixbuf;
+}
+
+static gboolean
+pixbufs_equal (GdkPixbuf *pb1, GdkPixbuf *pb2)
+{
+    int width = gdk_pixbuf_get_width (pb1);
+    int height = gdk_pixbuf_get_height (pb1);
+    int linelen = width * gdk_pixbuf_get_n_channels (pb1);
+    for (int y = 0; y < height; y++)
+    {
+        guchar *row1 = gdk_pixbuf_get_pixels (pb1) +
+            y * gdk_pixbuf_get_rowstride (pb1);
+        guchar *row2 = gdk_pixbuf_get_pixels (pb2) +
+            y * gdk_pixbuf_get_rowstride (pb2);
+        if (memcmp (row1, row2, linelen))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * test_scale_blend_parallel_is_identical
+ *
+ * Test that scaling in parallel bands produces exactly the same
+ * pixels as scaling the whole rectangle at once, both for opaque and
+ * transparent pixbufs.
+ **/
+static void
+test_scale_blend_parallel_is_identical ()
+{
+    printf ("test_scale_blend_parallel_is_identical\n");
+    GdkInterpType interps[] = {
+        GDK_INTERP_NEAREST,
+        GDK_INTERP_BILINEAR,
+        GDK_INTERP_HYPER
+    };
+    gdouble zooms[] = {0.3, 1.0, 2.7};
+    for (int alpha = 0; alpha < 2; alpha++)
+    {
+        GdkPixbuf *src = random_pixbuf (alpha, 200, 200);
+        GdkPixbuf *serial = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                            150, 257);
+        GdkPixbuf *parallel = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                              150, 257);
+        for (int i = 0; i < G_N_ELEMENTS (interps); i++)
+            for (int j = 0; j < G_N_ELEMENTS (zooms); j++)
+            {
+                gdk_pixbuf_scale_blend (src, serial,
+                                        0, 0, 150, 257,
+                                        -10.0, -5.0,
+                                        zooms[j], interps[i],
+                                        10, 5, 16,
+                                        0x666666, 0x999999);
+                gdk_pixbuf_scale_blend_parallel (src, parallel,
+                                                 0, 0, 150, 257,
+                                                 -10.0, -5.0,
+                                                 zooms[j], interps[i],
+                                                 10, 5, 16,
+                                                 0x666666, 0x999999,
+                                                 4);
+                assert (pixbufs_equal (serial, parallel));
+            }
+        g_object_unref (src);
+        g_object_unref (serial);
+        g_object_unref (parallel);
+    }
+}
+
+static int
+pixbufs_max_diff (GdkPixbuf *pb1, GdkPixbuf *pb2)
+{
+    int width = gdk_pixbuf_get_width (pb1);
+    int height = gdk_pixbuf_get_height (pb1);
+    int linelen = width * gdk_pixbuf_get_n_channels (pb1);
+    int max_diff = 0;
+    for (int y = 0; y < height; y++)
+    {
+        guchar *row1 = gdk_pixbuf_get_pixels (pb1) +
+            y * gdk_pixbuf_get_rowstride (pb1);
+        guchar *row2 = gdk_pixbuf_get_pixels (pb2) +
+            y * gdk_pixbuf_get_rowstride (pb2);
+        for (int x = 0; x < linelen; x++)
+            max_diff = MAX (max_diff, ABS (row1[x] - row2[x]));
+    }
+    return max_diff;
+}
+
+/**
+ * test_pixops_matches_gdk_pixbuf
+ *
+ * Test that all scaling kernels that the CPU supports produce the
+ * same pixels as gdk-pixbuf, give or take rounding.
+ **/
+static void
+test_pixops_matches_gdk_pixbuf ()
+{
+    printf ("test_pixops_matches_gdk_pixbuf\n");
+    PixopsImpl best = pixops_get_impl ();
+    GdkInterpType interps[] = {GDK_INTERP_NEAREST, GDK_INTERP_BILINEAR};
+    gdouble zooms[] = {0.37, 1.0, 1.5, 2.0, 3.3, 7.9};
+    /* Fractional offsets are rounded, not truncated. */
+    gdouble offsets[][2] = {{-20.0, -9.0}, {-20.4, -8.6}, {-19.5, -9.5}};
+    for (int alpha = 0; alpha < 2; alpha++)
+    {
+        GdkPixbuf *src = random_pixbuf (alpha, 57, 43);
+        GdkPixbuf *expected = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                              71, 61);
+        GdkPixbuf *actual = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                            71, 61);
+        for (int i = 0; i < G_N_ELEMENTS (interps); i++)
+            for (int j = 0; j < G_N_ELEMENTS (zooms); j++)
+                for (int k = 0; k < G_N_ELEMENTS (offsets); k++)
+                {
+                    pixops_set_impl (PIXOPS_IMPL_GENERIC);
+                    gdk_pixbuf_scale_blend (src, expected,
+                                            0, 0, 71, 61,
+                                            offsets[k][0], offsets[k][1],
+                                            zooms[j], interps[i],
+                                            20, 9, 8,
+                                            0x666666, 0x999999);
+                    for (PixopsImpl impl = PIXOPS_IMPL_C;
+                         impl <= PIXOPS_IMPL_AVX2;
+                         impl++)
+                    {
+                        if (!pixops_set_impl (impl))
+                            continue;
+                        gboolean supported =
+                            pixops_scale_blend (src, actual,
+                                                0, 0, 71, 61,
+                                                offsets[k][0],
+                                                offsets[k][1],
+                                                zooms[j], interps[i],
+                                                20, 9, 8,
+                                                0x666666, 0x999999);
+                        assert (supported ==
+                                (interps[i] == GDK_INTERP_NEAREST ||
+                                 zooms[j] > 1.0));
+                        if (supported)
+                            assert (pixbufs_max_diff (expected, actual) <= 3);
+                    }
+                }
+        g_object_unref (src);
+        g_object_unref (expected);
+        g_object_unref (actual);
+    }
+    pixops_set_impl (best);
+}
+
+/**
+ * test_rectangles_merge
+ *
+ * Test that only rectangles that lie close together are merged.
+ **/
+static void
+test_rectangles_merge ()
+{
+    printf ("test_rectangles_merge\n");
+
+    // Two opposite corners of a large view are kept apart.
+    GdkRectangle corners[] = {
+        {0, 0, 50, 50},
+        {750, 550, 50, 50}
+    };
+    assert (gdk_rectangles_merge (corners, 2, 64 * 64) == 2);
+    assert (gdk_rectangle_eq2 (corners[0], 0, 0, 50, 50));
+    assert (gdk_rectangle_eq2 (corners[1], 750, 550, 50, 50));
+
+    // Adjacent halves are merged with no slack at all.
+    GdkRectangle halves[] = {
+        {0, 0, 100, 40},
+        {0, 40, 100, 60}
+    };
+    assert (gdk_rectangles_merge (halves, 2, 0) == 1);
+    assert (gdk_rectangle_eq2 (halves[0], 0, 0, 100, 100));
+
+    // Merging the first two makes the third close enough to merge.
+    GdkRectangle steps[] = {
+        {0, 0, 10, 10},
+        {10, 0, 10, 10},
+        {0, 10, 20, 10},
+        {500, 500, 10, 10}
+    };
+    assert (gdk_rectangles_merge (steps, 4, 0) == 2);
+    assert (gdk_rectangle_eq2 (steps[0], 0, 0, 20, 20));
+    assert (gdk_rectangle_eq2 (steps[1], 500, 500, 10, 10));
+}
+
+static char *
+write_temp_image (const char *contents,
+                  gsize       size)
+{
+    char *filename;
+    int fd = g_file_open_tmp ("test-mapped-XXXXXX", &filename, NULL);
+    assert (fd >= 0);
+    assert (write (fd, contents, size) == size);
+    close (fd);
+    return filename;
+}
+
+/**
+ * test_image_source_mapped
+ *
+ * Test that PPM and PAM files are read with the right size and
+ * pixels, that levels average the pixels they cover weighted by
+ * alpha, and that invalid and truncated files are rejected.
+ **/
+static void
+test_image_source_mapped ()
+{
+    printf ("test_image_source_mapped\n");
+    static const char ppm[] = "P6\n# comment\n3 2\n255\n"
+        "\x01\x02\x03\x04\x05\x06\x07\x08\x09"
+        "\x0a\x0b\x0c\x0d\x0e\x0f\x10\x11\x12";
+    char *filename = write_temp_image (ppm, sizeof (ppm) - 1);
+    GtkIImageSource *source = gtk_image_source_mapped_new (filename, NULL);
+    assert (source);
+    int width, height;
+    gtk_iimage_source_get_size (source, &width, &height);
+    assert (width == 3 && height == 2);
+    assert (!gtk_iimage_source_get_has_alpha (source));
+    assert (gtk_iimage_source_get_n_levels (source) == 3);
+    assert (gtk_iimage_source_get_fast_level (source) == -1);
+
+    GdkRectangle area = {1, 0, 2, 2};
+    GdkPixbuf *pixbuf = gtk_iimage_source_read_area (source, 0, &area);
+    assert (gdk_pixbuf_get_width (pixbuf) == 2);
+    assert (gdk_pixbuf_get_height (pixbuf) == 2);
+    assert (!gdk_pixbuf_get_has_alpha (pixbuf));
+    guchar *pixels = gdk_pixbuf_get_pixels (pixbuf);
+    int stride = gdk_pixbuf_get_rowstride (pixbuf);
+    assert (!memcmp (pixels, "\x04\x05\x06\x07\x08\x09", 6));
+    assert (!memcmp (pixels + stride, "\x0d\x0e\x0f\x10\x11\x12", 6));
+    g_object_unref (pixbuf);
+
+    // Level 1 is 2x1 pixels. The last column only covers one column
+    // of level 0.
+    gtk_iimage_source_get_level_size (source, 1, &width, &height);
+    assert (width == 2 && height == 1);
+    area = (GdkRectangle){0, 0, 2, 1};
+    pixbuf = gtk_iimage_source_read_area (source, 1, &area);
+    assert (!memcmp (gdk_pixbuf_get_pixels (pixbuf),
+                     "\x07\x08\x09\x0c\x0d\x0e", 6));
+    g_object_unref (pixbuf);
+    assert (gtk_iimage_source_get_fast_level (source) == 0);
+    g_object_unref (source);
+    g_unlink (filename);
+    g_free (filename);
+
+    // A transparent pixel does not darken the one it is averaged
+    // with.
+    static const char pam[] = "P7\nWIDTH 2\nHEIGHT 1\nDEPTH 4\nMAXVAL 255\n"
+        "TUPLTYPE RGB_ALPHA\nENDHDR\n"
+        "\xc8\x00\x00\xff\x00\x00\x00\x00";
+    filename = write_temp_image (pam, sizeof (pam) - 1);
+    source = gtk_image_source_mapped_new (filename, NULL);
+    assert (source);
+    assert (gtk_iimage_source_get_has_alpha (source));
+    area = (GdkRectangle){0, 0, 1, 1};
+    pixbuf = gtk_iimage_source_read_area (source, 1, &area);
+    assert (gdk_pixbuf_get_has_alpha (pixbuf));
+    assert (!memcmp (gdk_pixbuf_get_pixels (pixbuf), "\xc8\x00\x00\x80", 4));
+    g_object_unref (pixbuf);
+    g_object_unref (source);
+    g_unlink (filename);
+    g_free (filename);
+
+    // The last pixel is missing.
+    filename = write_temp_image (ppm, sizeof (ppm) - 2);
+    GError *error = NULL;
+    assert (!gtk_image_source_mapped_new (filename, &error));
+    assert (error->domain == GDK_PIXBUF_ERROR);
+    assert (error->code == GDK_PIXBUF_ERROR_CORRUPT_IMAGE);
+    g_clear_error (&error);
+    g_unlink (filename);
+    g_free (filename);
+
+    assert (!gtk_image_source_mapped_new ("does-not-exist.ppm", &error));
+    assert (error->domain == G_FILE_ERROR);
+    g_clear_error (&error);
+}
+
+/**
+ * test_scale_area_matches_whole
+ *
+ * Test that scaling an image tile by tile with pixops_scale_area(),
+ * from only the pixels each tile samples, gives exactly the pixels
+ * pixops_scale_blend() gives when scaling the whole image.
+ **/
+static void
+test_scale_area_matches_whole ()
+{
+    printf ("test_scale_area_matches_whole\n");
+    GdkPixbuf *image = random_pixbuf (FALSE, 50, 40);
+    GdkInterpType interps[] = {GDK_INTERP_NEAREST, GDK_INTERP_BILINEAR};
+    gdouble zooms[] = {2.5, 1.7};
+    for (int i = 0; i < G_N_ELEMENTS (interps); i++)
+    {
+        gdouble zoom = zooms[i];
+        int width = (int) (50 * zoom + 0.5);
+        int height = (int) (40 * zoom + 0.5);
+        GdkPixbuf *whole = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                           width, height);
+        GdkPixbuf *tiled = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                           width, height);
+        assert (pixops_scale_blend (image, whole, 0, 0, width, height,
+                                    0, 0, zoom, interps[i],
+                                    0, 0, 16, 0x666666, 0x999999));
+        for (int y = 0; y < height; y += 32)
+            for (int x = 0; x < width; x += 32)
+            {
+                GdkRectangle tile = {
+                    x, y, MIN (32, width - x), MIN (32, height - y)
+                };
+                GdkRectangle area;
+                gdk_rectangle_unzoom (&tile, zoom, &area);
+                int x0 = MAX (area.x - 1, 0);
+                int y0 = MAX (area.y - 1, 0);
+                int x1 = MIN (area.x + area.width + 1, 50);
+                int y1 = MIN (area.y + area.height + 1, 40);
+                GdkPixbuf *pixels =
+                    gdk_pixbuf_new_subpixbuf (image, x0, y0,
+                                              x1 - x0, y1 - y0);
+                assert (pixops_scale_area (pixels, x0, y0, 50, 40,
+                                           tiled,
+                                           tile.x, tile.y,
+                                           tile.width, tile.height,
+                                           0, 0, zoom, interps[i],
+                                           tile.x, tile.y, 16,
+                                           0x666666, 0x999999));
+                g_object_unref (pixels);
+            }
+        assert (pixbufs_max_diff (whole, tiled) == 0);
+        g_object_unref (whole);
+        g_object_unref (tiled);
+    }
+    g_object_unref (image);
+}
+
+/**
+ * test_damage_area_at_every_zoom:
+ *
+ * Test that when a few pixels of an image are modified, every drawn
+ * pixel that changes lies in the area gdk_rectangle_zoom() maps them
+ * to grown by gdk_pixbuf_get_scale_margin(), at every zoom factor
+ * GtkImageView uses. The area must also be tight, not a multiple of
+ * the size of the modified pixels.
+ **/
+static void
+test_damage_area_at_every_zoom ()
+{
+    printf ("test_damage_area_at_every_zoom\n");
+    GdkPixbuf *before = random_pixbuf (FALSE, 60, 60);
+    GdkPixbuf *after = gdk_pixbuf_copy (before);
+    GdkRectangle damage = {21, 25, 3, 2};
+    guchar *pixels = gdk_pixbuf_get_pixels (after);
+    int stride = gdk_pixbuf_get_rowstride (after);
+    for (int y = damage.y; y < damage.y + damage.height; y++)
+        for (int x = damage.x * 3; x < (damage.x + damage.width) * 3; x++)
+            pixels[y * stride + x] ^= 0xff;
+
+    GdkInterpType interps[] = {GDK_INTERP_NEAREST, GDK_INTERP_BILINEAR};
+    gdouble zoom = gtk_zooms_get_min_zoom ();
+    while (TRUE)
+    {
+        GdkRectangle exact, back;
+        gdk_rectangle_zoom (&damage, zoom, &exact);
+        assert (exact.width <= ceil (damage.width * zoom) + 1);
+        assert (exact.height <= ceil (damage.height * zoom) + 1);
+        gdk_rectangle_unzoom (&exact, zoom, &back);
+        assert (back.x <= damage.x && back.y <= damage.y);
+        assert (back.x + back.width >= damage.x + damage.width);
+        assert (back.y + back.height >= damage.y + damage.height);
+
+        int extent = MAX ((int) (60 * zoom), 1);
+        for (int i = 0; i < G_N_ELEMENTS (interps); i++)
+        {
+            int margin = gdk_pixbuf_get_scale_margin (zoom, interps[i],
+                                                      extent);
+            assert (margin <= 2 * zoom + 2);
+            GdkRectangle area = {
+                exact.x - margin, exact.y - margin,
+                exact.width + 2 * margin, exact.height + 2 * margin
+            };
+
+            // Draw the part of the zoomed image around the area.
+            GdkRectangle win = {
+                area.x - 16, area.y - 16, area.width + 32, area.height + 32
+            };
+            GdkRectangle zoomed = {0, 0, extent, extent};
+            gdk_rectangle_intersect (&zoomed, &win, &win);
+            GdkPixbuf *dst[2];
+            GdkPixbuf *src[2] = {before, after};
+            for (int n = 0; n < 2; n++)
+            {
+                dst[n] = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                         win.width, win.height);
+                gdk_pixbuf_scale_blend (src[n], dst[n],
+                                        0, 0, win.width, win.height,
+                                        -win.x, -win.y,
+                                        zoom, interps[i],
+                                        win.x, win.y, 16, 0, 0);
+            }
+
+            int n_changed = 0;
+            int dst_stride = gdk_pixbuf_get_rowstride (dst[0]);
+            for (int y = 0; y < win.height; y++)
+                for (int x = 0; x < win.width; x++)
+                {
+                    int ofs = y * dst_stride + x * 3;
+                    if (!memcmp (gdk_pixbuf_get_pixels (dst[0]) + ofs,
+                                 gdk_pixbuf_get_pixels (dst[1]) + ofs, 3))
+                        continue;
+                    assert (win.x + x >= area.x && win.y + y >= area.y);
+                    assert (win.x + x < area.x + area.width);
+                    assert (win.y + y < area.y + area.height);
+                    n_changed++;
+                }
+            if (zoom >= 1.0)
+                assert (n_changed);
+            g_object_unref (dst[0]);
+            g_object_unref (dst[1]);
+        }
+        if (zoom == gtk_zooms_get_max_zoom ())
+            break;
+        zoom = gtk_zooms_get_zoom_in (zoom);
+    }
+    g_object_unref (before);
+    g_object_unref (after);
+}
+
 int
 main (int argc, char *argv[])
 {
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
     gtk_init (&argc, &argv);
     test_get_rects_around_rect ();
-    printf ("1 test passed.\n");
+    test_scale_blend_parallel_is_identical ();
+    test_pixops_matches_gdk_pixbuf ();
+    test_rectangles_merge ();
+    test_image_source_mapped ();
+    test_scale_area_matches_whole ();
+    test_damage_area_at_every_zoom ();
+    printf ("7 tests passed.\n");
 }
-
-
@@ -27,19 +27,129 @@ test_expose_event_with_pixbuf ()
     
     gtk_image_view_set_pixbuf (GTK_IMAGE_VIEW (view), pixbuf, FALSE);
 
+    /* Without a region, the whole area is painted. */
     GdkEventExpose ev = {.area = {0, 0, 999, 999}};
     GTK_WIDGET_GET_CLASS (view)->expose_event (view, &ev);
+    GdkPixbufDrawStats stats;
+    gtk_image_view_get_stats (GTK_IMAGE_VIEW (view), &stats);
+    assert (stats.n_exposes == 1);
 
     g_object_unref (pixbuf);
     gtk_widget_destroy (view);
     g_object_unref (view);
 }
 
+/**
+ * test_progressive_refine:
+ *
+ * The objective of this test is to verify that in progressive mode,
+ * uncached tiles are painted quickly and refined by the next expose
+ * after the refine delay, that new quick pixels postpone the
+ * refinement and that cached tiles are painted at full quality
+ * without one.
+ **/
+static void
+test_progressive_refine ()
+{
+    printf ("test_progressive_refine\n");
+    GtkImageView *view = GTK_IMAGE_VIEW (gtk_image_view_new ());
+    g_object_ref (view);
+    gtk_object_sink (GTK_OBJECT (view));
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        400, 400);
+
+    fake_realize (GTK_WIDGET (view));
+    GtkAllocation alloc = {0, 0, 100, 100};
+    gtk_widget_size_allocate (GTK_WIDGET (view), &alloc);
+    gtk_image_view_set_pixbuf (view, pixbuf, FALSE);
+    gtk_image_view_set_zoom (view, 0.5);
+    gtk_image_view_set_refine_delay (view, 20);
+
+    GdkRectangle area = {0, 0, 100, 100};
+    GdkEventExpose ev = {.area = area,
+                         .region = gdk_region_rectangle (&area)};
+    GdkPixbufDrawStats stats;
+    GTK_WIDGET_GET_CLASS (view)->expose_event (GTK_WIDGET (view), &ev);
+    gtk_image_view_get_stats (view, &stats);
+    assert (stats.n_incomplete == 1);
+    guint refine_id = view->refine_id;
+    assert (refine_id);
+
+    /* Quick pixels painted again postpone the refinement. */
+    GTK_WIDGET_GET_CLASS (view)->expose_event (GTK_WIDGET (view), &ev);
+    assert (view->refine_id && view->refine_id != refine_id);
+
+    while (view->refine_id)
+        g_main_context_iteration (NULL, TRUE);
+    assert (view->is_refining);
+    GTK_WIDGET_GET_CLASS (view)->expose_event (GTK_WIDGET (view), &ev);
+    assert (!view->is_refining && !view->refine_id);
+    gtk_image_view_get_stats (view, &stats);
+    assert (stats.n_incomplete == 2);
+
+    /* The tiles are cached now, so scrolling needs no refinement. */
+    gtk_image_view_set_offset (view, 50, 50, FALSE);
+    GTK_WIDGET_GET_CLASS (view)->expose_event (GTK_WIDGET (view), &ev);
+    gtk_image_view_get_stats (view, &stats);
+    assert (stats.n_incomplete == 2);
+    assert (!view->refine_id);
+
+    gdk_region_destroy (ev.region);
+    g_object_unref (pixbuf);
+    gtk_widget_destroy (GTK_WIDGET (view));
+    g_object_unref (view);
+}
+
+/**
+ * test_expose_counted_once:
+ *
+ * The objective of this test is to verify that an expose whose
+ * region is painted as several rectangles counts as one expose in
+ * the statistics.
+ **/
+static void
+test_expose_counted_once ()
+{
+    printf ("test_expose_counted_once\n");
+    GtkImageView *view = GTK_IMAGE_VIEW (gtk_image_view_new ());
+    g_object_ref (view);
+    gtk_object_sink (GTK_OBJECT (view));
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        800, 600);
+
+    fake_realize (GTK_WIDGET (view));
+    GtkAllocation alloc = {0, 0, 800, 600};
+    gtk_widget_size_allocate (GTK_WIDGET (view), &alloc);
+    gtk_image_view_set_pixbuf (view, pixbuf, FALSE);
+    gtk_image_view_set_zoom (view, 1.0);
+
+    /* Two opposite corners are painted separately. */
+    GdkRectangle corners[] = {{0, 0, 50, 50}, {750, 550, 50, 50}};
+    GdkEventExpose ev = {.area = {0, 0, 800, 600},
+                         .region = gdk_region_rectangle (&corners[0])};
+    gdk_region_union_with_rect (ev.region, &corners[1]);
+    gtk_image_view_reset_stats (view);
+    GTK_WIDGET_GET_CLASS (view)->expose_event (GTK_WIDGET (view), &ev);
+
+    GdkPixbufDrawStats stats;
+    gtk_image_view_get_stats (view, &stats);
+    assert (stats.n_pixels_saved);
+    assert (stats.n_exposes == 1);
+    assert (stats.max_expose_time == stats.expose_time);
+
+    gdk_region_destroy (ev.region);
+    g_object_unref (pixbuf);
+    gtk_widget_destroy (GTK_WIDGET (view));
+    g_object_unref (view);
+}
+
 int
 main (int argc, char *argv[])
 {
     gtk_init (&argc, &argv);
     test_expose_event_with_pixbuf ();
-    printf ("1 test passed.\n");
+    test_progressive_refine ();
+    test_expose_counted_once ();
+    printf ("3 tests passed.\n");
 }
 
@@ -270,6 +270,43 @@ test_not_resizable ()
     teardown ();
 }
 
+/**
+ * test_transparent_preview_is_composited:
+ *
+ * The objective of this test is to verify that the preview of a
+ * pixbuf with alpha is composited over the view's checkerboard and
+ * opaque.
+ **/
+static void
+test_transparent_preview_is_composited ()
+{
+    printf ("test_transparent_preview_is_composited\n");
+    setup ();
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8,
+                                        100, 100);
+    gdk_pixbuf_fill (pixbuf, 0x00000000);
+    gtk_image_view_set_pixbuf (view, pixbuf, TRUE);
+    gtk_image_nav_show_and_grab (nav, 100, 100);
+
+    int col1, col2;
+    gtk_image_view_get_check_colors (view, &col1, &col2);
+    GdkPixbuf *preview = gtk_image_nav_get_pixbuf (nav);
+    guchar *p = gdk_pixbuf_get_pixels (preview);
+    int color = (p[0] << 16) | (p[1] << 8) | p[2];
+    assert (color == (col1 & 0xffffff));
+    if (gdk_pixbuf_get_has_alpha (preview))
+        for (int y = 0; y < gdk_pixbuf_get_height (preview); y++)
+        {
+            p = gdk_pixbuf_get_pixels (preview) +
+                y * gdk_pixbuf_get_rowstride (preview);
+            for (int x = 0; x < gdk_pixbuf_get_width (preview); x++)
+                assert (p[x * 4 + 3] == 0xff);
+        }
+
+    g_object_unref (pixbuf);
+    teardown ();
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -284,5 +321,6 @@ main (int argc, char *argv[])
     test_lmb_release ();
     test_delayed_scaling ();
     test_not_resizable ();
-    printf ("10 tests passed.\n");
+    test_transparent_preview_is_composited ();
+    printf ("11 tests passed.\n");
 }
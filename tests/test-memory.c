@@ -3,6 +3,7 @@
  * the GtkImageView.
  **/
 #include <assert.h>
+#include <src/gdkpixbufmemory.h>
 #include <src/gtkimageview.h>
 #include <src/gtkimagescrollwin.h>
 #include <src/gtkimagetoolselector.h>
@@ -248,6 +249,105 @@ test_offset_setting ()
     g_object_unref (pixbuf);
 }
 
+/**
+ * test_memory_limit:
+ *
+ * Ensure that the buffers of a draw cache are accounted, that tiles
+ * are evicted when the memory limit is exceeded and that the draw
+ * buffers are released too once the cache has not drawn since the
+ * last time it was asked to.
+ **/
+static void
+test_memory_limit ()
+{
+    printf ("test_memory_limit\n");
+    GdkPixbufMemoryStats before, stats;
+    gdk_pixbuf_memory_get_stats (&before);
+
+    GdkPixbufDrawCache *cache = gdk_pixbuf_draw_cache_new ();
+    GdkPixmap *pixmap = gdk_pixmap_new (NULL, 100, 100,
+                                        gdk_visual_get_system ()->depth);
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        200, 200);
+    GdkPixbufDrawOpts opts = {1, (GdkRectangle){0, 0, 100, 100},
+                              0, 0, GDK_INTERP_NEAREST, pixbuf, 0, 0};
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+
+    gdk_pixbuf_memory_get_stats (&stats);
+    assert (stats.usage[GDK_PIXBUF_MEMORY_TILES] ==
+            before.usage[GDK_PIXBUF_MEMORY_TILES] + cache->store->size);
+    assert (stats.usage[GDK_PIXBUF_MEMORY_DRAW_BUFFERS] >=
+            before.usage[GDK_PIXBUF_MEMORY_DRAW_BUFFERS] + 100 * 100 * 3);
+    assert (stats.peak >= stats.total);
+
+    /* The cache has just drawn so its tiles and buffer are kept the
+       first time. */
+    gdk_pixbuf_memory_set_limit (1);
+    gdk_pixbuf_memory_trim ();
+    assert (cache->store->size);
+    assert (gdk_pixbuf_get_width (cache->last_pixbuf) == 100);
+
+    gdk_pixbuf_memory_trim ();
+    assert (!cache->store->size);
+    assert (gdk_pixbuf_get_width (cache->last_pixbuf) == 1);
+    assert (!cache->last_pixmap);
+    gdk_pixbuf_memory_get_stats (&stats);
+    assert (stats.n_shrinks > before.n_shrinks);
+
+    /* The next draw scales everything again. */
+    gdk_pixbuf_memory_set_limit (0);
+    gdk_pixbuf_draw_cache_draw (cache, &opts, pixmap);
+    assert (gdk_pixbuf_get_width (cache->last_pixbuf) == 100);
+
+    gdk_pixbuf_draw_cache_free (cache);
+    g_object_unref (pixbuf);
+    g_object_unref (pixmap);
+    gdk_pixbuf_memory_get_stats (&stats);
+    assert (stats.total == before.total);
+}
+
+static int shrink_calls[2];
+
+static void
+shrink_second_cb (gpointer data)
+{
+    shrink_calls[1]++;
+}
+
+static void
+shrink_first_cb (gpointer data)
+{
+    shrink_calls[0]++;
+    gdk_pixbuf_memory_remove_shrinker (shrink_second_cb, data);
+}
+
+/**
+ * test_shrinker_removing_shrinker:
+ *
+ * Ensure that a shrink function may remove another one while the
+ * memory is trimmed, and that the removed one is not called.
+ **/
+static void
+test_shrinker_removing_shrinker ()
+{
+    printf ("test_shrinker_removing_shrinker\n");
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        10, 10);
+    gdk_pixbuf_memory_track_pixbuf (pixbuf, GDK_PIXBUF_MEMORY_TILES);
+    gdk_pixbuf_memory_add_shrinker (GDK_PIXBUF_MEMORY_TILES,
+                                    shrink_first_cb, NULL);
+    gdk_pixbuf_memory_add_shrinker (GDK_PIXBUF_MEMORY_TILES,
+                                    shrink_second_cb, NULL);
+
+    gdk_pixbuf_memory_set_limit (1);
+    gdk_pixbuf_memory_trim ();
+    assert (shrink_calls[0] == 1 && shrink_calls[1] == 0);
+
+    gdk_pixbuf_memory_set_limit (0);
+    gdk_pixbuf_memory_remove_shrinker (shrink_first_cb, NULL);
+    g_object_unref (pixbuf);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -261,5 +361,7 @@ main (int argc, char *argv[])
 	test_finalize_for_unrealized_attributes2 ();
     test_finalize_tool_selector ();
     test_offset_setting ();
-    printf ("8 test passed.\n");
+    test_memory_limit ();
+    test_shrinker_removing_shrinker ();
+    printf ("10 test passed.\n");
 }
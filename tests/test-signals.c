@@ -12,6 +12,7 @@
  * 5. Sending a size-allocate event.
  **/
 #include <src/gtkimageview.h>
+#include <src/gtkimagetooldragger.h>
 #include <src/gtkzooms.h>
 #include <assert.h>
 #include "testlib/testlib.h"
@@ -343,6 +344,290 @@ test_scroll_handle_dragging ()
     g_object_unref (view);
 }
 
+/**
+ * test_loader_damage_is_coalesced:
+ *
+ * The objective of this test is to verify that a view bound to a
+ * loader shows the loader's pixbuf as soon as it exists, and that
+ * the rows decoded before the next frame are drawn with a single
+ * pixbuf-changed signal.
+ **/
+static void
+test_loader_damage_is_coalesced ()
+{
+    printf ("test_loader_damage_is_coalesced\n");
+    GtkImageView *view = GTK_IMAGE_VIEW (gtk_image_view_new ());
+    g_object_ref (view);
+    gtk_object_sink (GTK_OBJECT (view));
+    g_signal_connect (G_OBJECT (view), "pixbuf-changed",
+                      G_CALLBACK (pixbuf_changed_cb), NULL);
+
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        64, 64);
+    gdk_pixbuf_fill (pixbuf, 0x336699ff);
+    gchar *buf;
+    gsize size;
+    assert (gdk_pixbuf_save_to_buffer (pixbuf, &buf, &size, "png",
+                                       NULL, NULL));
+
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
+    gtk_image_view_set_loader (view, loader);
+    assert (gtk_image_view_get_loader (view) == loader);
+    num_calls = 0;
+    for (gsize n = 0; n < size; n += 16)
+        assert (gdk_pixbuf_loader_write (loader, (guchar *) buf + n,
+                                         MIN (16, size - n), NULL));
+    assert (gtk_image_view_get_pixbuf (view) ==
+            gdk_pixbuf_loader_get_pixbuf (loader));
+    assert (num_calls == 1);
+
+    /* Closing the loader draws the remaining rows and unbinds it. */
+    assert (gdk_pixbuf_loader_close (loader, NULL));
+    assert (num_calls == 2);
+    assert (!gtk_image_view_get_loader (view));
+
+    g_object_unref (loader);
+    g_free (buf);
+    g_object_unref (pixbuf);
+    gtk_widget_destroy (GTK_WIDGET (view));
+    g_object_unref (view);
+}
+
+/**
+ * test_damage_is_coalesced:
+ *
+ * The objective of this test is to verify that damage is merged
+ * until it is flushed and that only one pixbuf-changed signal is
+ * emitted for it.
+ **/
+static void
+test_damage_is_coalesced ()
+{
+    printf ("test_damage_is_coalesced\n");
+    GtkImageView *view = GTK_IMAGE_VIEW (gtk_image_view_new ());
+    g_object_ref (view);
+    gtk_object_sink (GTK_OBJECT (view));
+    g_signal_connect (G_OBJECT (view), "pixbuf-changed",
+                      G_CALLBACK (pixbuf_changed_cb), NULL);
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        100, 100);
+    gtk_image_view_set_pixbuf (view, pixbuf, TRUE);
+
+    num_calls = 0;
+    for (int n = 0; n < 10; n++)
+        gtk_image_view_damage_pixels (view,
+                                      &(GdkRectangle){10 + n * 4, 20, 4, 4});
+    gtk_image_view_damage_pixels (view, &(GdkRectangle){10, 10, 4, 4});
+    assert (num_calls == 0);
+    assert (view->damage.x == 10 && view->damage.y == 10);
+    assert (view->damage.width == 40 && view->damage.height == 14);
+
+    gtk_image_view_flush_damage (view);
+    assert (num_calls == 1);
+    gtk_image_view_flush_damage (view);
+    assert (num_calls == 1);
+
+    /* Setting the same pixbuf again handles pending damage along with
+       the rest of the pixels, with one signal for both, and updates
+       the image pyramid. */
+    gtk_image_view_set_use_pyramid (view, TRUE);
+    view->pyramid = gdk_pixbuf_pyramid_new (pixbuf);
+    GdkPixbuf *level = gdk_pixbuf_pyramid_get_level (view->pyramid, 1);
+    gdk_pixbuf_fill (pixbuf, 0xff000000);
+    gtk_image_view_damage_pixels (view, &(GdkRectangle){10, 10, 4, 4});
+    gtk_image_view_set_pixbuf (view, pixbuf, FALSE);
+    assert (num_calls == 2);
+    assert (!view->damage_id);
+    assert (gdk_pixbuf_get_pixels (level)[0] == 0xff);
+    gtk_image_view_flush_damage (view);
+    assert (num_calls == 2);
+
+    g_object_unref (pixbuf);
+    gtk_widget_destroy (GTK_WIDGET (view));
+    g_object_unref (view);
+}
+
+/**
+ * test_zoom_animation:
+ *
+ * The objective of this test is to verify that with a zoom duration
+ * set, the zoom moves monotonically towards the new zoom with one
+ * zoom-changed signal per frame, and that zooming in again during
+ * the animation starts from the zoom being animated to.
+ **/
+static void
+test_zoom_animation ()
+{
+    printf ("test_zoom_animation\n");
+    GtkImageView *view = GTK_IMAGE_VIEW (gtk_image_view_new ());
+    g_object_ref (view);
+    gtk_object_sink (GTK_OBJECT (view));
+    g_signal_connect (G_OBJECT (view), "zoom_changed",
+                      G_CALLBACK (zoom_changed_cb), NULL);
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        100, 100);
+    gtk_image_view_set_pixbuf (view, pixbuf, FALSE);
+    gtk_image_view_set_zoom_duration (view, 60);
+
+    num_calls = 0;
+    gtk_image_view_set_zoom (view, 3.0);
+    assert (gtk_image_view_get_zoom (view) == 1.0);
+    assert (!num_calls);
+
+    gtk_image_view_zoom_in (view);
+    gdouble target = gtk_zooms_get_zoom_in (3.0);
+    gdouble last_zoom = gotten_zoom = 1.0;
+    while (gtk_image_view_get_zoom (view) != target)
+    {
+        g_main_context_iteration (NULL, TRUE);
+        assert (gotten_zoom >= last_zoom && gotten_zoom <= target);
+        last_zoom = gotten_zoom;
+    }
+    assert (num_calls > 1);
+
+    /* Setting a new pixbuf ends the animation at once. */
+    gtk_image_view_set_zoom (view, 1.0);
+    gtk_image_view_set_pixbuf (view, NULL, FALSE);
+    assert (gtk_image_view_get_zoom (view) == 1.0);
+
+    g_object_unref (pixbuf);
+    gtk_widget_destroy (GTK_WIDGET (view));
+    g_object_unref (view);
+}
+
+/**
+ * test_continuous_zoom:
+ *
+ * The objective of this test is to verify that in continuous zoom
+ * mode the mouse wheel zooms by a constant factor instead of to the
+ * next zoom in the list, and that the view is drawn at full quality
+ * only after the zoom has settled.
+ **/
+static void
+test_continuous_zoom ()
+{
+    printf ("test_continuous_zoom\n");
+    GtkImageView *view = GTK_IMAGE_VIEW (gtk_image_view_new ());
+    g_object_ref (view);
+    gtk_object_sink (GTK_OBJECT (view));
+    fake_realize (GTK_WIDGET (view));
+    GtkAllocation alloc = {0, 0, 100, 100};
+    gtk_widget_size_allocate (GTK_WIDGET (view), &alloc);
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        100, 100);
+    gtk_image_view_set_pixbuf (view, pixbuf, FALSE);
+    gtk_image_view_set_continuous_zoom (view, TRUE);
+
+    GdkEventScroll ev;
+    gboolean retval;
+    ev.direction = GDK_SCROLL_UP;
+    ev.state = GDK_CONTROL_MASK;
+    ev.x = ev.y = 0;
+    g_signal_emit_by_name (view, "scroll-event", &ev, &retval);
+    g_signal_emit_by_name (view, "scroll-event", &ev, &retval);
+    gdouble zoom = gtk_image_view_get_zoom (view);
+    assert (zoom > 1.2 && zoom < gtk_zooms_get_zoom_in (1.0));
+    assert (view->settle_id);
+
+    ev.direction = GDK_SCROLL_DOWN;
+    g_signal_emit_by_name (view, "scroll-event", &ev, &retval);
+    assert (gtk_image_view_get_zoom (view) < zoom);
+
+    /* Until the zoom settles, previews are drawn without scaling
+       anything at full quality. */
+    GdkRectangle area = {0, 0, 100, 100};
+    GdkEventExpose expose = {.area = area,
+                             .region = gdk_region_rectangle (&area)};
+    GdkPixbufDrawCache *cache = GTK_IMAGE_TOOL_DRAGGER (view->tool)->cache;
+    GdkPixbufDrawStats stats;
+    gtk_image_view_reset_stats (view);
+    GTK_WIDGET_GET_CLASS (view)->expose_event (GTK_WIDGET (view), &expose);
+    gtk_image_view_get_stats (view, &stats);
+    assert (stats.n_exposes == 1);
+    assert (!stats.n_draws[GDK_PIXBUF_DRAW_METHOD_SCALE]);
+    assert (cache->last_opts.preview);
+    assert (cache->last_opts.interp == GDK_INTERP_NEAREST);
+
+    while (view->settle_id)
+        g_main_context_iteration (NULL, TRUE);
+
+    /* Then the view is scaled with its interpolation. */
+    GTK_WIDGET_GET_CLASS (view)->expose_event (GTK_WIDGET (view), &expose);
+    gtk_image_view_get_stats (view, &stats);
+    assert (stats.n_exposes == 2);
+    assert (stats.n_draws[GDK_PIXBUF_DRAW_METHOD_SCALE] == 1);
+    assert (!cache->last_opts.preview);
+    assert (cache->last_opts.interp == GDK_INTERP_BILINEAR);
+
+    gdk_region_destroy (expose.region);
+    g_object_unref (pixbuf);
+    gtk_widget_destroy (GTK_WIDGET (view));
+    g_object_unref (view);
+}
+
+static int num_scroll_events = 0;
+
+static gboolean
+scroll_event_cb (GtkWidget      *widget,
+                 GdkEventScroll *ev,
+                 gpointer        data)
+{
+    num_scroll_events++;
+    return FALSE;
+}
+
+/**
+ * test_scroll_events_render_once:
+ *
+ * The objective of this test is to verify that when several scroll
+ * events with ctrl pressed are dispatched between two frames, each
+ * reaches the handlers connected to the view and zooms it, but the
+ * view is only rendered once for all of them.
+ **/
+static void
+test_scroll_events_render_once ()
+{
+    printf ("test_scroll_events_render_once\n");
+    GtkImageView *view = GTK_IMAGE_VIEW (gtk_image_view_new ());
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        100, 100);
+    gtk_image_view_set_pixbuf (view, pixbuf, FALSE);
+    gtk_image_view_set_zoom (view, 1.0);
+    GtkWidget *window = show_in_window (GTK_WIDGET (view), 100, 100);
+    g_signal_connect (G_OBJECT (view), "zoom_changed",
+                      G_CALLBACK (zoom_changed_cb), NULL);
+    g_signal_connect (G_OBJECT (view), "scroll-event",
+                      G_CALLBACK (scroll_event_cb), NULL);
+
+    GdkEvent ev;
+    ev.scroll = (GdkEventScroll){.type = GDK_SCROLL,
+                                 .window = GTK_WIDGET (view)->window,
+                                 .x = 50, .y = 50,
+                                 .direction = GDK_SCROLL_UP,
+                                 .state = GDK_CONTROL_MASK};
+    for (int n = 0; n < 4; n++)
+        gdk_event_put (&ev);
+
+    num_calls = 0;
+    gtk_image_view_reset_stats (view);
+    dispatch_events ();
+
+    gdouble zoom = 1.0;
+    for (int n = 0; n < 4; n++)
+        zoom = gtk_zooms_get_zoom_in (zoom);
+    assert (gtk_image_view_get_zoom (view) == zoom);
+    assert (num_scroll_events == 4);
+    assert (num_calls == 4);
+
+    GdkPixbufDrawStats stats;
+    gtk_image_view_get_stats (view, &stats);
+    assert (stats.n_exposes == 1);
+    assert (stats.n_draws[GDK_PIXBUF_DRAW_METHOD_SCALE] == 1);
+
+    gtk_widget_destroy (window);
+    g_object_unref (pixbuf);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -355,5 +640,10 @@ main (int argc, char *argv[])
     test_pixbuf_changed_emitted_by_setting_pixbuf ();
     test_set_null_scroll_adjustments ();
     test_scroll_handle_dragging ();
-    printf ("8 tests passed.\n");
+    test_loader_damage_is_coalesced ();
+    test_damage_is_coalesced ();
+    test_zoom_animation ();
+    test_continuous_zoom ();
+    test_scroll_events_render_once ();
+    printf ("13 tests passed.\n");
 }
@@ -134,11 +134,65 @@ test_size_allocate_at_image_boundary ()
     g_object_unref (view);
 }
 
+/**
+ * test_resizing_fitted_view_settles:
+ *
+ * The objective of this test is to verify that while a realized view
+ * that fits its image is resized, it draws previews, and that it is
+ * drawn at full quality once the size has not changed for a while.
+ **/
+static void
+test_resizing_fitted_view_settles ()
+{
+    printf ("test_resizing_fitted_view_settles\n");
+    GtkImageView *view = GTK_IMAGE_VIEW (gtk_image_view_new ());
+    g_object_ref (view);
+    gtk_object_sink (GTK_OBJECT (view));
+    fake_realize (GTK_WIDGET (view));
+
+    GtkAllocation alloc = {0, 0, 200, 200};
+    gtk_widget_size_allocate (GTK_WIDGET (view), &alloc);
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        500, 500);
+    gtk_image_view_set_pixbuf (view, pixbuf, TRUE);
+    assert (!view->settle_id);
+
+    for (int n = 1; n <= 10; n++)
+    {
+        alloc.width = alloc.height = 200 + 10 * n;
+        gtk_widget_size_allocate (GTK_WIDGET (view), &alloc);
+        assert (gtk_image_view_get_zoom (view) == alloc.width / 500.0);
+        assert (view->settle_id);
+    }
+    while (view->settle_id)
+        g_main_context_iteration (NULL, TRUE);
+
+    /* An allocation that does not change the zoom draws at full
+       quality right away. */
+    alloc.x = 10;
+    gtk_widget_size_allocate (GTK_WIDGET (view), &alloc);
+    assert (!view->settle_id);
+
+    /* Neither does fitting a new pixbuf into the same allocation. */
+    GdkPixbuf *pixbuf2 = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                         1000, 1000);
+    gtk_image_view_set_pixbuf (view, pixbuf2, TRUE);
+    gtk_widget_size_allocate (GTK_WIDGET (view), &alloc);
+    assert (gtk_image_view_get_zoom (view) == alloc.width / 1000.0);
+    assert (!view->settle_id);
+
+    g_object_unref (pixbuf2);
+    g_object_unref (pixbuf);
+    gtk_widget_destroy (GTK_WIDGET (view));
+    g_object_unref (view);
+}
+
 int
 main (int argc, char *argv[])
 {
     gtk_init (&argc, &argv);
     test_that_image_is_fitted_after_size_changes ();
 	test_size_allocate_at_image_boundary ();
-    printf ("2 tests passed.\n");
+    test_resizing_fitted_view_settles ();
+    printf ("3 tests passed.\n");
 }
@@ -4,6 +4,7 @@
  **/
 #include <src/gtkimagetooldragger.h>
 #include <assert.h>
+#include "testlib/testlib.h"
 
 static GtkImageView *view = NULL;
 // Use two global variables to avoid castings.
@@ -47,11 +48,147 @@ test_cursor_at_point_on_unrealized_view ()
     teardown ();
 }
 
+/**
+ * test_kinetic_fling:
+ *
+ * Ensure that in kinetic mode, the drag is scrolled in the next
+ * frame, that the image keeps moving in the direction it was dragged
+ * after the button is released and that pressing the button again
+ * stops it.
+ **/
+static void
+test_kinetic_fling ()
+{
+    printf ("test_kinetic_fling\n");
+    setup ();
+    fake_realize (GTK_WIDGET (view));
+    GtkAllocation alloc = {0, 0, 200, 200};
+    gtk_widget_size_allocate (GTK_WIDGET (view), &alloc);
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        2000, 2000);
+    gtk_image_view_set_pixbuf (view, pixbuf, FALSE);
+    gtk_image_view_set_zoom (view, 1.0);
+    gtk_image_view_set_offset (view, 0, 0, FALSE);
+
+    assert (!gtk_image_tool_dragger_get_kinetic (dragger));
+    gtk_image_tool_dragger_set_kinetic (dragger, TRUE);
+
+    // Drag the mouse 10 pixels to the left every 10 ms.
+    GdkEventButton press = {.button = 1,
+                            .window = GTK_WIDGET (view)->window,
+                            .x = 150, .y = 100, .time = 1000};
+    assert (gtk_iimage_tool_button_press (tool, &press));
+    for (int n = 1; n <= 5; n++)
+    {
+        GdkEventMotion motion = {.x = 150 - 10 * n, .y = 100,
+                                 .time = 1000 + 10 * n};
+        gtk_iimage_tool_motion_notify (tool, &motion);
+    }
+    GdkRectangle viewport;
+    gtk_image_view_get_viewport (view, &viewport);
+    assert (viewport.x == 0);
+
+    GdkEventButton release = {.button = 1, .x = 100, .y = 100,
+                              .time = 1055};
+    gtk_iimage_tool_button_release (tool, &release);
+    assert (dragger->frame_id);
+    assert (dragger->velocity_x > 0 && !dragger->velocity_y);
+
+    while (dragger->frame_id &&
+           g_main_context_wait_for_event (NULL, 1000 * 1000))
+        g_main_context_iteration (NULL, TRUE);
+    gtk_image_view_get_viewport (view, &viewport);
+    assert (viewport.x > 100 && viewport.y == 0);
+
+    // Fling again and catch the image.
+    gtk_iimage_tool_button_press (tool, &press);
+    gtk_iimage_tool_motion_notify (tool, &(GdkEventMotion){.x = 140,
+                                                           .y = 100,
+                                                           .time = 1010});
+    release.time = 1015;
+    gtk_iimage_tool_button_release (tool, &release);
+    assert (dragger->frame_id);
+    gtk_iimage_tool_button_press (tool, &press);
+    assert (!dragger->frame_id);
+    gtk_iimage_tool_button_release (tool, &release);
+
+    g_object_unref (pixbuf);
+    teardown ();
+}
+
+/**
+ * test_motion_hint_scrolls_to_pointer:
+ *
+ * Ensure that motion hints scroll the image to where the pointer is
+ * and not to where the events say. Hints that piled up behind the
+ * first one then all find the pointer at the same place, so the view
+ * is only rendered once for them.
+ **/
+static void
+test_motion_hint_scrolls_to_pointer ()
+{
+    printf ("test_motion_hint_scrolls_to_pointer\n");
+    setup ();
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        2000, 2000);
+    gtk_image_view_set_pixbuf (view, pixbuf, FALSE);
+    gtk_image_view_set_zoom (view, 1.0);
+    gtk_image_view_set_offset (view, 0, 0, FALSE);
+
+    // Put the view where the pointer is 50 pixels from its left edge.
+    int x, y;
+    gdk_window_get_pointer (gdk_get_default_root_window (), &x, &y, NULL);
+    GtkWidget *window = show_in_window (GTK_WIDGET (view), 200, 200);
+    gtk_window_move (GTK_WINDOW (window), x - 50, y - 100);
+    dispatch_events ();
+    GdkWindow *view_window = GTK_WIDGET (view)->window;
+    gdk_window_get_pointer (view_window, &x, &y, NULL);
+    assert (x >= 0 && x + 100 < 200 && y >= 0 && y < 200);
+
+    // Pressed 100 pixels to the right of where the pointer is now.
+    GdkEvent ev;
+    ev.button = (GdkEventButton){.type = GDK_BUTTON_PRESS,
+                                 .window = view_window, .button = 1,
+                                 .x = x + 100, .y = y,
+                                 .time = GDK_CURRENT_TIME};
+    gdk_event_put (&ev);
+    for (int n = 1; n <= 99; n++)
+    {
+        ev.motion = (GdkEventMotion){.type = GDK_MOTION_NOTIFY,
+                                     .window = view_window,
+                                     .x = n, .y = n, .is_hint = TRUE,
+                                     .time = GDK_CURRENT_TIME};
+        gdk_event_put (&ev);
+    }
+    ev.button = (GdkEventButton){.type = GDK_BUTTON_RELEASE,
+                                 .window = view_window, .button = 1,
+                                 .x = x, .y = y,
+                                 .time = GDK_CURRENT_TIME};
+    gdk_event_put (&ev);
+
+    gtk_image_view_reset_stats (view);
+    dispatch_events ();
+    GdkRectangle viewport;
+    gtk_image_view_get_viewport (view, &viewport);
+    assert (viewport.x == 100 && viewport.y == 0);
+    assert (!dragger->mouse_handler->pressed);
+
+    GdkPixbufDrawStats stats;
+    gtk_image_view_get_stats (view, &stats);
+    assert (stats.n_exposes == 1);
+
+    gtk_widget_destroy (window);
+    g_object_unref (pixbuf);
+    teardown ();
+}
+
 int
 main (int   argc,
       char *argv[])
 {
     gtk_init (&argc, &argv);
     test_cursor_at_point_on_unrealized_view ();
-    printf ("1 test passed.\n");
+    test_kinetic_fling ();
+    test_motion_hint_scrolls_to_pointer ();
+    printf ("3 tests passed.\n");
 }
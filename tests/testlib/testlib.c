@@ -23,7 +23,8 @@ fake_realize (GtkWidget *widget)
                         | GDK_BUTTON_MOTION_MASK
                         | GDK_BUTTON_PRESS_MASK
                         | GDK_BUTTON_RELEASE_MASK
-                        | GDK_POINTER_MOTION_MASK);
+                        | GDK_POINTER_MOTION_MASK
+                        | GDK_POINTER_MOTION_HINT_MASK);
                         
     int attr_mask = (GDK_WA_X | GDK_WA_Y | GDK_WA_VISUAL | GDK_WA_COLORMAP);
     widget->window = gdk_window_new (NULL, &attrs, attr_mask);
@@ -56,3 +57,42 @@ g_main_context_wait_for_event (GMainContext *context,
     }
     return FALSE;
 }
+
+/**
+ * show_in_window:
+ * @widget: a #GtkWidget
+ * @width: width to request for @widget
+ * @height: height to request for @widget
+ * @returns: the new toplevel window
+ *
+ * Adds @widget to a new toplevel window, shows it and handles the
+ * events until it has been drawn. Unlike fake_realize(), the widget
+ * is really realized and mapped, so events and exposes reach it
+ * through the main loop.
+ **/
+GtkWidget *
+show_in_window (GtkWidget *widget,
+                int        width,
+                int        height)
+{
+    GtkWidget *window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+    gtk_widget_set_size_request (widget, width, height);
+    gtk_container_add (GTK_CONTAINER (window), widget);
+    gtk_widget_show_all (window);
+    dispatch_events ();
+    return window;
+}
+
+/**
+ * dispatch_events:
+ *
+ * Waits for the X server to handle all requests and then handles
+ * events, redraws and idle callbacks until none are pending.
+ **/
+void
+dispatch_events (void)
+{
+    gdk_display_sync (gdk_display_get_default ());
+    while (gtk_events_pending ())
+        gtk_main_iteration_do (FALSE);
+}
@@ -6,5 +6,9 @@
 void          fake_realize                   (GtkWidget *widget);
 gboolean      g_main_context_wait_for_event  (GMainContext *context,
                                               int           timeout);
+GtkWidget    *show_in_window                 (GtkWidget    *widget,
+                                              int           width,
+                                              int           height);
+void          dispatch_events                (void);
 
 #endif